@@ -2,6 +2,7 @@ let g:libclang#lib_path = expand('<sfile>:p:h:h') . '/lib/libclang-vim.so'
 
 let s:LIST_TYPE = type([])
 let s:STRING_TYPE = type('')
+let s:FUNCREF_TYPE = type(function('tr'))
 
 if ! filereadable(g:libclang#lib_path)
     echoerr 'libclang-vim: ' . g:libclang#lib_path . ' is not found! Please execute `make` in ' . expand('<sfile>:p:h:h')
@@ -25,12 +26,67 @@ function! s:get_extra_string(extra)
     endif
 endfunction
 
+" The argument strings of the APIs, shared with libclang#server#call().
+function! libclang#args(file, extra)
+    return a:file . ':' . s:get_extra_string(a:extra)
+endfunction
+
+function! libclang#args_at(file, line, col, extra)
+    return printf("%s:%s:%d:%d", a:file, s:get_extra_string(a:extra), a:line, a:col)
+endfunction
+
+function! libclang#args_completion_at(file, line, col, prefix, limit, extra)
+    return printf("%s:%s:%d:%d:%s:%d", a:file, s:get_extra_string(a:extra), a:line, a:col, a:prefix, a:limit)
+endfunction
+
+function! libclang#args_with_generation(file, generation, extra)
+    return printf("%s:%s:%d", a:file, s:get_extra_string(a:extra), a:generation)
+endfunction
+
+" Splits a trailing Funcref off the optional arguments of the APIs.
+function! s:split_callback(extra)
+    if type(a:extra) == s:LIST_TYPE && !empty(a:extra) && type(a:extra[-1]) == s:FUNCREF_TYPE
+        return [a:extra[: -2], a:extra[-1]]
+    endif
+    return [a:extra, v:null]
+endfunction
+
+" Runs {api} with {argument} in the server if it's running, with libcall()
+" otherwise. With a {Callback}, the server call returns v:null right away
+" and {Callback} gets the result later; with libcall() it gets the result
+" before the call returns it.
+function! libclang#eval(api, argument, Callback)
+    if libclang#server#is_running()
+        if a:Callback isnot v:null
+            call libclang#server#call(a:api, a:argument, a:Callback)
+            return v:null
+        endif
+        return libclang#server#eval(a:api, a:argument)
+    endif
+
+    let result = eval(libcall(g:libclang#lib_path, a:api, a:argument))
+    if a:Callback isnot v:null
+        call call(a:Callback, [result])
+    endif
+    return result
+endfunction
+
 function! libclang#call(api, file, extra)
-    let compiler_args = s:get_extra_string(a:extra)
-    return eval(libcall(g:libclang#lib_path, a:api, a:file . ':' . compiler_args))
+    let [extra, Callback] = s:split_callback(a:extra)
+    return libclang#eval(a:api, libclang#args(a:file, extra), Callback)
 endfunction
 
 function! libclang#call_at(api, file, line, col, extra)
-    let compiler_args = s:get_extra_string(a:extra)
-    return eval(libcall(g:libclang#lib_path, a:api, printf("%s:%s:%d:%d", a:file, compiler_args, a:line, a:col)))
+    let [extra, Callback] = s:split_callback(a:extra)
+    return libclang#eval(a:api, libclang#args_at(a:file, a:line, a:col, extra), Callback)
+endfunction
+
+function! libclang#call_completion_at(api, file, line, col, prefix, limit, extra)
+    let [extra, Callback] = s:split_callback(a:extra)
+    return libclang#eval(a:api, libclang#args_completion_at(a:file, a:line, a:col, a:prefix, a:limit, extra), Callback)
+endfunction
+
+function! libclang#call_with_generation(api, file, generation, extra)
+    let [extra, Callback] = s:split_callback(a:extra)
+    return libclang#eval(a:api, libclang#args_with_generation(a:file, a:generation, extra), Callback)
 endfunction
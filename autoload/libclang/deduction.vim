@@ -16,6 +16,15 @@ endfunction
 function! libclang#deduction#completion_at(filename, line, col, ...)
     return libclang#call_at('vim_clang_get_completion_at', a:filename, a:line, a:col, a:000)
 endfunction
+function! libclang#deduction#filtered_completion_at(filename, line, col, prefix, limit, ...)
+    return libclang#call_completion_at('vim_clang_get_filtered_completion_at', a:filename, a:line, a:col, a:prefix, a:limit, a:000)
+endfunction
+function! libclang#deduction#completion_items_at(filename, line, col, prefix, limit, ...)
+    return libclang#call_completion_at('vim_clang_get_completion_items_at', a:filename, a:line, a:col, a:prefix, a:limit, a:000)
+endfunction
+function! libclang#deduction#completion_detail(id, ...)
+    return libclang#eval('vim_clang_get_completion_detail', a:id, get(a:000, 0, v:null))
+endfunction
 function! libclang#deduction#comment_at(filename, line, col, ...)
     return libclang#call_at('vim_clang_get_comment_at', a:filename, a:line, a:col, a:000)
 endfunction
@@ -32,3 +41,9 @@ function! libclang#deduction#diagnostics(filename, ...)
     return libclang#call('vim_clang_get_diagnostics', a:filename, a:000)
 endfunction
 
+function! libclang#deduction#schedule_diagnostics(filename, generation, ...)
+    return libclang#call_with_generation('vim_clang_schedule_diagnostics', a:filename, a:generation, a:000)
+endfunction
+function! libclang#deduction#latest_diagnostics(filename)
+    return libclang#call('vim_clang_get_latest_diagnostics', a:filename, "")
+endfunction
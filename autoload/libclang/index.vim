@@ -0,0 +1,21 @@
+function! libclang#index#project(directory, ...)
+    return libclang#eval('vim_clang_index_project', a:directory, get(a:000, 0, v:null))
+endfunction
+function! libclang#index#update(directory, ...)
+    return libclang#eval('vim_clang_update_project_index', a:directory, get(a:000, 0, v:null))
+endfunction
+function! libclang#index#definition_at(filename, line, col, ...)
+    return libclang#call_at('vim_clang_get_project_definition_at', a:filename, a:line, a:col, a:000)
+endfunction
+function! libclang#index#references_at(filename, line, col, ...)
+    return libclang#call_at('vim_clang_get_project_references_at', a:filename, a:line, a:col, a:000)
+endfunction
+function! libclang#index#search_symbols(directory, query, limit, ...)
+    return libclang#eval('vim_clang_search_project_symbols', printf("%s:%s:%d", a:directory, a:query, a:limit), get(a:000, 0, v:null))
+endfunction
+function! libclang#index#includers(filename, ...)
+    return libclang#eval('vim_clang_get_project_includers', fnamemodify(a:filename, ':p'), get(a:000, 0, v:null))
+endfunction
+function! libclang#index#virtual_calls(directory, ...)
+    return libclang#eval('vim_clang_get_project_virtual_calls', a:directory, get(a:000, 0, v:null))
+endfunction
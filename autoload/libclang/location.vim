@@ -49,3 +49,6 @@ endfunction
 function! libclang#location#class_type_of_member_pointer_at(filename, line, col, ...)
     return libclang#call_at('vim_clang_get_class_type_of_member_pointer_at', a:filename, a:line, a:col, a:000)
 endfunction
+function! libclang#location#layout_at(filename, line, col, ...)
+    return libclang#call_at('vim_clang_get_layout_at', a:filename, a:line, a:col, a:000)
+endfunction
@@ -0,0 +1,18 @@
+function! libclang#profile#includes(filename, ...)
+    return libclang#call('vim_clang_profile_includes', a:filename, a:000)
+endfunction
+function! libclang#profile#padding(directory, ...)
+    return libclang#eval('vim_clang_scan_project_padding', a:directory, get(a:000, 0, v:null))
+endfunction
+function! libclang#profile#virtual_calls(filename, ...)
+    return libclang#call('vim_clang_extract_virtual_calls', a:filename, a:000)
+endfunction
+function! libclang#profile#functions(filename, ...)
+    return libclang#call('vim_clang_extract_function_metrics', a:filename, a:000)
+endfunction
+function! libclang#profile#project_functions(directory, ...)
+    return libclang#eval('vim_clang_measure_project_functions', a:directory, get(a:000, 0, v:null))
+endfunction
+function! libclang#profile#scheduler(...)
+    return libclang#eval('vim_clang_get_scheduler_stats', '', get(a:000, 0, v:null))
+endfunction
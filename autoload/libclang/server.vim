@@ -0,0 +1,108 @@
+" Runs the same APIs as libclang#call() in a separate process, so queries
+" don't block the editor and a crash of libclang doesn't take it down.
+let g:libclang#server#path = expand('<sfile>:p:h:h:h') . '/server/libclang-vim-server'
+
+let s:job = v:null
+
+" Project-wide methods run for minutes on a large project, far longer than
+" the 2 seconds ch_evalexpr() waits by default.
+let s:PROJECT_METHODS = [
+            \ 'vim_clang_index_project',
+            \ 'vim_clang_update_project_index',
+            \ 'vim_clang_scan_project_padding',
+            \ 'vim_clang_measure_project_functions',
+            \ 'vim_clang_get_project_virtual_calls',
+            \ ]
+let g:libclang#server#project_timeout = get(g:, 'libclang#server#project_timeout', 600000)
+
+function! s:get_channel()
+    if s:job is v:null || job_status(s:job) !=# 'run'
+        " Restarted on the next query if it crashed.
+        let s:job = job_start([g:libclang#server#path], {'mode': 'json', 'err_io': 'null'})
+    endif
+    return job_getchannel(s:job)
+endfunction
+
+function! s:report_error(error)
+    echohl ErrorMsg
+    echomsg 'libclang-vim: ' . a:error
+    echohl None
+endfunction
+
+function! s:on_response(callback, on_error, channel, response)
+    if type(a:response) != type({}) || has_key(a:response, 'error')
+        let error = type(a:response) == type({}) ? a:response.error : 'no response'
+        if a:on_error isnot v:null
+            call call(a:on_error, [error])
+        elseif error !=# 'cancelled'
+            " Cancelled ones were superseded by a newer query for the same
+            " buffer, which gets the answer.
+            call s:report_error(error)
+        endif
+        return
+    endif
+    call call(a:callback, [a:response.result])
+endfunction
+
+" Starts the server, so libclang#call() and the wrappers around it use it.
+function! libclang#server#start()
+    call s:get_channel()
+endfunction
+
+function! libclang#server#is_running()
+    return s:job isnot v:null && job_status(s:job) ==# 'run'
+endfunction
+
+" Calls {api} with {argument}, like libcall() does, and {callback} with the
+" result once it's ready. The optional priority is 'interactive', 'visible'
+" or 'background', the server picks one from {api} by default. The optional
+" {on_error} gets the error message of a failed or cancelled request,
+" otherwise errors other than cancellations are reported as messages.
+function! libclang#server#call(api, argument, callback, ...)
+    let request = {'method': a:api, 'argument': a:argument}
+    if a:0 > 0 && a:1 isnot v:null
+        let request.priority = a:1
+    endif
+    let OnError = a:0 > 1 ? a:2 : v:null
+    call ch_sendexpr(s:get_channel(), request, {'callback': function('s:on_response', [a:callback, OnError])})
+endfunction
+
+" Same as libclang#server#call(), but waits for the result and returns it,
+" or v:null after reporting an error. Project-wide methods get
+" g:libclang#server#project_timeout milliseconds instead of the default 2
+" seconds: Vim waits for them, pass a callback to the wrappers to avoid that.
+function! libclang#server#eval(api, argument)
+    let options = {}
+    if index(s:PROJECT_METHODS, a:api) >= 0
+        let options.timeout = g:libclang#server#project_timeout
+    endif
+    let response = ch_evalexpr(s:get_channel(), {'method': a:api, 'argument': a:argument}, options)
+    if type(response) != type({}) || has_key(response, 'error')
+        call s:report_error(type(response) == type({}) ? response.error : 'no response')
+        return v:null
+    endif
+    return response.result
+endfunction
+
+function! libclang#server#call_file(api, file, extra, callback)
+    call libclang#server#call(a:api, libclang#args(a:file, a:extra), a:callback)
+endfunction
+
+function! libclang#server#call_at(api, file, line, col, extra, callback)
+    call libclang#server#call(a:api, libclang#args_at(a:file, a:line, a:col, a:extra), a:callback)
+endfunction
+
+function! libclang#server#call_completion_at(api, file, line, col, prefix, limit, extra, callback)
+    call libclang#server#call(a:api, libclang#args_completion_at(a:file, a:line, a:col, a:prefix, a:limit, a:extra), a:callback)
+endfunction
+
+function! libclang#server#call_with_generation(api, file, generation, extra, callback)
+    call libclang#server#call(a:api, libclang#args_with_generation(a:file, a:generation, a:extra), a:callback)
+endfunction
+
+function! libclang#server#stop()
+    if s:job isnot v:null
+        call job_stop(s:job)
+        let s:job = v:null
+    endif
+endfunction
@@ -1,5 +1,7 @@
 #include "AST_extracter.hpp"
 
+#include "translation_unit_cache.hpp"
+
 namespace {
 
 enum { result = 0, visit_policy, predicate };
@@ -14,18 +16,11 @@ CXChildVisitResult AST_extracter(CXCursor cursor, CXCursor parent,
     auto& vimson = std::get<result>(callback_data);
     auto& policy = std::get<visit_policy>(callback_data);
 
-    if (policy == libclang_vim::extraction_policy::current_file) {
-        auto const location = clang_getCursorLocation(cursor);
-        if (!clang_Location_isFromMainFile(location)) {
-            return CXChildVisit_Continue;
-        }
-    }
+    if (libclang_vim::is_cancelled())
+        return CXChildVisit_Break;
 
-    if (policy == libclang_vim::extraction_policy::non_system_headers) {
-        auto const location = clang_getCursorLocation(cursor);
-        if (clang_Location_isInSystemHeader(location)) {
-            return CXChildVisit_Continue;
-        }
+    if (!libclang_vim::is_extracted(policy, cursor)) {
+        return CXChildVisit_Continue;
     }
 
     bool const is_target_node = std::get<predicate>(callback_data)(cursor);
@@ -45,29 +40,44 @@ CXChildVisitResult AST_extracter(CXCursor cursor, CXCursor parent,
 }
 }
 
+bool libclang_vim::is_extracted(extraction_policy policy,
+                                const CXCursor& cursor) {
+    if (policy == extraction_policy::current_file) {
+        auto const location = clang_getCursorLocation(cursor);
+        if (!clang_Location_isFromMainFile(location)) {
+            return false;
+        }
+    }
+
+    if (policy == extraction_policy::non_system_headers) {
+        auto const location = clang_getCursorLocation(cursor);
+        if (clang_Location_isInSystemHeader(location)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 const char* libclang_vim::extract_AST_nodes(
     char const* arguments, extraction_policy const policy,
     const std::function<bool(const CXCursor&)>& predicate) {
-    static std::string vimson;
+    thread_local std::string vimson;
     vimson = "";
 
     auto const parsed = parse_default_args(arguments);
-    auto const args_ptrs = get_args_ptrs(parsed.args);
 
     callback_data_type callback_data{vimson, policy, predicate};
 
-    cxindex_ptr index =
-        clang_createIndex(/*excludeDeclsFromPCH*/ 1, /*displayDiagnostics*/ 0);
-    std::vector<CXUnsavedFile> unsaved_files = create_unsaved_files(parsed);
-    cxtranslation_unit_ptr translation_unit(clang_parseTranslationUnit(
-        index, parsed.file.c_str(), args_ptrs.data(), args_ptrs.size(),
-        unsaved_files.data(), unsaved_files.size(),
-        CXTranslationUnit_Incomplete));
+    auto const translation_unit =
+        get_translation_unit_cache().get_current(parsed);
     if (!translation_unit)
         return "{}";
 
     CXCursor cursor = clang_getTranslationUnitCursor(translation_unit);
     clang_visitChildren(cursor, AST_extracter, &callback_data);
+    if (is_cancelled())
+        return "{}";
 
     vimson = "{'root':[" + vimson + "]}";
 
@@ -17,6 +17,9 @@ enum struct extraction_policy {
     current_file,
 };
 
+/// Returns false if cursor is outside of what policy extracts.
+bool is_extracted(extraction_policy policy, const CXCursor& cursor);
+
 const char*
 extract_AST_nodes(char const* arguments, extraction_policy const policy,
                   const std::function<bool(const CXCursor&)>& predicate);
@@ -1,31 +1,96 @@
+#include <fcntl.h>
 #include <unistd.h>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
 #include <tuple>
 
 #include <clang-c/Index.h>
 
+#include "clang_vim.h"
 #include "helpers.hpp"
 #include "tokenizer.hpp"
 #include "AST_extracter.hpp"
 #include "location.hpp"
+#include "node_array.hpp"
 #include "deduction.hpp"
-
-/// Ensures that writes to stderr are ignored.
+#include "function_metrics.hpp"
+#include "completion.hpp"
+#include "diagnostics_engine.hpp"
+#include "include_graph.hpp"
+#include "include_profile.hpp"
+#include "layout.hpp"
+#include "indexer.hpp"
+#include "project.hpp"
+#include "query_memo.hpp"
+#include "scheduler.hpp"
+#include "session.hpp"
+#include "virtual_calls.hpp"
+
+/// Ensures that writes to stderr are ignored while Vim calls the library.
+/// Calls may overlap, so the first guard points stderr to /dev/null and the
+/// last one restores it. dup2() replaces descriptor 2 atomically, other
+/// threads never find it closed and get it for their own files. Descriptor 2
+/// belongs to the whole process, so queries of a host's session leave it
+/// alone, the host decides where it goes.
 class stderr_guard {
-    int m_stderr;
+    static std::mutex m_mutex;
+    static unsigned m_count;
+    static int m_stderr;
+    bool m_active;
 
   public:
-    stderr_guard() : m_stderr(dup(STDERR_FILENO)) {
-        // Close stderr.
-        close(STDERR_FILENO);
+    stderr_guard() : m_active(!libclang_vim::has_session_scope()) {
+        if (!m_active)
+            return;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_count++)
+            return;
+        static const int devnull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        if (devnull < 0)
+            return;
+        m_stderr = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 0);
+        if (m_stderr >= 0)
+            dup2(devnull, STDERR_FILENO);
     }
 
     ~stderr_guard() {
+        if (!m_active)
+            return;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_count || m_stderr < 0)
+            return;
         // Restore stderr.
-        dup(m_stderr);
+        dup2(m_stderr, STDERR_FILENO);
         close(m_stderr);
+        m_stderr = -1;
     }
 };
 
+std::mutex stderr_guard::m_mutex;
+unsigned stderr_guard::m_count = 0;
+int stderr_guard::m_stderr = -1;
+
+/// State of a host's session, see vim_clang_create_session().
+struct vim_clang_session {
+    libclang_vim::session state;
+};
+
+namespace {
+
+using libcall_function_map =
+    std::map<std::string, char const* (*)(char const*)>;
+
+libcall_function_map get_libcall_functions() {
+    libcall_function_map functions;
+#define LIBCLANG_VIM_ADD_FUNCTION(name) functions[#name] = name;
+    LIBCLANG_VIM_LIBCALL_FUNCTIONS(LIBCLANG_VIM_ADD_FUNCTION)
+#undef LIBCLANG_VIM_ADD_FUNCTION
+    return functions;
+}
+}
+
 extern "C" {
 
 char const* vim_clang_version() {
@@ -33,492 +98,592 @@ char const* vim_clang_version() {
 }
 
 char const* vim_clang_tokens(char const* arguments) {
-    auto const parsed = libclang_vim::parse_default_args(arguments);
-    libclang_vim::tokenizer tokenizer{};
-    static auto const vimson = tokenizer.tokenize_as_vimson(parsed);
-    return vimson.c_str();
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        auto const parsed = libclang_vim::parse_default_args(arguments);
+        libclang_vim::tokenizer tokenizer{};
+        thread_local std::string vimson;
+        vimson = tokenizer.tokenize_as_vimson(parsed);
+        return vimson.c_str();
+    });
 }
 
 // API to extract AST nodes {{{
 // API to extract all {{{
 char const* vim_clang_extract_all(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::all,
-        [](CXCursor const&) { return true; });
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::all,
+            [](CXCursor const&) { return true; });
+    });
 }
 
 char const* vim_clang_extract_declarations(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::all, [](CXCursor const& c) {
-            return clang_isDeclaration(clang_getCursorKind(c));
-        });
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::all,
+            [](CXCursor const& c) {
+                return clang_isDeclaration(clang_getCursorKind(c));
+            });
+    });
 }
 
 char const* vim_clang_extract_attributes(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::all, [](CXCursor const& c) {
-            return clang_isAttribute(clang_getCursorKind(c));
-        });
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::all,
+            [](CXCursor const& c) {
+                return clang_isAttribute(clang_getCursorKind(c));
+            });
+    });
 }
 
 char const* vim_clang_extract_expressions(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::all, [](CXCursor const& c) {
-            return clang_isExpression(clang_getCursorKind(c));
-        });
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::all,
+            [](CXCursor const& c) {
+                return clang_isExpression(clang_getCursorKind(c));
+            });
+    });
 }
 
 char const* vim_clang_extract_preprocessings(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::all, [](CXCursor const& c) {
-            return clang_isPreprocessing(clang_getCursorKind(c));
-        });
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::all,
+            [](CXCursor const& c) {
+                return clang_isPreprocessing(clang_getCursorKind(c));
+            });
+    });
 }
 
 char const* vim_clang_extract_references(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::all, [](CXCursor const& c) {
-            return clang_isReference(clang_getCursorKind(c));
-        });
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::all,
+            [](CXCursor const& c) {
+                return clang_isReference(clang_getCursorKind(c));
+            });
+    });
 }
 
 char const* vim_clang_extract_statements(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::all, [](CXCursor const& c) {
-            return clang_isStatement(clang_getCursorKind(c));
-        });
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::all,
+            [](CXCursor const& c) {
+                return clang_isStatement(clang_getCursorKind(c));
+            });
+    });
 }
 
 char const* vim_clang_extract_translation_units(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::all, [](CXCursor const& c) {
-            return clang_isTranslationUnit(clang_getCursorKind(c));
-        });
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::all,
+            [](CXCursor const& c) {
+                return clang_isTranslationUnit(clang_getCursorKind(c));
+            });
+    });
 }
 
 char const* vim_clang_extract_definitions(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::all,
-        [](CXCursor const& c) { return clang_isCursorDefinition(c); });
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::all,
+            [](CXCursor const& c) { return clang_isCursorDefinition(c); });
+    });
 }
 
 char const* vim_clang_extract_virtual_member_functions(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::all,
-        [](CXCursor const& c) { return clang_CXXMethod_isVirtual(c); });
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::all,
+            [](CXCursor const& c) { return clang_CXXMethod_isVirtual(c); });
+    });
 }
 
 char const*
 vim_clang_extract_pure_virtual_member_functions(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::all,
-        [](CXCursor const& c) { return clang_CXXMethod_isPureVirtual(c); });
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::all,
+            [](CXCursor const& c) { return clang_CXXMethod_isPureVirtual(c); });
+    });
 }
 
 char const* vim_clang_extract_static_member_functions(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::all,
-        [](CXCursor const& c) { return clang_CXXMethod_isStatic(c); });
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::all,
+            [](CXCursor const& c) { return clang_CXXMethod_isStatic(c); });
+    });
 }
 // }}}
 
 // API to extract current file only {{{
 char const* vim_clang_extract_all_current_file(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::current_file,
-        [](CXCursor const&) -> bool { return true; });
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::current_file,
+            [](CXCursor const&) -> bool { return true; });
+    });
 }
 
 char const* vim_clang_extract_declarations_current_file(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::current_file,
-        [](CXCursor const& c) {
-            return clang_isDeclaration(clang_getCursorKind(c));
-        });
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::current_file,
+            [](CXCursor const& c) {
+                return clang_isDeclaration(clang_getCursorKind(c));
+            });
+    });
 }
 
 char const* vim_clang_extract_attributes_current_file(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::current_file,
-        [](CXCursor const& c) {
-            return clang_isAttribute(clang_getCursorKind(c));
-        });
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::current_file,
+            [](CXCursor const& c) {
+                return clang_isAttribute(clang_getCursorKind(c));
+            });
+    });
 }
 
 char const* vim_clang_extract_expressions_current_file(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::current_file,
-        [](CXCursor const& c) {
-            return clang_isExpression(clang_getCursorKind(c));
-        });
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::current_file,
+            [](CXCursor const& c) {
+                return clang_isExpression(clang_getCursorKind(c));
+            });
+    });
 }
 
 char const*
 vim_clang_extract_preprocessings_current_file(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::current_file,
-        [](CXCursor const& c) {
-            return clang_isPreprocessing(clang_getCursorKind(c));
-        });
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::current_file,
+            [](CXCursor const& c) {
+                return clang_isPreprocessing(clang_getCursorKind(c));
+            });
+    });
 }
 
 char const* vim_clang_extract_references_current_file(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::current_file,
-        [](CXCursor const& c) {
-            return clang_isReference(clang_getCursorKind(c));
-        });
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::current_file,
+            [](CXCursor const& c) {
+                return clang_isReference(clang_getCursorKind(c));
+            });
+    });
 }
 
 char const* vim_clang_extract_statements_current_file(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::current_file,
-        [](CXCursor const& c) {
-            return clang_isStatement(clang_getCursorKind(c));
-        });
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::current_file,
+            [](CXCursor const& c) {
+                return clang_isStatement(clang_getCursorKind(c));
+            });
+    });
 }
 
 char const*
 vim_clang_extract_translation_units_current_file(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::current_file,
-        [](CXCursor const& c) {
-            return clang_isTranslationUnit(clang_getCursorKind(c));
-        });
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::current_file,
+            [](CXCursor const& c) {
+                return clang_isTranslationUnit(clang_getCursorKind(c));
+            });
+    });
 }
 
 char const* vim_clang_extract_definitions_current_file(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::current_file,
-        clang_isCursorDefinition);
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::current_file,
+            clang_isCursorDefinition);
+    });
 }
 
 char const*
 vim_clang_extract_virtual_member_functions_current_file(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::current_file,
-        clang_CXXMethod_isVirtual);
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::current_file,
+            clang_CXXMethod_isVirtual);
+    });
 }
 
 char const* vim_clang_extract_pure_virtual_member_functions_current_file(
     char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::current_file,
-        clang_CXXMethod_isPureVirtual);
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::current_file,
+            clang_CXXMethod_isPureVirtual);
+    });
 }
 
 char const*
 vim_clang_extract_static_member_functions_current_file(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::current_file,
-        clang_CXXMethod_isStatic);
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::current_file,
+            clang_CXXMethod_isStatic);
+    });
 }
 // }}}
 
 // API to extract current file only {{{
 char const* vim_clang_extract_all_non_system_headers(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::non_system_headers,
-        [](CXCursor const&) -> bool { return true; });
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::non_system_headers,
+            [](CXCursor const&) -> bool { return true; });
+    });
 }
 
 char const*
 vim_clang_extract_declarations_non_system_headers(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::non_system_headers,
-        [](CXCursor const& c) {
-            return clang_isDeclaration(clang_getCursorKind(c));
-        });
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::non_system_headers,
+            [](CXCursor const& c) {
+                return clang_isDeclaration(clang_getCursorKind(c));
+            });
+    });
 }
 
 char const*
 vim_clang_extract_attributes_non_system_headers(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::non_system_headers,
-        [](CXCursor const& c) {
-            return clang_isAttribute(clang_getCursorKind(c));
-        });
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::non_system_headers,
+            [](CXCursor const& c) {
+                return clang_isAttribute(clang_getCursorKind(c));
+            });
+    });
 }
 
 char const*
 vim_clang_extract_expressions_non_system_headers(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::non_system_headers,
-        [](CXCursor const& c) {
-            return clang_isExpression(clang_getCursorKind(c));
-        });
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::non_system_headers,
+            [](CXCursor const& c) {
+                return clang_isExpression(clang_getCursorKind(c));
+            });
+    });
 }
 
 char const*
 vim_clang_extract_preprocessings_non_system_headers(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::non_system_headers,
-        [](CXCursor const& c) {
-            return clang_isPreprocessing(clang_getCursorKind(c));
-        });
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::non_system_headers,
+            [](CXCursor const& c) {
+                return clang_isPreprocessing(clang_getCursorKind(c));
+            });
+    });
 }
 
 char const*
 vim_clang_extract_references_non_system_headers(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::non_system_headers,
-        [](CXCursor const& c) {
-            return clang_isReference(clang_getCursorKind(c));
-        });
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::non_system_headers,
+            [](CXCursor const& c) {
+                return clang_isReference(clang_getCursorKind(c));
+            });
+    });
 }
 
 char const*
 vim_clang_extract_statements_non_system_headers(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::non_system_headers,
-        [](CXCursor const& c) {
-            return clang_isStatement(clang_getCursorKind(c));
-        });
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::non_system_headers,
+            [](CXCursor const& c) {
+                return clang_isStatement(clang_getCursorKind(c));
+            });
+    });
 }
 
 char const*
 vim_clang_extract_translation_units_non_system_headers(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::non_system_headers,
-        [](CXCursor const& c) {
-            return clang_isTranslationUnit(clang_getCursorKind(c));
-        });
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::non_system_headers,
+            [](CXCursor const& c) {
+                return clang_isTranslationUnit(clang_getCursorKind(c));
+            });
+    });
 }
 
 char const*
 vim_clang_extract_definitions_non_system_headers(char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::non_system_headers,
-        clang_isCursorDefinition);
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::non_system_headers,
+            clang_isCursorDefinition);
+    });
 }
 
 char const* vim_clang_extract_virtual_member_functions_non_system_headers(
     char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::non_system_headers,
-        clang_CXXMethod_isVirtual);
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::non_system_headers,
+            clang_CXXMethod_isVirtual);
+    });
 }
 
 char const* vim_clang_extract_pure_virtual_member_functions_non_system_headers(
     char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::non_system_headers,
-        clang_CXXMethod_isPureVirtual);
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::non_system_headers,
+            clang_CXXMethod_isPureVirtual);
+    });
 }
 
 char const* vim_clang_extract_static_member_functions_non_system_headers(
     char const* arguments) {
-    return libclang_vim::extract_AST_nodes(
-        arguments, libclang_vim::extraction_policy::non_system_headers,
-        clang_CXXMethod_isStatic);
+    return libclang_vim::memoize(__func__, arguments, [&] {
+        return libclang_vim::extract_AST_nodes(
+            arguments, libclang_vim::extraction_policy::non_system_headers,
+            clang_CXXMethod_isStatic);
+    });
 }
 // }}}
 // }}}
 
 // API to get information of specific location {{{
 char const* vim_clang_get_location_information(char const* location_string) {
-    auto const location_info =
-        libclang_vim::parse_args_with_location(location_string);
-    char const* file_name = location_info.file.c_str();
-    auto const args_ptrs = libclang_vim::get_args_ptrs(location_info.args);
-    libclang_vim::cxindex_ptr index =
-        clang_createIndex(/*excludeDeclsFromPCH*/ 1, /*displayDiagnostics*/ 0);
-    std::vector<CXUnsavedFile> unsaved_files =
-        create_unsaved_files(location_info);
-    libclang_vim::cxtranslation_unit_ptr translation_unit(
-        clang_parseTranslationUnit(index, file_name, args_ptrs.data(),
-                                   args_ptrs.size(), unsaved_files.data(),
-                                   unsaved_files.size(),
-                                   CXTranslationUnit_Incomplete));
-    if (!translation_unit)
-        return "{}";
-
-    CXFile file = clang_getFile(translation_unit, file_name);
-    auto const location = clang_getLocation(
-        translation_unit, file, location_info.line, location_info.col);
-    CXCursor const cursor = clang_getCursor(translation_unit, location);
-    static std::string result;
-    result = "{" + libclang_vim::stringize_cursor(
-                       cursor, clang_getCursorSemanticParent(cursor)) +
-             "}";
-
-    return result.c_str();
+    return libclang_vim::memoize(__func__, location_string, [&] {
+        auto const location_info =
+            libclang_vim::parse_args_with_location(location_string);
+        return libclang_vim::at_specific_location(
+            location_info, [](CXCursor const& cursor) {
+                return "{" +
+                       libclang_vim::stringize_cursor(
+                           cursor, clang_getCursorSemanticParent(cursor)) +
+                       "}";
+            });
+    });
 }
 // }}}
 
 // API to get extent of identifier at specific location {{{
 char const*
 vim_clang_get_extent_of_node_at_specific_location(char const* location_string) {
-    auto location_info =
-        libclang_vim::parse_args_with_location(location_string);
-    char const* file_name = location_info.file.c_str();
-    auto const args_ptrs = libclang_vim::get_args_ptrs(location_info.args);
-    libclang_vim::cxindex_ptr index =
-        clang_createIndex(/*excludeDeclsFromPCH*/ 1, /*displayDiagnostics*/ 0);
-    std::vector<CXUnsavedFile> unsaved_files =
-        create_unsaved_files(location_info);
-    libclang_vim::cxtranslation_unit_ptr translation_unit(
-        clang_parseTranslationUnit(index, file_name, args_ptrs.data(),
-                                   args_ptrs.size(), unsaved_files.data(),
-                                   unsaved_files.size(),
-                                   CXTranslationUnit_Incomplete));
-    if (!translation_unit)
-        return "{}";
-
-    CXFile file = clang_getFile(translation_unit, file_name);
-    auto const location = clang_getLocation(
-        translation_unit, file, location_info.line, location_info.col);
-    CXCursor const cursor = clang_getCursor(translation_unit, location);
-    static std::string result;
-    result = "{" + libclang_vim::stringize_extent(cursor) + "}";
-
-    return result.c_str();
+    return libclang_vim::memoize(__func__, location_string, [&] {
+        auto const location_info =
+            libclang_vim::parse_args_with_location(location_string);
+        return libclang_vim::at_specific_location(
+            location_info, [](CXCursor const& cursor) {
+                return "{" + libclang_vim::stringize_extent(cursor) + "}";
+            });
+    });
 }
 
 char const* vim_clang_get_inner_definition_extent_at_specific_location(
     char const* location_string) {
-    auto const parsed_location =
-        libclang_vim::parse_args_with_location(location_string);
-    return libclang_vim::get_extent(parsed_location, clang_isCursorDefinition);
+    return libclang_vim::memoize(__func__, location_string, [&] {
+        auto const parsed_location =
+            libclang_vim::parse_args_with_location(location_string);
+        return libclang_vim::get_extent(
+            parsed_location, clang_isCursorDefinition);
+    });
 }
 
 char const* vim_clang_get_expression_extent_at_specific_location(
     char const* location_string) {
-    auto const parsed_location =
-        libclang_vim::parse_args_with_location(location_string);
-    return libclang_vim::get_extent(parsed_location, [](CXCursor const& c) {
-        return clang_isExpression(clang_getCursorKind(c));
+    return libclang_vim::memoize(__func__, location_string, [&] {
+        auto const parsed_location =
+            libclang_vim::parse_args_with_location(location_string);
+        return libclang_vim::get_extent(parsed_location, [](CXCursor const& c) {
+                return clang_isExpression(clang_getCursorKind(c));
+            });
     });
 }
 
 char const* vim_clang_get_statement_extent_at_specific_location(
     char const* location_string) {
-    auto const parsed_location =
-        libclang_vim::parse_args_with_location(location_string);
-    return libclang_vim::get_extent(parsed_location, [](CXCursor const& c) {
-        return clang_isStatement(clang_getCursorKind(c));
+    return libclang_vim::memoize(__func__, location_string, [&] {
+        auto const parsed_location =
+            libclang_vim::parse_args_with_location(location_string);
+        return libclang_vim::get_extent(parsed_location, [](CXCursor const& c) {
+                return clang_isStatement(clang_getCursorKind(c));
+            });
     });
 }
 
 char const*
 vim_clang_get_class_extent_at_specific_location(char const* location_string) {
-    auto const parsed_location =
-        libclang_vim::parse_args_with_location(location_string);
-    return libclang_vim::get_extent(parsed_location,
-                                    libclang_vim::is_class_decl);
+    return libclang_vim::memoize(__func__, location_string, [&] {
+        auto const parsed_location =
+            libclang_vim::parse_args_with_location(location_string);
+        return libclang_vim::get_extent(
+            parsed_location, libclang_vim::is_class_decl);
+    });
 }
 
 char const* vim_clang_get_function_extent_at_specific_location(
     char const* location_string) {
-    auto const parsed_location =
-        libclang_vim::parse_args_with_location(location_string);
-    return libclang_vim::get_extent(parsed_location,
-                                    libclang_vim::is_function_decl);
+    return libclang_vim::memoize(__func__, location_string, [&] {
+        auto const parsed_location =
+            libclang_vim::parse_args_with_location(location_string);
+        return libclang_vim::get_extent(
+            parsed_location, libclang_vim::is_function_decl);
+    });
 }
 
 char const* vim_clang_get_parameter_extent_at_specific_location(
     char const* location_string) {
-    auto const parsed_location =
-        libclang_vim::parse_args_with_location(location_string);
-    return libclang_vim::get_extent(parsed_location,
-                                    libclang_vim::is_parameter);
+    return libclang_vim::memoize(__func__, location_string, [&] {
+        auto const parsed_location =
+            libclang_vim::parse_args_with_location(location_string);
+        return libclang_vim::get_extent(
+            parsed_location, libclang_vim::is_parameter);
+    });
 }
 
 char const* vim_clang_get_namespace_extent_at_specific_location(
     char const* location_string) {
-    auto const parsed_location =
-        libclang_vim::parse_args_with_location(location_string);
-    return libclang_vim::get_extent(parsed_location, [](CXCursor const& c) {
-        return clang_getCursorKind(c) == CXCursor_Namespace;
+    return libclang_vim::memoize(__func__, location_string, [&] {
+        auto const parsed_location =
+            libclang_vim::parse_args_with_location(location_string);
+        return libclang_vim::get_extent(parsed_location, [](CXCursor const& c) {
+                return clang_getCursorKind(c) == CXCursor_Namespace;
+            });
     });
 }
 // }}}
 
 char const* vim_clang_get_definition_at(char const* location_string) {
-    auto const parsed_location =
-        libclang_vim::parse_args_with_location(location_string);
-    return libclang_vim::get_related_node_of(parsed_location,
-                                             clang_getCursorDefinition);
+    return libclang_vim::memoize(__func__, location_string, [&] {
+        auto const parsed_location =
+            libclang_vim::parse_args_with_location(location_string);
+        return libclang_vim::get_related_node_of(
+            parsed_location, clang_getCursorDefinition);
+    });
 }
 
 char const* vim_clang_get_referenced_at(char const* location_string) {
-    auto const parsed_location =
-        libclang_vim::parse_args_with_location(location_string);
-    return libclang_vim::get_related_node_of(parsed_location,
-                                             clang_getCursorReferenced);
+    return libclang_vim::memoize(__func__, location_string, [&] {
+        auto const parsed_location =
+            libclang_vim::parse_args_with_location(location_string);
+        return libclang_vim::get_related_node_of(
+            parsed_location, clang_getCursorReferenced);
+    });
 }
 
 char const* vim_clang_get_declaration_at(char const* location_string) {
     stderr_guard g;
-    auto const parsed_location =
-        libclang_vim::parse_args_with_location(location_string);
-    return libclang_vim::get_related_node_of(parsed_location,
-                                             clang_getCanonicalCursor);
+
+    return libclang_vim::memoize(__func__, location_string, [&] {
+        auto const parsed_location =
+            libclang_vim::parse_args_with_location(location_string);
+        return libclang_vim::get_related_node_of(
+            parsed_location, clang_getCanonicalCursor);
+    });
 }
 
 char const* vim_clang_get_pointee_type_at(char const* location_string) {
-    auto const parsed_location =
-        libclang_vim::parse_args_with_location(location_string);
-    return libclang_vim::get_type_related_to(parsed_location,
-                                             clang_getPointeeType);
+    return libclang_vim::memoize(__func__, location_string, [&] {
+        auto const parsed_location =
+            libclang_vim::parse_args_with_location(location_string);
+        return libclang_vim::get_type_related_to(
+            parsed_location, clang_getPointeeType);
+    });
 }
 
 char const* vim_clang_get_canonical_type_at(char const* location_string) {
-    auto const parsed_location =
-        libclang_vim::parse_args_with_location(location_string);
-    return libclang_vim::get_type_related_to(parsed_location,
-                                             clang_getCanonicalType);
+    return libclang_vim::memoize(__func__, location_string, [&] {
+        auto const parsed_location =
+            libclang_vim::parse_args_with_location(location_string);
+        return libclang_vim::get_type_related_to(
+            parsed_location, clang_getCanonicalType);
+    });
 }
 
 char const* vim_clang_get_result_type_at(char const* location_string) {
-    auto const parsed_location =
-        libclang_vim::parse_args_with_location(location_string);
-    return libclang_vim::get_type_related_to(parsed_location,
-                                             clang_getResultType);
+    return libclang_vim::memoize(__func__, location_string, [&] {
+        auto const parsed_location =
+            libclang_vim::parse_args_with_location(location_string);
+        return libclang_vim::get_type_related_to(
+            parsed_location, clang_getResultType);
+    });
 }
 
 char const*
 vim_clang_get_class_type_of_member_pointer_at(char const* location_string) {
-    auto const parsed_location =
-        libclang_vim::parse_args_with_location(location_string);
-    return libclang_vim::get_type_related_to(parsed_location,
-                                             clang_Type_getClassType);
+    return libclang_vim::memoize(__func__, location_string, [&] {
+        auto const parsed_location =
+            libclang_vim::parse_args_with_location(location_string);
+        return libclang_vim::get_type_related_to(
+            parsed_location, clang_Type_getClassType);
+    });
+}
+
+char const* vim_clang_get_layout_at(char const* location_string) {
+    stderr_guard g;
+
+    return libclang_vim::memoize(__func__, location_string, [&] {
+        return libclang_vim::get_layout_at(
+            libclang_vim::parse_args_with_location(location_string));
+    });
 }
 
 char const* vim_clang_get_all_extents_at(char const* location_string) {
-    return libclang_vim::get_all_extents(
-        libclang_vim::parse_args_with_location(location_string));
+    return libclang_vim::memoize(__func__, location_string, [&] {
+        return libclang_vim::get_all_extents(
+            libclang_vim::parse_args_with_location(location_string));
+    });
 }
 
 char const* vim_clang_deduce_var_decl_at(char const* location_string) {
-    return libclang_vim::deduce_var_decl_type(
-        libclang_vim::parse_args_with_location(location_string));
+    return libclang_vim::memoize(__func__, location_string, [&] {
+        return libclang_vim::deduce_var_decl_type(
+            libclang_vim::parse_args_with_location(location_string));
+    });
 }
 
 char const* vim_clang_deduce_func_decl_at(char const* location_string) {
-    return libclang_vim::deduce_func_return_type(
-        libclang_vim::parse_args_with_location(location_string));
+    return libclang_vim::memoize(__func__, location_string, [&] {
+        return libclang_vim::deduce_func_return_type(
+            libclang_vim::parse_args_with_location(location_string));
+    });
 }
 
 char const* vim_clang_deduce_func_or_var_decl_at(char const* location_string) {
-    return libclang_vim::deduce_func_or_var_decl(
-        libclang_vim::parse_args_with_location(location_string));
+    return libclang_vim::memoize(__func__, location_string, [&] {
+        return libclang_vim::deduce_func_or_var_decl(
+            libclang_vim::parse_args_with_location(location_string));
+    });
 }
 
 char const* vim_clang_get_type_with_deduction_at(char const* location_string) {
     stderr_guard g;
 
-    const char* ret = libclang_vim::deduce_type_at(
-        libclang_vim::parse_args_with_location(location_string));
-    return ret;
+    return libclang_vim::memoize(__func__, location_string, [&] {
+        return libclang_vim::deduce_type_at(
+            libclang_vim::parse_args_with_location(location_string));
+    });
 }
 
 char const* vim_clang_get_current_function_at(char const* location_string) {
     stderr_guard g;
 
-    const char* ret = libclang_vim::get_current_function_at(
-        libclang_vim::parse_args_with_location(location_string));
-    return ret;
+    return libclang_vim::memoize(__func__, location_string, [&] {
+        return libclang_vim::get_current_function_at(
+            libclang_vim::parse_args_with_location(location_string));
+    });
 }
 
 char const* vim_clang_get_completion_at(char const* location_string) {
@@ -529,28 +694,51 @@ char const* vim_clang_get_completion_at(char const* location_string) {
     return ret;
 }
 
-char const* vim_clang_get_comment_at(char const* location_string) {
+char const* vim_clang_get_filtered_completion_at(char const* query_string) {
     stderr_guard g;
 
-    const char* ret = libclang_vim::get_comment_at(
-        libclang_vim::parse_args_with_location(location_string));
+    const char* ret = libclang_vim::get_filtered_completion_at(
+        libclang_vim::parse_completion_query(query_string));
     return ret;
 }
 
-char const* vim_clang_get_deduced_declaration_at(char const* location_string) {
+char const* vim_clang_get_completion_items_at(char const* query_string) {
     stderr_guard g;
 
-    const char* ret = libclang_vim::get_deduced_declaration_at(
-        libclang_vim::parse_args_with_location(location_string));
+    const char* ret = libclang_vim::get_completion_items_at(
+        libclang_vim::parse_completion_query(query_string));
     return ret;
 }
 
+char const* vim_clang_get_completion_detail(char const* id_string) {
+    return libclang_vim::get_completion_detail(id_string);
+}
+
+char const* vim_clang_get_comment_at(char const* location_string) {
+    stderr_guard g;
+
+    return libclang_vim::memoize(__func__, location_string, [&] {
+        return libclang_vim::get_comment_at(
+            libclang_vim::parse_args_with_location(location_string));
+    });
+}
+
+char const* vim_clang_get_deduced_declaration_at(char const* location_string) {
+    stderr_guard g;
+
+    return libclang_vim::memoize(__func__, location_string, [&] {
+        return libclang_vim::get_deduced_declaration_at(
+            libclang_vim::parse_args_with_location(location_string));
+    });
+}
+
 char const* vim_clang_get_include_at(const char* location_string) {
     stderr_guard g;
 
-    const char* ret = libclang_vim::get_include_at(
-        libclang_vim::parse_args_with_location(location_string));
-    return ret;
+    return libclang_vim::memoize(__func__, location_string, [&] {
+        return libclang_vim::get_include_at(
+            libclang_vim::parse_args_with_location(location_string));
+    });
 }
 
 char const* vim_clang_get_compile_commands(char const* file) {
@@ -569,6 +757,235 @@ char const* vim_clang_get_diagnostics(const char* file_and_args) {
     return ret;
 }
 
+char const* vim_clang_profile_includes(const char* file_and_args) {
+    stderr_guard g;
+
+    const char* ret = libclang_vim::profile_includes(
+        libclang_vim::parse_default_args(file_and_args));
+    return ret;
+}
+
+char const* vim_clang_extract_function_metrics(const char* file_and_args) {
+    stderr_guard g;
+
+    const char* ret = libclang_vim::extract_function_metrics(
+        libclang_vim::parse_default_args(file_and_args));
+    return ret;
+}
+
+char const* vim_clang_extract_virtual_calls(const char* file_and_args) {
+    stderr_guard g;
+
+    return libclang_vim::memoize(__func__, file_and_args, [&] {
+        return libclang_vim::extract_virtual_calls(
+            libclang_vim::parse_default_args(file_and_args));
+    });
+}
+
+char const* vim_clang_schedule_diagnostics(const char* request_string) {
+    return libclang_vim::schedule_diagnostics(
+        libclang_vim::parse_diagnostics_request(request_string));
+}
+
+char const* vim_clang_get_latest_diagnostics(const char* file) {
+    return libclang_vim::get_latest_diagnostics(
+        libclang_vim::parse_default_args(file).file);
+}
+
+/// Not for libcall(): blocks until the scheduled diagnostics are computed,
+/// e.g. for hosts that have their own worker threads.
+char const* vim_clang_wait_for_diagnostics(char const* file,
+                                           unsigned long long generation) {
+    return libclang_vim::wait_for_diagnostics(
+        libclang_vim::parse_default_args(file).file, generation);
+}
+
+/// Not for libcall(): file_callback is invoked with the diagnostics of each
+/// file of the project as soon as they are ready, from worker threads, but
+/// never concurrently.
+char const* vim_clang_sweep_diagnostics(char const* directory, unsigned jobs,
+                                        void (*file_callback)(char const*,
+                                                              void*),
+                                        void* data) {
+    thread_local std::string vimson;
+    vimson = libclang_vim::sweep_diagnostics(
+        directory, jobs, [file_callback, data](const std::string& result) {
+            file_callback(result.c_str(), data);
+        });
+    return vimson.c_str();
+}
+
+/// Not for libcall(): measures the parse time, memory, included files and
+/// AST nodes of every file of the project. format is "json", "csv" or
+/// anything else for vimson. file_callback gets the result of each file as
+/// soon as it's ready, the returned report is sorted by parse time.
+char const* vim_clang_profile_project(char const* directory, unsigned jobs,
+                                      char const* format,
+                                      void (*file_callback)(char const*,
+                                                            void*),
+                                      void* data) {
+    thread_local std::string report;
+    report = libclang_vim::profile_project(
+        directory, jobs, libclang_vim::parse_report_format(format),
+        [file_callback, data](const std::string& result) {
+            file_callback(result.c_str(), data);
+        });
+    return report.c_str();
+}
+
+/// Not for libcall(): same as vim_clang_scan_project_padding(), but with a
+/// custom number of threads.
+char const* vim_clang_scan_padding(char const* directory, unsigned jobs) {
+    thread_local std::string vimson;
+    vimson = libclang_vim::scan_padding(directory, jobs);
+    return vimson.c_str();
+}
+
+/// Not for libcall(): same as vim_clang_measure_project_functions(), but
+/// with a custom number of threads.
+char const* vim_clang_measure_functions(char const* directory, unsigned jobs) {
+    thread_local std::string vimson;
+    vimson = libclang_vim::measure_project_functions(directory, jobs);
+    return vimson.c_str();
+}
+
+/// Not for libcall(): same as vim_clang_index_project() or, if incremental
+/// is non-zero, vim_clang_update_project_index(), but with a custom number
+/// of threads.
+char const* vim_clang_build_project_index(char const* directory, unsigned jobs,
+                                          int incremental) {
+    thread_local std::string vimson;
+    if (incremental)
+        vimson = libclang_vim::update_project_index(directory, jobs);
+    else
+        vimson = libclang_vim::index_project(directory, jobs);
+    return vimson.c_str();
+}
+
+char const* vim_clang_index_project(char const* directory) {
+    stderr_guard g;
+
+    return vim_clang_build_project_index(directory, 0, 0);
+}
+
+char const* vim_clang_update_project_index(char const* directory) {
+    stderr_guard g;
+
+    return vim_clang_build_project_index(directory, 0, 1);
+}
+
+char const* vim_clang_get_project_definition_at(char const* location_string) {
+    stderr_guard g;
+
+    const char* ret = libclang_vim::get_project_definition_at(
+        libclang_vim::parse_args_with_location(location_string));
+    return ret;
+}
+
+char const* vim_clang_get_project_references_at(char const* location_string) {
+    stderr_guard g;
+
+    const char* ret = libclang_vim::get_project_references_at(
+        libclang_vim::parse_args_with_location(location_string));
+    return ret;
+}
+
+char const* vim_clang_search_project_symbols(char const* query_string) {
+    stderr_guard g;
+
+    const char* ret = libclang_vim::search_project_symbols(
+        libclang_vim::parse_symbol_query(query_string));
+    return ret;
+}
+
+char const* vim_clang_scan_project_padding(char const* directory) {
+    stderr_guard g;
+
+    return vim_clang_scan_padding(directory, 0);
+}
+
+char const* vim_clang_measure_project_functions(char const* directory) {
+    stderr_guard g;
+
+    return vim_clang_measure_functions(directory, 0);
+}
+
+char const* vim_clang_get_project_includers(char const* file) {
+    stderr_guard g;
+
+    const char* ret = libclang_vim::get_project_includers(file);
+    return ret;
+}
+
+char const* vim_clang_get_project_virtual_calls(char const* directory) {
+    stderr_guard g;
+
+    const char* ret = libclang_vim::get_project_virtual_calls(directory);
+    return ret;
+}
+
+/// The argument is ignored.
+char const* vim_clang_get_scheduler_stats(char const*) {
+    return libclang_vim::get_scheduler_stats();
+}
+
+vim_clang_session* vim_clang_create_session() { return new vim_clang_session; }
+
+void vim_clang_dispose_session(vim_clang_session* session) { delete session; }
+
+char* vim_clang_session_call(vim_clang_session* session, char const* method,
+                             char const* argument, int json) {
+    static const libcall_function_map functions = get_libcall_functions();
+    auto const function = functions.find(method);
+    if (function == functions.end())
+        return nullptr;
+
+    std::string result;
+    {
+        libclang_vim::scheduler_slot slot(
+            libclang_vim::get_default_priority(method));
+        libclang_vim::session_scope scope(session->state);
+        result = function->second(argument);
+    }
+    if (json)
+        result = libclang_vim::vimson_to_json(result);
+
+    auto const ret = static_cast<char*>(std::malloc(result.size() + 1));
+    if (ret)
+        std::memcpy(ret, result.c_str(), result.size() + 1);
+    return ret;
+}
+
+void vim_clang_free_result(char* result) { std::free(result); }
+
+vim_clang_nodes* vim_clang_get_token_nodes(char const* file_and_args) {
+    stderr_guard g;
+
+    return libclang_vim::get_token_nodes(
+        libclang_vim::parse_default_args(file_and_args));
+}
+
+vim_clang_nodes* vim_clang_get_extent_nodes(char const* location) {
+    stderr_guard g;
+
+    return libclang_vim::get_extent_nodes(
+        libclang_vim::parse_args_with_location(location));
+}
+
+vim_clang_nodes* vim_clang_extract_nodes(char const* file_and_args,
+                                         char const* category,
+                                         int current_file) {
+    stderr_guard g;
+
+    return libclang_vim::extract_nodes(
+        libclang_vim::parse_default_args(file_and_args),
+        current_file ? libclang_vim::extraction_policy::current_file
+                     : libclang_vim::extraction_policy::all,
+        category);
+}
+
+void vim_clang_free_nodes(vim_clang_nodes* nodes) { std::free(nodes); }
+
 } // extern "C"
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,209 @@
+#if !defined LIBCLANG_VIM_CLANG_VIM_H_INCLUDED
+#define LIBCLANG_VIM_CLANG_VIM_H_INCLUDED
+
+/// C interface of libclang-vim.so. Results are owned by the library and stay
+/// valid until the next call of the same function on the same thread. The
+/// vim_clang_session_* functions return results owned by the caller instead.
+
+#if defined __cplusplus
+extern "C" {
+#endif
+
+/// Invokes X(name) for each function that takes one string argument, the
+/// ones Vim can call with libcall().
+#define LIBCLANG_VIM_LIBCALL_FUNCTIONS(X)                                      \
+    X(vim_clang_tokens)                                                        \
+    X(vim_clang_extract_all)                                                   \
+    X(vim_clang_extract_declarations)                                          \
+    X(vim_clang_extract_attributes)                                            \
+    X(vim_clang_extract_expressions)                                           \
+    X(vim_clang_extract_preprocessings)                                        \
+    X(vim_clang_extract_references)                                            \
+    X(vim_clang_extract_statements)                                            \
+    X(vim_clang_extract_translation_units)                                     \
+    X(vim_clang_extract_definitions)                                           \
+    X(vim_clang_extract_virtual_member_functions)                              \
+    X(vim_clang_extract_pure_virtual_member_functions)                         \
+    X(vim_clang_extract_static_member_functions)                               \
+    X(vim_clang_extract_all_current_file)                                      \
+    X(vim_clang_extract_declarations_current_file)                             \
+    X(vim_clang_extract_attributes_current_file)                               \
+    X(vim_clang_extract_expressions_current_file)                              \
+    X(vim_clang_extract_preprocessings_current_file)                           \
+    X(vim_clang_extract_references_current_file)                               \
+    X(vim_clang_extract_statements_current_file)                               \
+    X(vim_clang_extract_translation_units_current_file)                        \
+    X(vim_clang_extract_definitions_current_file)                              \
+    X(vim_clang_extract_virtual_member_functions_current_file)                 \
+    X(vim_clang_extract_pure_virtual_member_functions_current_file)            \
+    X(vim_clang_extract_static_member_functions_current_file)                  \
+    X(vim_clang_extract_all_non_system_headers)                                \
+    X(vim_clang_extract_declarations_non_system_headers)                       \
+    X(vim_clang_extract_attributes_non_system_headers)                         \
+    X(vim_clang_extract_expressions_non_system_headers)                        \
+    X(vim_clang_extract_preprocessings_non_system_headers)                     \
+    X(vim_clang_extract_references_non_system_headers)                         \
+    X(vim_clang_extract_statements_non_system_headers)                         \
+    X(vim_clang_extract_translation_units_non_system_headers)                  \
+    X(vim_clang_extract_definitions_non_system_headers)                        \
+    X(vim_clang_extract_virtual_member_functions_non_system_headers)           \
+    X(vim_clang_extract_pure_virtual_member_functions_non_system_headers)      \
+    X(vim_clang_extract_static_member_functions_non_system_headers)            \
+    X(vim_clang_get_location_information)                                      \
+    X(vim_clang_get_extent_of_node_at_specific_location)                       \
+    X(vim_clang_get_inner_definition_extent_at_specific_location)              \
+    X(vim_clang_get_expression_extent_at_specific_location)                    \
+    X(vim_clang_get_statement_extent_at_specific_location)                     \
+    X(vim_clang_get_class_extent_at_specific_location)                         \
+    X(vim_clang_get_function_extent_at_specific_location)                      \
+    X(vim_clang_get_parameter_extent_at_specific_location)                     \
+    X(vim_clang_get_namespace_extent_at_specific_location)                     \
+    X(vim_clang_get_definition_at)                                             \
+    X(vim_clang_get_referenced_at)                                             \
+    X(vim_clang_get_declaration_at)                                            \
+    X(vim_clang_get_pointee_type_at)                                           \
+    X(vim_clang_get_canonical_type_at)                                         \
+    X(vim_clang_get_result_type_at)                                            \
+    X(vim_clang_get_class_type_of_member_pointer_at)                           \
+    X(vim_clang_get_layout_at)                                                 \
+    X(vim_clang_get_all_extents_at)                                            \
+    X(vim_clang_deduce_var_decl_at)                                            \
+    X(vim_clang_deduce_func_decl_at)                                           \
+    X(vim_clang_deduce_func_or_var_decl_at)                                    \
+    X(vim_clang_get_type_with_deduction_at)                                    \
+    X(vim_clang_get_current_function_at)                                       \
+    X(vim_clang_get_completion_at)                                             \
+    X(vim_clang_get_filtered_completion_at)                                    \
+    X(vim_clang_get_completion_items_at)                                       \
+    X(vim_clang_get_completion_detail)                                         \
+    X(vim_clang_get_comment_at)                                                \
+    X(vim_clang_get_deduced_declaration_at)                                    \
+    X(vim_clang_get_include_at)                                                \
+    X(vim_clang_get_compile_commands)                                          \
+    X(vim_clang_get_diagnostics)                                               \
+    X(vim_clang_profile_includes)                                              \
+    X(vim_clang_extract_function_metrics)                                      \
+    X(vim_clang_extract_virtual_calls)                                         \
+    X(vim_clang_schedule_diagnostics)                                          \
+    X(vim_clang_get_latest_diagnostics)                                        \
+    X(vim_clang_index_project)                                                 \
+    X(vim_clang_update_project_index)                                          \
+    X(vim_clang_get_project_definition_at)                                     \
+    X(vim_clang_get_project_references_at)                                     \
+    X(vim_clang_search_project_symbols)                                        \
+    X(vim_clang_scan_project_padding)                                          \
+    X(vim_clang_measure_project_functions)                                     \
+    X(vim_clang_get_project_includers)                                         \
+    X(vim_clang_get_project_virtual_calls)                                     \
+    X(vim_clang_get_scheduler_stats)
+
+#define LIBCLANG_VIM_DECLARE(name) char const* name(char const* argument);
+LIBCLANG_VIM_LIBCALL_FUNCTIONS(LIBCLANG_VIM_DECLARE)
+#undef LIBCLANG_VIM_DECLARE
+
+char const* vim_clang_version(void);
+
+/// Not for libcall(): file_callback gets the diagnostics of each file.
+char const* vim_clang_sweep_diagnostics(char const* directory, unsigned jobs,
+                                        void (*file_callback)(char const*,
+                                                              void*),
+                                        void* data);
+
+/// Not for libcall(): same as vim_clang_get_latest_diagnostics(), but waits
+/// for the scheduled diagnostics of generation or a newer one.
+char const* vim_clang_wait_for_diagnostics(char const* file,
+                                           unsigned long long generation);
+
+/// Not for libcall(): format is "json", "csv" or anything else for vimson.
+char const* vim_clang_profile_project(char const* directory, unsigned jobs,
+                                      char const* format,
+                                      void (*file_callback)(char const*,
+                                                            void*),
+                                      void* data);
+
+char const* vim_clang_scan_padding(char const* directory, unsigned jobs);
+
+char const* vim_clang_measure_functions(char const* directory, unsigned jobs);
+
+char const* vim_clang_build_project_index(char const* directory, unsigned jobs,
+                                          int incremental);
+
+/// Reentrant interface for multithreaded hosts: a session has its own
+/// translation unit cache, completion state and memoized results, and its
+/// queries leave stderr alone. A session can be used from several threads,
+/// too. Sessions still share, all thread-safe:
+/// - the scheduler, which limits the number of concurrent queries of the
+///   process, so a session may wait for the queries of another one,
+/// - the content-keyed caches of the project index, the include graphs and
+///   the function metrics,
+/// - the diagnostics engine, which keeps the latest diagnostics of a file,
+/// - the per-thread result buffers of the functions above, which
+///   vim_clang_session_call() copies before it returns, so only a pointer
+///   returned by a libcall() function on the same thread is overwritten.
+typedef struct vim_clang_session vim_clang_session;
+
+vim_clang_session* vim_clang_create_session(void);
+
+void vim_clang_dispose_session(vim_clang_session* session);
+
+/// Runs method, one of LIBCLANG_VIM_LIBCALL_FUNCTIONS, with argument in
+/// session. The result is JSON if json is non-zero, vimson otherwise, and
+/// must be released with vim_clang_free_result(). Returns NULL if method is
+/// unknown.
+char* vim_clang_session_call(vim_clang_session* session, char const* method,
+                             char const* argument, int json);
+
+void vim_clang_free_result(char* result);
+
+/// A token, extent or AST node, for hosts that would rather not parse
+/// vimson. Lines, columns and offsets are the ones of
+/// clang_getFileLocation().
+typedef struct vim_clang_node {
+    /// CXCursorKind, or CXTokenKind for tokens.
+    int kind;
+    unsigned start_line;
+    unsigned start_column;
+    unsigned start_offset;
+    unsigned end_line;
+    unsigned end_column;
+    unsigned end_offset;
+    /// Index of the parent node in the same array, or -1.
+    int parent;
+    /// Offsets of the spelling and of the file name in the string pool.
+    unsigned name;
+    unsigned file;
+} vim_clang_node;
+
+/// Nodes and their string pool of NUL-terminated strings, in a single
+/// allocation.
+typedef struct vim_clang_nodes {
+    unsigned count;
+    vim_clang_node* nodes;
+    char const* strings;
+} vim_clang_nodes;
+
+/// Tokens of "file:args", like vim_clang_tokens(). Each function returning
+/// vim_clang_nodes returns NULL if parsing fails, the result must be
+/// released with vim_clang_free_nodes().
+vim_clang_nodes* vim_clang_get_token_nodes(char const* file_and_args);
+
+/// Extents of "file:args:line:col", like vim_clang_get_all_extents_at(),
+/// innermost first: each one is the parent of the previous one.
+vim_clang_nodes* vim_clang_get_extent_nodes(char const* location);
+
+/// AST nodes of "file:args" of category, e.g. "declarations" for the ones
+/// vim_clang_extract_declarations() returns, only of the main file if
+/// current_file is non-zero. Returns NULL if category is unknown.
+vim_clang_nodes* vim_clang_extract_nodes(char const* file_and_args,
+                                         char const* category,
+                                         int current_file);
+
+void vim_clang_free_nodes(vim_clang_nodes* nodes);
+
+#if defined __cplusplus
+} // extern "C"
+#endif
+
+#endif // LIBCLANG_VIM_CLANG_VIM_H_INCLUDED
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
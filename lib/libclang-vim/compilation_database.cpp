@@ -0,0 +1,128 @@
+#include "compilation_database.hpp"
+
+#include <clang-c/CXCompilationDatabase.h>
+
+namespace {
+
+/// Wrapper around clang_CompilationDatabase_fromDirectory(), returns nullptr
+/// on failure.
+CXCompilationDatabase open_database(const std::string& directory) {
+    CXCompilationDatabase_Error error;
+    CXCompilationDatabase database =
+        clang_CompilationDatabase_fromDirectory(directory.c_str(), &error);
+    if (error == CXCompilationDatabase_NoError)
+        return database;
+
+    clang_CompilationDatabase_dispose(database);
+    return nullptr;
+}
+
+bool is_absolute(const std::string& path) {
+    return !path.empty() && path[0] == '/';
+}
+}
+
+std::string
+libclang_vim::find_compilation_database(const std::string& directory) {
+    std::string current = directory;
+    while (!current.empty()) {
+        std::ifstream stream((current + "/compile_commands.json").c_str());
+        if (stream.good())
+            return current;
+
+        std::size_t found = current.find_last_of("/\\");
+        if (found == std::string::npos)
+            break;
+
+        current = current.substr(0, found);
+    }
+
+    return std::string();
+}
+
+libclang_vim::args_type
+libclang_vim::parse_compilation_database(const std::string& file) {
+    args_type ret;
+
+    std::size_t found = file.find_last_of("/\\");
+    std::string directory =
+        find_compilation_database(found == std::string::npos
+                                      ? std::string(".")
+                                      : file.substr(0, found));
+    if (directory.empty()) {
+        // Our default when no JSON was found.
+        ret.emplace_back("-std=c++1y");
+
+        return ret;
+    }
+
+    CXCompilationDatabase database = open_database(directory);
+    if (database) {
+        CXCompileCommands commands =
+            clang_CompilationDatabase_getCompileCommands(database,
+                                                         file.c_str());
+        unsigned commandsSize = clang_CompileCommands_getSize(commands);
+        if (commandsSize >= 1) {
+            CXCompileCommand command =
+                clang_CompileCommands_getCommand(commands, 0);
+            unsigned args = clang_CompileCommand_getNumArgs(command);
+            for (unsigned i = 0; i < args; ++i) {
+                cxstring_ptr arg = clang_CompileCommand_getArg(command, i);
+                if (file != clang_getCString(arg))
+                    ret.emplace_back(clang_getCString(arg));
+            }
+        }
+        clang_CompileCommands_dispose(commands);
+        clang_CompilationDatabase_dispose(database);
+    }
+
+    return ret;
+}
+
+std::vector<libclang_vim::compile_command>
+libclang_vim::get_all_compile_commands(const std::string& directory) {
+    std::vector<compile_command> ret;
+
+    std::string database_directory = find_compilation_database(directory);
+    if (database_directory.empty())
+        return ret;
+
+    CXCompilationDatabase database = open_database(database_directory);
+    if (!database)
+        return ret;
+
+    CXCompileCommands commands =
+        clang_CompilationDatabase_getAllCompileCommands(database);
+    unsigned size = clang_CompileCommands_getSize(commands);
+    ret.reserve(size);
+    for (unsigned i = 0; i < size; ++i) {
+        CXCompileCommand command =
+            clang_CompileCommands_getCommand(commands, i);
+        compile_command entry;
+        entry.directory = to_c_str(clang_CompileCommand_getDirectory(command));
+        std::string file = to_c_str(clang_CompileCommand_getFilename(command));
+        entry.file = is_absolute(file) ? file : entry.directory + "/" + file;
+
+        // The first argument is the compiler itself.
+        unsigned args = clang_CompileCommand_getNumArgs(command);
+        for (unsigned j = 1; j < args; ++j) {
+            std::string arg = to_c_str(clang_CompileCommand_getArg(command, j));
+            if (arg == file || arg == entry.file || arg == "-c")
+                continue;
+            if (arg == "-o") {
+                ++j;
+                continue;
+            }
+            entry.args.push_back(arg);
+        }
+        entry.args.push_back("-working-directory=" + entry.directory);
+
+        ret.push_back(entry);
+    }
+    clang_CompileCommands_dispose(commands);
+    clang_CompilationDatabase_dispose(database);
+
+    return ret;
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,38 @@
+#if !defined LIBCLANG_VIM_COMPILATION_DATABASE_HPP_INCLUDED
+#define LIBCLANG_VIM_COMPILATION_DATABASE_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+
+#include "helpers.hpp"
+
+namespace libclang_vim {
+
+/// Stores one entry of a compilation database.
+class compile_command {
+  public:
+    /// Absolute path of the main file.
+    std::string file;
+    std::string directory;
+    /// Arguments for clang_parseTranslationUnit(): without the compiler, the
+    /// main file and the output options, but with -working-directory.
+    args_type args;
+};
+
+/// Returns the directory of the compile_commands.json in directory or one of
+/// its parents, or an empty string if there is none.
+std::string find_compilation_database(const std::string& directory);
+
+/// Look up compilation arguments for a file from a database in one of its
+/// parent directories.
+args_type parse_compilation_database(const std::string& file);
+
+/// Returns all entries of the compilation database found from directory.
+std::vector<compile_command>
+get_all_compile_commands(const std::string& directory);
+
+} // namespace libclang_vim
+
+#endif // LIBCLANG_VIM_COMPILATION_DATABASE_HPP_INCLUDED
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,488 @@
+#include "completion.hpp"
+
+#include <mutex>
+#include <unordered_map>
+
+#include "session.hpp"
+#include "translation_unit_cache.hpp"
+
+namespace {
+
+/// A completion result which matched the typed prefix.
+struct completion_candidate {
+    /// Index into CXCodeCompleteResults::Results.
+    unsigned index;
+    std::string typed_text;
+    unsigned priority;
+    int score;
+};
+
+/// Orders candidates by match quality, then by priority (smaller is better),
+/// then by the clang_sortCodeCompletionResults() order.
+bool is_better_candidate(const completion_candidate& lhs,
+                         const completion_candidate& rhs) {
+    if (lhs.score != rhs.score)
+        return lhs.score > rhs.score;
+    if (lhs.priority != rhs.priority)
+        return lhs.priority < rhs.priority;
+    return lhs.index < rhs.index;
+}
+
+std::string get_typed_text(const CXCompletionString& completion_string) {
+    std::string typed_text;
+    for (unsigned i = 0; i < clang_getNumCompletionChunks(completion_string);
+         ++i) {
+        if (clang_getCompletionChunkKind(completion_string, i) !=
+            CXCompletionChunk_TypedText)
+            continue;
+
+        libclang_vim::cxstring_ptr chunk_text =
+            clang_getCompletionChunkText(completion_string, i);
+        typed_text += libclang_vim::to_c_str(chunk_text);
+    }
+    return typed_text;
+}
+
+/// Runs clang_codeCompleteAt() on the cached translation unit.
+CXCodeCompleteResults*
+complete_at(const libclang_vim::location_tuple& location_info) {
+    std::vector<CXUnsavedFile> unsaved_files =
+        libclang_vim::create_unsaved_files(location_info);
+    // No need to reparse, clang_codeCompleteAt() does that using the
+    // preamble of the cached translation unit, so it needs it exclusively.
+    auto const translation_unit =
+        libclang_vim::get_translation_unit_cache().get(location_info,
+                                                       /*exclusive=*/true);
+    if (!translation_unit)
+        return nullptr;
+
+    return clang_codeCompleteAt(
+        translation_unit, location_info.file.c_str(), location_info.line,
+        location_info.col, unsaved_files.data(), unsaved_files.size(),
+        clang_defaultCodeCompleteOptions() |
+            CXCodeComplete_IncludeBriefComments);
+}
+
+/// Hashes the buffer contents before the completion location: as long as it
+/// doesn't change, the completion results at the location don't change
+/// either.
+unsigned long long
+get_context_hash(const libclang_vim::location_tuple& location_info) {
+    std::vector<char> contents = location_info.unsaved_file;
+    if (contents.empty()) {
+        std::ifstream stream(location_info.file,
+                             std::ios::in | std::ios::binary);
+        contents.assign(std::istreambuf_iterator<char>(stream),
+                        std::istreambuf_iterator<char>());
+    }
+
+    size_t offset = 0;
+    for (size_t line = 1; line < location_info.line && offset < contents.size();
+         ++offset) {
+        if (contents[offset] == '\n')
+            ++line;
+    }
+    if (location_info.col)
+        offset += location_info.col - 1;
+    offset = std::min(offset, contents.size());
+    return libclang_vim::get_content_hash(contents.data(), offset);
+}
+}
+
+/// The results of the last filtered completion request, kept around so that
+/// typing more characters of the same identifier only needs to filter them
+/// again, without running clang_codeCompleteAt().
+class libclang_vim::completion_session {
+    std::mutex _mutex;
+    std::string _file;
+    libclang_vim::args_type _args;
+    size_t _line;
+    size_t _col;
+    unsigned long long _context_hash;
+    CXCodeCompleteResults* _results;
+    /// Incremented by each reset(), so ids of older results don't match.
+    unsigned long _generation;
+    /// One candidate for each distinct typed text of _results.
+    std::vector<completion_candidate> _candidates;
+    std::string _prefix;
+    /// The subset of _candidates matching _prefix.
+    std::vector<completion_candidate> _matches;
+
+  public:
+    completion_session();
+    completion_session(const completion_session&) = delete;
+    completion_session& operator=(const completion_session&) = delete;
+    ~completion_session();
+
+    /// Serializes the requests that use the session.
+    std::mutex& get_mutex();
+
+    /// If the results are still valid for a request at location_info.
+    bool is_valid_for(const libclang_vim::location_tuple& location_info,
+                      unsigned long long context_hash) const;
+
+    /// Takes ownership of results, which belong to location_info.
+    void reset(const libclang_vim::location_tuple& location_info,
+               unsigned long long context_hash,
+               CXCodeCompleteResults* results);
+
+    /// Returns the candidates matching prefix. When prefix extends the
+    /// previous one, only the previous matches are considered.
+    std::vector<completion_candidate>& filter(const std::string& prefix);
+
+    /// Generation of the retained results, part of the item ids.
+    unsigned long get_generation() const;
+
+    /// Returns the retained result with index, or nullptr if generation is
+    /// not the one of the retained results.
+    const CXCompletionResult* get_result(unsigned long generation,
+                                         unsigned index) const;
+};
+
+libclang_vim::completion_session::completion_session()
+    : _line(0), _col(0), _context_hash(0), _results(nullptr), _generation(0) {}
+
+libclang_vim::completion_session::~completion_session() {
+    if (_results)
+        clang_disposeCodeCompleteResults(_results);
+}
+
+std::mutex& libclang_vim::completion_session::get_mutex() { return _mutex; }
+
+bool libclang_vim::completion_session::is_valid_for(
+    const libclang_vim::location_tuple& location_info,
+    unsigned long long context_hash) const {
+    return _results && _file == location_info.file &&
+           _args == location_info.args && _line == location_info.line &&
+           _col == location_info.col && _context_hash == context_hash;
+}
+
+void libclang_vim::completion_session::reset(
+    const libclang_vim::location_tuple& location_info,
+    unsigned long long context_hash, CXCodeCompleteResults* results) {
+    if (_results)
+        clang_disposeCodeCompleteResults(_results);
+    _file = location_info.file;
+    _args = location_info.args;
+    _line = location_info.line;
+    _col = location_info.col;
+    _context_hash = context_hash;
+    _results = results;
+    ++_generation;
+
+    clang_sortCodeCompletionResults(_results->Results, _results->NumResults);
+
+    // Keep only the best candidate of overloads.
+    _candidates.clear();
+    std::unordered_map<std::string, size_t> candidate_indexes;
+    for (unsigned i = 0; i < _results->NumResults; ++i) {
+        const CXCompletionString& completion_string =
+            _results->Results[i].CompletionString;
+        completion_candidate candidate;
+        candidate.index = i;
+        candidate.typed_text = get_typed_text(completion_string);
+        candidate.priority = clang_getCompletionPriority(completion_string);
+        candidate.score = 0;
+
+        auto it = candidate_indexes.find(candidate.typed_text);
+        if (it == candidate_indexes.end()) {
+            candidate_indexes[candidate.typed_text] = _candidates.size();
+            _candidates.push_back(candidate);
+        } else if (is_better_candidate(candidate, _candidates[it->second]))
+            _candidates[it->second] = candidate;
+    }
+
+    // Everything matches the empty prefix.
+    _prefix.clear();
+    _matches = _candidates;
+}
+
+std::vector<completion_candidate>&
+libclang_vim::completion_session::filter(const std::string& prefix) {
+    const bool extends_prefix = prefix.compare(0, _prefix.size(), _prefix) == 0;
+    const std::vector<completion_candidate>& source =
+        extends_prefix ? _matches : _candidates;
+
+    std::vector<completion_candidate> matches;
+    for (const auto& candidate : source) {
+        const int score =
+            libclang_vim::get_fuzzy_score(prefix, candidate.typed_text);
+        if (score < 0)
+            continue;
+        matches.push_back(candidate);
+        matches.back().score = score;
+    }
+    _matches.swap(matches);
+    _prefix = prefix;
+    return _matches;
+}
+
+unsigned long libclang_vim::completion_session::get_generation() const {
+    return _generation;
+}
+
+const CXCompletionResult*
+libclang_vim::completion_session::get_result(unsigned long generation,
+                                             unsigned index) const {
+    if (!_results || generation != _generation ||
+        index >= _results->NumResults)
+        return nullptr;
+    return &_results->Results[index];
+}
+
+namespace {
+
+libclang_vim::completion_session& get_completion_session() {
+    return libclang_vim::get_current_session().get_completion_session();
+}
+
+/// Returns the best "limit" candidates of query, best first.
+std::vector<completion_candidate>
+get_best_candidates(const libclang_vim::completion_query& query) {
+    // Only run clang_codeCompleteAt() when the completion context changed,
+    // otherwise just filter the retained results again.
+    libclang_vim::completion_session& session = get_completion_session();
+    const unsigned long long context_hash = get_context_hash(query.location);
+    if (!session.is_valid_for(query.location, context_hash)) {
+        CXCodeCompleteResults* results = complete_at(query.location);
+        if (!results)
+            return std::vector<completion_candidate>();
+        session.reset(query.location, context_hash, results);
+    }
+    std::vector<completion_candidate>& candidates =
+        session.filter(query.prefix);
+
+    // Rank only the top "limit" candidates.
+    size_t count = candidates.size();
+    if (query.limit && query.limit < count)
+        count = query.limit;
+    std::partial_sort(candidates.begin(), candidates.begin() + count,
+                      candidates.end(), is_better_candidate);
+    return std::vector<completion_candidate>(candidates.begin(),
+                                             candidates.begin() + count);
+}
+
+const char* get_chunk_kind_spelling(CXCompletionChunkKind kind) {
+    switch (kind) {
+    case CXCompletionChunk_Optional:
+        return "Optional";
+    case CXCompletionChunk_TypedText:
+        return "TypedText";
+    case CXCompletionChunk_Text:
+        return "Text";
+    case CXCompletionChunk_Placeholder:
+        return "Placeholder";
+    case CXCompletionChunk_Informative:
+        return "Informative";
+    case CXCompletionChunk_CurrentParameter:
+        return "CurrentParameter";
+    case CXCompletionChunk_LeftParen:
+        return "LeftParen";
+    case CXCompletionChunk_RightParen:
+        return "RightParen";
+    case CXCompletionChunk_LeftBracket:
+        return "LeftBracket";
+    case CXCompletionChunk_RightBracket:
+        return "RightBracket";
+    case CXCompletionChunk_LeftBrace:
+        return "LeftBrace";
+    case CXCompletionChunk_RightBrace:
+        return "RightBrace";
+    case CXCompletionChunk_LeftAngle:
+        return "LeftAngle";
+    case CXCompletionChunk_RightAngle:
+        return "RightAngle";
+    case CXCompletionChunk_Comma:
+        return "Comma";
+    case CXCompletionChunk_ResultType:
+        return "ResultType";
+    case CXCompletionChunk_Colon:
+        return "Colon";
+    case CXCompletionChunk_SemiColon:
+        return "SemiColon";
+    case CXCompletionChunk_Equal:
+        return "Equal";
+    case CXCompletionChunk_HorizontalSpace:
+        return "HorizontalSpace";
+    case CXCompletionChunk_VerticalSpace:
+        return "VerticalSpace";
+    }
+    return "";
+}
+
+const char* get_availability_spelling(CXAvailabilityKind availability) {
+    switch (availability) {
+    case CXAvailability_Available:
+        return "available";
+    case CXAvailability_Deprecated:
+        return "deprecated";
+    case CXAvailability_NotAvailable:
+        return "not_available";
+    case CXAvailability_NotAccessible:
+        return "not_accessible";
+    }
+    return "";
+}
+
+/// Text of a chunk, optional chunks are flattened.
+std::string get_chunk_text(const CXCompletionString& completion_string,
+                           unsigned index) {
+    if (clang_getCompletionChunkKind(completion_string, index) !=
+        CXCompletionChunk_Optional) {
+        libclang_vim::cxstring_ptr text =
+            clang_getCompletionChunkText(completion_string, index);
+        return libclang_vim::to_c_str(text);
+    }
+
+    CXCompletionString optional =
+        clang_getCompletionChunkCompletionString(completion_string, index);
+    std::string text;
+    for (unsigned i = 0; i < clang_getNumCompletionChunks(optional); ++i)
+        text += get_chunk_text(optional, i);
+    return text;
+}
+}
+
+std::shared_ptr<libclang_vim::completion_session>
+libclang_vim::create_completion_session() {
+    return std::make_shared<completion_session>();
+}
+
+libclang_vim::completion_query::completion_query() : limit(0) {}
+
+libclang_vim::completion_query
+libclang_vim::parse_completion_query(const std::string& args_string) {
+    completion_query query;
+    const auto limit_colon = args_string.rfind(':');
+    if (limit_colon == std::string::npos || limit_colon == 0)
+        return query;
+    const auto prefix_colon = args_string.rfind(':', limit_colon - 1);
+    if (prefix_colon == std::string::npos)
+        return query;
+
+    query.location =
+        parse_args_with_location(args_string.substr(0, prefix_colon));
+    query.prefix =
+        args_string.substr(prefix_colon + 1, limit_colon - prefix_colon - 1);
+    std::sscanf(args_string.c_str() + limit_colon + 1, "%zu", &query.limit);
+    return query;
+}
+
+const char*
+libclang_vim::get_completion_at(const location_tuple& location_info) {
+    thread_local std::string vimson;
+
+    // Write the header.
+    std::stringstream ss;
+    ss << "['";
+
+    // Write the completion list.
+    CXCodeCompleteResults* results = complete_at(location_info);
+    std::set<std::string> matches;
+    if (results) {
+        for (unsigned i = 0; i < results->NumResults; ++i)
+            matches.insert(
+                get_typed_text(results->Results[i].CompletionString));
+        clang_disposeCodeCompleteResults(results);
+    }
+    for (auto it = matches.begin(); it != matches.end(); ++it) {
+        if (it != matches.begin())
+            ss << "', '";
+        ss << escape_single_quotes(*it);
+    }
+
+    // Write the footer.
+    ss << "']";
+    vimson = ss.str();
+    return vimson.c_str();
+}
+
+const char*
+libclang_vim::get_filtered_completion_at(const completion_query& query) {
+    thread_local std::string vimson;
+
+    std::lock_guard<std::mutex> lock(get_completion_session().get_mutex());
+
+    std::vector<completion_candidate> candidates = get_best_candidates(query);
+    std::stringstream ss;
+    ss << "[";
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (i)
+            ss << ", ";
+        ss << "'" << escape_single_quotes(candidates[i].typed_text) << "'";
+    }
+    ss << "]";
+    vimson = ss.str();
+    return vimson.c_str();
+}
+
+const char*
+libclang_vim::get_completion_items_at(const completion_query& query) {
+    thread_local std::string vimson;
+
+    std::lock_guard<std::mutex> lock(get_completion_session().get_mutex());
+
+    std::vector<completion_candidate> candidates = get_best_candidates(query);
+    const completion_session& session = get_completion_session();
+    std::stringstream ss;
+    ss << "[";
+    for (const auto& candidate : candidates) {
+        const CXCompletionResult* result =
+            session.get_result(session.get_generation(), candidate.index);
+        cxstring_ptr kind = clang_getCursorKindSpelling(result->CursorKind);
+        ss << "{'id':'" << session.get_generation() << ":" << candidate.index
+           << "','word':'" << escape_single_quotes(candidate.typed_text)
+           << "','kind':'" << to_c_str(kind)
+           << "','priority':" << candidate.priority << "},";
+    }
+    ss << "]";
+    vimson = ss.str();
+    return vimson.c_str();
+}
+
+const char* libclang_vim::get_completion_detail(const std::string& id) {
+    thread_local std::string vimson;
+
+    unsigned long generation = 0;
+    unsigned index = 0;
+    if (std::sscanf(id.c_str(), "%lu:%u", &generation, &index) != 2)
+        return "{}";
+
+    std::lock_guard<std::mutex> lock(get_completion_session().get_mutex());
+
+    const CXCompletionResult* result =
+        get_completion_session().get_result(generation, index);
+    if (!result)
+        return "{}";
+    const CXCompletionString& completion_string = result->CompletionString;
+
+    std::stringstream ss;
+    ss << "{'id':'" << escape_single_quotes(id) << "',";
+    std::string result_type;
+    ss << "'chunks':[";
+    for (unsigned i = 0; i < clang_getNumCompletionChunks(completion_string);
+         ++i) {
+        const CXCompletionChunkKind kind =
+            clang_getCompletionChunkKind(completion_string, i);
+        const std::string text = get_chunk_text(completion_string, i);
+        if (kind == CXCompletionChunk_ResultType)
+            result_type = text;
+        ss << "{'kind':'" << get_chunk_kind_spelling(kind) << "','text':'"
+           << escape_single_quotes(text) << "'},";
+    }
+    ss << "],";
+    ss << stringize_key_value("result_type", escape_single_quotes(result_type));
+    cxstring_ptr brief = clang_getCompletionBriefComment(completion_string);
+    if (to_c_str(brief))
+        ss << stringize_key_value("brief",
+                                  escape_single_quotes(to_c_str(brief)));
+    ss << "'availability':'"
+       << get_availability_spelling(
+              clang_getCompletionAvailability(completion_string))
+       << "',";
+    ss << "}";
+    vimson = ss.str();
+    return vimson.c_str();
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,57 @@
+#if !defined LIBCLANG_VIM_COMPLETION_HPP_INCLUDED
+#define LIBCLANG_VIM_COMPLETION_HPP_INCLUDED
+
+#include <memory>
+#include <string>
+#include <set>
+
+#include <clang-c/Index.h>
+
+#include "helpers.hpp"
+
+namespace libclang_vim {
+
+/// Stores a completion request: the location points to the start of the
+/// identifier, prefix is the already typed part of it.
+class completion_query {
+  public:
+    location_tuple location;
+    std::string prefix;
+    /// Maximum number of returned candidates, 0 means no limit.
+    size_t limit;
+
+    completion_query();
+};
+
+/// Results of the last completion request of a session, reused while only
+/// the typed prefix changes.
+class completion_session;
+
+/// Creates the completion state of a new session.
+std::shared_ptr<completion_session> create_completion_session();
+
+/// Parse "file:args:line:col:prefix:limit".
+completion_query parse_completion_query(const std::string& args_string);
+
+/// Wrapper around clang_codeCompleteAt().
+const char* get_completion_at(const location_tuple& location_info);
+
+/// Same as get_completion_at(), but only returns the best "limit" matches of
+/// "prefix", ranked by fuzzy match quality and completion priority.
+const char* get_filtered_completion_at(const completion_query& query);
+
+/// Same as get_filtered_completion_at(), but returns an id, kind and priority
+/// for each candidate. The id is "generation:index", the generation changes
+/// whenever clang_codeCompleteAt() runs again.
+const char* get_completion_items_at(const completion_query& query);
+
+/// Returns the chunks, result type, brief comment and availability of the
+/// item with the given id from the last get_completion_items_at() call, or
+/// an empty dictionary if newer results replaced it.
+const char* get_completion_detail(const std::string& id);
+
+} // namespace libclang_vim
+
+#endif // LIBCLANG_VIM_COMPLETION_HPP_INCLUDED
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -1,63 +1,10 @@
 #include "deduction.hpp"
 
-#include <clang-c/CXCompilationDatabase.h>
+#include "compilation_database.hpp"
+#include "translation_unit_cache.hpp"
 
 namespace {
 
-/// Look up compilation arguments for a file from a database in one of its
-/// parent directories.
-libclang_vim::args_type parse_compilation_database(const std::string& file) {
-    libclang_vim::args_type ret;
-
-    std::size_t found = file.find_last_of("/\\");
-    std::string directory = file.substr(0, found);
-    while (true) {
-        std::string json =
-            directory + file.substr(found, 1) + "compile_commands.json";
-        std::ifstream stream(json.c_str());
-        if (stream.good())
-            break;
-
-        found = directory.find_last_of("/\\");
-        if (found == std::string::npos)
-            break;
-
-        directory = directory.substr(0, found);
-    }
-
-    if (directory.empty()) {
-        // Our default when no JSON was found.
-        ret.emplace_back("-std=c++1y");
-
-        return ret;
-    }
-
-    CXCompilationDatabase_Error error;
-    CXCompilationDatabase database =
-        clang_CompilationDatabase_fromDirectory(directory.c_str(), &error);
-    if (error == CXCompilationDatabase_NoError) {
-        CXCompileCommands commands =
-            clang_CompilationDatabase_getCompileCommands(database,
-                                                         file.c_str());
-        unsigned commandsSize = clang_CompileCommands_getSize(commands);
-        if (commandsSize >= 1) {
-            CXCompileCommand command =
-                clang_CompileCommands_getCommand(commands, 0);
-            unsigned args = clang_CompileCommand_getNumArgs(command);
-            for (unsigned i = 0; i < args; ++i) {
-                libclang_vim::cxstring_ptr arg =
-                    clang_CompileCommand_getArg(command, i);
-                if (file != clang_getCString(arg))
-                    ret.emplace_back(clang_getCString(arg));
-            }
-        }
-        clang_CompileCommands_dispose(commands);
-    }
-    clang_CompilationDatabase_dispose(database);
-
-    return ret;
-}
-
 CXChildVisitResult valid_type_cursor_getter(CXCursor cursor, CXCursor,
                                             CXClientData data) {
     auto const type = clang_getCursorType(cursor);
@@ -271,7 +218,7 @@ const char* libclang_vim::deduce_type_at(const location_tuple& location_info) {
 }
 
 const char* libclang_vim::get_compile_commands(const std::string& file) {
-    static std::string vimson;
+    thread_local std::string vimson;
 
     // Write the header.
     std::stringstream ss;
@@ -292,24 +239,16 @@ const char* libclang_vim::get_compile_commands(const std::string& file) {
 
 const char*
 libclang_vim::get_current_function_at(const location_tuple& location_info) {
-    static std::string vimson;
+    thread_local std::string vimson;
 
     // Write the header.
     std::stringstream ss;
     ss << "{'name':'";
 
     // Write the actual name.
-    cxindex_ptr index = clang_createIndex(/*excludeDeclarationsFromPCH=*/1,
-                                          /*displayDiagnostics=*/0);
-
     std::string file_name = location_info.file;
-    std::vector<const char*> args_ptrs = get_args_ptrs(location_info.args);
-    std::vector<CXUnsavedFile> unsaved_files =
-        create_unsaved_files(location_info);
-    unsigned options = CXTranslationUnit_Incomplete;
-    cxtranslation_unit_ptr translation_unit(clang_parseTranslationUnit(
-        index, file_name.c_str(), args_ptrs.data(), args_ptrs.size(),
-        unsaved_files.data(), unsaved_files.size(), options));
+    auto const translation_unit =
+        get_translation_unit_cache().get_current(location_info);
     if (!translation_unit)
         return "{}";
 
@@ -341,29 +280,8 @@ libclang_vim::get_current_function_at(const location_tuple& location_info) {
         kind = clang_getCursorKind(cursor);
     }
 
-    if (kind != CXCursor_TranslationUnit) {
-        std::stack<std::string> stack;
-        while (true) {
-            cxstring_ptr aString = clang_getCursorSpelling(cursor);
-            if (!strlen(clang_getCString(aString)))
-                stack.push("(anonymous namespace)");
-            else
-                stack.push(clang_getCString(aString));
-
-            cursor = clang_getCursorSemanticParent(cursor);
-            if (clang_getCursorKind(cursor) == CXCursor_TranslationUnit)
-                break;
-        }
-        bool first = true;
-        while (!stack.empty()) {
-            if (first)
-                first = false;
-            else
-                ss << "::";
-            ss << stack.top();
-            stack.pop();
-        }
-    }
+    if (kind != CXCursor_TranslationUnit)
+        ss << get_qualified_name(cursor);
 
     // Write the footer.
     ss << "'}";
@@ -372,24 +290,16 @@ libclang_vim::get_current_function_at(const location_tuple& location_info) {
 }
 
 const char* libclang_vim::get_comment_at(const location_tuple& location_info) {
-    static std::string vimson;
+    thread_local std::string vimson;
 
     // Write the header.
     std::stringstream ss;
     ss << "{'brief':'";
 
     // Write the actual comment.
-    cxindex_ptr index = clang_createIndex(/*excludeDeclarationsFromPCH=*/1,
-                                          /*displayDiagnostics=*/0);
-
     std::string file_name = location_info.file;
-    std::vector<const char*> args_ptrs = get_args_ptrs(location_info.args);
-    std::vector<CXUnsavedFile> unsaved_files =
-        create_unsaved_files(location_info);
-    unsigned options = CXTranslationUnit_Incomplete;
-    cxtranslation_unit_ptr translation_unit(clang_parseTranslationUnit(
-        index, file_name.c_str(), args_ptrs.data(), args_ptrs.size(),
-        unsaved_files.data(), unsaved_files.size(), options));
+    auto const translation_unit =
+        get_translation_unit_cache().get_current(location_info);
     if (!translation_unit)
         return "{}";
 
@@ -425,24 +335,16 @@ const char* libclang_vim::get_comment_at(const location_tuple& location_info) {
 
 const char*
 libclang_vim::get_deduced_declaration_at(const location_tuple& location_info) {
-    static std::string vimson;
+    thread_local std::string vimson;
 
     // Write the header.
     std::stringstream ss;
     ss << "{";
 
     // Write the actual comment.
-    cxindex_ptr index = clang_createIndex(/*excludeDeclarationsFromPCH=*/1,
-                                          /*displayDiagnostics=*/0);
-
     std::string file_name = location_info.file;
-    std::vector<const char*> args_ptrs = get_args_ptrs(location_info.args);
-    std::vector<CXUnsavedFile> unsaved_files =
-        create_unsaved_files(location_info);
-    CXTranslationUnit_Flags flags = CXTranslationUnit_Incomplete;
-    cxtranslation_unit_ptr translation_unit(clang_parseTranslationUnit(
-        index, file_name.c_str(), args_ptrs.data(), args_ptrs.size(),
-        unsaved_files.data(), unsaved_files.size(), flags));
+    auto const translation_unit =
+        get_translation_unit_cache().get_current(location_info);
     if (!translation_unit)
         return "{}";
 
@@ -484,170 +386,15 @@ libclang_vim::get_deduced_declaration_at(const location_tuple& location_info) {
     return vimson.c_str();
 }
 
-const char* libclang_vim::get_include_at(const location_tuple& location_info) {
-    static std::string vimson;
-
-    // Write the header.
-    std::stringstream ss;
-    ss << "{'file':'";
-
-    // Write the actual comment.
-    cxindex_ptr index = clang_createIndex(/*excludeDeclarationsFromPCH=*/1,
-                                          /*displayDiagnostics=*/0);
-
-    std::string file_name = location_info.file;
-    std::vector<const char*> args_ptrs = get_args_ptrs(location_info.args);
-    unsigned options = CXTranslationUnit_Incomplete |
-                       CXTranslationUnit_DetailedPreprocessingRecord;
-    std::vector<CXUnsavedFile> unsaved_files =
-        create_unsaved_files(location_info);
-    cxtranslation_unit_ptr translation_unit(clang_parseTranslationUnit(
-        index, file_name.c_str(), args_ptrs.data(), args_ptrs.size(),
-        unsaved_files.data(), unsaved_files.size(), options));
-    if (!translation_unit)
-        return "{}";
-
-    CXFile file = clang_getFile(translation_unit, file_name.c_str());
-    int line = location_info.line;
-    int column = location_info.col;
-    CXSourceLocation source_location =
-        clang_getLocation(translation_unit, file, line, column);
-    CXCursor cursor = clang_getCursor(translation_unit, source_location);
-    if (clang_getCursorKind(cursor) != CXCursor_InclusionDirective)
-        return "{}";
-
-    CXFile included_file = clang_getIncludedFile(cursor);
-    cxstring_ptr included_name = clang_getFileName(included_file);
-    ss << clang_getCString(included_name);
-
-    // Write the footer.
-    ss << "'}";
-    vimson = ss.str();
-    return vimson.c_str();
-}
-
-const char*
-libclang_vim::get_completion_at(const location_tuple& location_info) {
-    static std::string vimson;
-
-    // Write the header.
-    std::stringstream ss;
-    ss << "['";
-
-    // Write the completion list.
-    libclang_vim::cxindex_ptr index = clang_createIndex(
-        /*excludeDeclarationsFromPCH=*/1, /*displayDiagnostics=*/0);
-
-    std::string file_name = location_info.file;
-    std::vector<const char*> args_ptrs = get_args_ptrs(location_info.args);
-    std::vector<CXUnsavedFile> unsaved_files =
-        create_unsaved_files(location_info);
-    unsigned options = CXTranslationUnit_Incomplete;
-    cxtranslation_unit_ptr translation_unit(clang_parseTranslationUnit(
-        index, file_name.c_str(), args_ptrs.data(), args_ptrs.size(),
-        unsaved_files.data(), unsaved_files.size(), options));
-    if (!translation_unit)
-        return "[]";
-
-    unsigned line = location_info.line;
-    unsigned column = location_info.col;
-    CXCodeCompleteResults* results = clang_codeCompleteAt(
-        translation_unit, file_name.c_str(), line, column, unsaved_files.data(),
-        unsaved_files.size(), clang_defaultCodeCompleteOptions());
-    std::set<std::string> matches;
-    if (results) {
-        for (unsigned i = 0; i < results->NumResults; ++i) {
-            const CXCompletionString& completion_string =
-                results->Results[i].CompletionString;
-            std::stringstream match;
-            for (unsigned j = 0;
-                 j < clang_getNumCompletionChunks(completion_string); ++j) {
-                if (clang_getCompletionChunkKind(completion_string, j) !=
-                    CXCompletionChunk_TypedText)
-                    continue;
-
-                const CXString& chunk_text =
-                    clang_getCompletionChunkText(completion_string, j);
-                match << clang_getCString(chunk_text);
-            }
-            matches.insert(match.str());
-        }
-        clang_disposeCodeCompleteResults(results);
-    }
-    for (auto it = matches.begin(); it != matches.end(); ++it) {
-        if (it != matches.begin())
-            ss << "', '";
-        ss << *it;
-    }
-
-    // Write the footer.
-    ss << "']";
-    vimson = ss.str();
-    return vimson.c_str();
-}
-
 const char* libclang_vim::get_diagnostics(const location_tuple& location_info) {
-    static std::string vimson;
-
-    // Write the header.
-    std::stringstream ss;
-    ss << "[";
-
-    // Write the diagnostic list.
-    libclang_vim::cxindex_ptr index = clang_createIndex(
-        /*excludeDeclarationsFromPCH=*/1, /*displayDiagnostics=*/0);
+    thread_local std::string vimson;
 
-    std::string file_name = location_info.file;
-    std::vector<const char*> args_ptrs = get_args_ptrs(location_info.args);
-    std::vector<CXUnsavedFile> unsaved_files =
-        create_unsaved_files(location_info);
-    unsigned options = CXTranslationUnit_Incomplete;
-    cxtranslation_unit_ptr translation_unit(clang_parseTranslationUnit(
-        index, file_name.c_str(), args_ptrs.data(), args_ptrs.size(),
-        unsaved_files.data(), unsaved_files.size(), options));
+    auto const translation_unit =
+        get_translation_unit_cache().get_reparsed(location_info);
     if (!translation_unit)
         return "[]";
 
-    unsigned num_diagnostics = clang_getNumDiagnostics(translation_unit);
-    for (unsigned i = 0; i < num_diagnostics; ++i) {
-        CXDiagnostic diagnostic = clang_getDiagnostic(translation_unit, i);
-        if (diagnostic) {
-            std::string severity;
-            switch (clang_getDiagnosticSeverity(diagnostic)) {
-            case CXDiagnostic_Ignored:
-                severity = "ignored";
-                break;
-            case CXDiagnostic_Note:
-                severity = "note";
-                break;
-            case CXDiagnostic_Warning:
-                severity = "warning";
-                break;
-            case CXDiagnostic_Error:
-                severity = "error";
-                break;
-            case CXDiagnostic_Fatal:
-                severity = "fatal";
-                break;
-            }
-            ss << "{'severity': '" << severity << "', ";
-
-            CXSourceLocation location = clang_getDiagnosticLocation(diagnostic);
-            CXFile location_file;
-            unsigned location_line;
-            unsigned location_column;
-            clang_getExpansionLocation(location, &location_file, &location_line,
-                                       &location_column, nullptr);
-            libclang_vim::cxstring_ptr location_file_name =
-                clang_getFileName(location_file);
-            ss << libclang_vim::stringize_location(location) << "}, ";
-        }
-        clang_disposeDiagnostic(diagnostic);
-    }
-
-    // Write the footer.
-    ss << "]";
-    vimson = ss.str();
+    vimson = stringize_diagnostics(translation_unit);
     return vimson.c_str();
 }
 
@@ -28,12 +28,6 @@ const char* get_comment_at(const location_tuple& location_info);
 /// Get location of declaration referenced by location_info.
 const char* get_deduced_declaration_at(const location_tuple& location_info);
 
-/// Wrapper around clang_getIncludedFile().
-const char* get_include_at(const location_tuple& location_info);
-
-/// Wrapper around clang_codeCompleteAt().
-const char* get_completion_at(const location_tuple& location_info);
-
 /// Wrapper around clang_CompilationDatabase_getCompileCommands().
 const char* get_compile_commands(const std::string& file);
 
@@ -0,0 +1,190 @@
+#include "diagnostics_engine.hpp"
+
+#include "scheduler.hpp"
+#include "stringizers.hpp"
+#include "translation_unit_cache.hpp"
+
+libclang_vim::diagnostics_request::diagnostics_request() : generation(0) {}
+
+libclang_vim::diagnostics_request
+libclang_vim::parse_diagnostics_request(const std::string& args_string) {
+    diagnostics_request request;
+    const auto generation_colon = args_string.rfind(':');
+    if (generation_colon == std::string::npos)
+        return request;
+
+    request.location =
+        parse_default_args(args_string.substr(0, generation_colon));
+    std::sscanf(args_string.c_str() + generation_colon + 1, "%llu",
+                &request.generation);
+    return request;
+}
+
+libclang_vim::diagnostics_engine::diagnostics_engine(
+    std::chrono::milliseconds debounce)
+    : _debounce(debounce), _stopping(false),
+      _worker(&diagnostics_engine::run, this) {}
+
+libclang_vim::diagnostics_engine::~diagnostics_engine() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _condition.notify_all();
+    _worker.join();
+}
+
+void libclang_vim::diagnostics_engine::run() {
+    // Translation units are only touched by this thread.
+    translation_unit_cache cache(/*warm_up_completion=*/false,
+                                 /*double_buffered=*/false);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_stopping) {
+        if (_pending.empty()) {
+            _condition.wait(lock);
+            continue;
+        }
+
+        auto next = _pending.begin();
+        for (auto it = _pending.begin(); it != _pending.end(); ++it) {
+            if (it->second.due < next->second.due)
+                next = it;
+        }
+        if (clock::now() < next->second.due) {
+            // Woken up early when a newer request postpones the due time.
+            _condition.wait_until(lock, next->second.due);
+            continue;
+        }
+
+        const std::string file = next->first;
+        const diagnostics_request request = next->second.request;
+        const clock::time_point due = next->second.due;
+        _pending.erase(next);
+        _running = file;
+        lock.unlock();
+
+        std::string diagnostics = "[]";
+        bool superseded = false;
+        {
+            // Diagnostics of the buffer being edited, but nobody waits for
+            // them.
+            scheduler_slot slot(request_priority::visible, due);
+            auto const translation_unit = cache.get_reparsed(request.location);
+            // The reparse can't be interrupted, but a newer request that
+            // arrived meanwhile makes its result useless.
+            lock.lock();
+            superseded = is_superseded(file, request.generation);
+            lock.unlock();
+            if (translation_unit && !superseded)
+                diagnostics = stringize_diagnostics(translation_unit);
+        }
+
+        lock.lock();
+        _running.clear();
+        if (!superseded && !is_superseded(file, request.generation)) {
+            auto result = _results.find(file);
+            if (result == _results.end()) {
+                completed_result completed;
+                completed.generation = request.generation;
+                completed.diagnostics = diagnostics;
+                _results.insert(std::make_pair(file, completed));
+            } else if (result->second.generation <= request.generation) {
+                result->second.generation = request.generation;
+                result->second.diagnostics = diagnostics;
+            }
+        }
+        _completed.notify_all();
+    }
+}
+
+bool libclang_vim::diagnostics_engine::is_superseded(
+    const std::string& file, unsigned long long generation) const {
+    auto const pending = _pending.find(file);
+    return pending != _pending.end() &&
+           pending->second.request.generation > generation;
+}
+
+std::string
+libclang_vim::diagnostics_engine::format_latest(const std::string& file) const {
+    auto const result = _results.find(file);
+    if (result == _results.end())
+        return "{}";
+
+    return "{'generation':" + std::to_string(result->second.generation) +
+           ",'diagnostics':" + result->second.diagnostics + "}";
+}
+
+void libclang_vim::diagnostics_engine::schedule(
+    const diagnostics_request& request) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const std::string file = get_absolute_path(request.location.file);
+        auto const result = _results.find(file);
+        if (result != _results.end() &&
+            result->second.generation > request.generation)
+            return;
+
+        auto const pending = _pending.find(file);
+        if (pending != _pending.end() &&
+            pending->second.request.generation > request.generation)
+            return;
+
+        pending_request queued;
+        queued.request = request;
+        queued.due = clock::now() + _debounce;
+        _pending[file] = queued;
+    }
+    _condition.notify_all();
+}
+
+std::string
+libclang_vim::diagnostics_engine::get_latest(const std::string& file) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return format_latest(get_absolute_path(file));
+}
+
+std::string
+libclang_vim::diagnostics_engine::wait_for(const std::string& file,
+                                           unsigned long long generation) {
+    const std::string key = get_absolute_path(file);
+    std::unique_lock<std::mutex> lock(_mutex);
+    _completed.wait(lock, [this, &key, generation] {
+        auto const result = _results.find(key);
+        if (result != _results.end() && result->second.generation >= generation)
+            return true;
+        return !_pending.count(key) && _running != key;
+    });
+    return format_latest(key);
+}
+
+libclang_vim::diagnostics_engine& libclang_vim::get_diagnostics_engine() {
+    static diagnostics_engine engine(std::chrono::milliseconds(250));
+    return engine;
+}
+
+const char*
+libclang_vim::schedule_diagnostics(const diagnostics_request& request) {
+    if (request.location.file.empty())
+        return "{}";
+
+    thread_local std::string vimson;
+    get_diagnostics_engine().schedule(request);
+    vimson = "{'generation':" + std::to_string(request.generation) + "}";
+    return vimson.c_str();
+}
+
+const char* libclang_vim::get_latest_diagnostics(const std::string& file) {
+    thread_local std::string vimson;
+    vimson = get_diagnostics_engine().get_latest(file);
+    return vimson.c_str();
+}
+
+const char* libclang_vim::wait_for_diagnostics(const std::string& file,
+                                               unsigned long long generation) {
+    thread_local std::string vimson;
+    vimson = get_diagnostics_engine().wait_for(file, generation);
+    return vimson.c_str();
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
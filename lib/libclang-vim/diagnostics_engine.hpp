@@ -0,0 +1,104 @@
+#if !defined LIBCLANG_VIM_DIAGNOSTICS_ENGINE_HPP_INCLUDED
+#define LIBCLANG_VIM_DIAGNOSTICS_ENGINE_HPP_INCLUDED
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "helpers.hpp"
+
+namespace libclang_vim {
+
+/// Stores a diagnostics request: the buffer and its generation (e.g. Vim's
+/// b:changedtick).
+class diagnostics_request {
+  public:
+    location_tuple location;
+    unsigned long long generation;
+
+    diagnostics_request();
+};
+
+/// Parse "file:args:generation".
+diagnostics_request parse_diagnostics_request(const std::string& args_string);
+
+/// Computes diagnostics on a background thread, after the buffer did not
+/// change for a debounce interval. Older requests for a file are dropped when
+/// a newer generation is scheduled, even if their parse already started.
+/// Files are keyed by their absolute path.
+class diagnostics_engine {
+    using clock = std::chrono::steady_clock;
+
+    struct pending_request {
+        diagnostics_request request;
+        clock::time_point due;
+    };
+
+    struct completed_result {
+        unsigned long long generation;
+        std::string diagnostics;
+    };
+
+    const std::chrono::milliseconds _debounce;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    /// Notified when diagnostics are completed or dropped.
+    std::condition_variable _completed;
+    /// Requests waiting for their debounce interval, by file.
+    std::map<std::string, pending_request> _pending;
+    /// Latest completed diagnostics, by file.
+    std::map<std::string, completed_result> _results;
+    /// File of the request being computed, empty if none.
+    std::string _running;
+    bool _stopping;
+    std::thread _worker;
+
+    void run();
+
+    /// If a newer request of file is pending. Needs _mutex.
+    bool is_superseded(const std::string& file,
+                       unsigned long long generation) const;
+
+    std::string format_latest(const std::string& file) const;
+
+  public:
+    explicit diagnostics_engine(std::chrono::milliseconds debounce);
+    diagnostics_engine(const diagnostics_engine&) = delete;
+    diagnostics_engine& operator=(const diagnostics_engine&) = delete;
+    ~diagnostics_engine();
+
+    /// Queues request, replacing the pending request of the same file.
+    /// Requests older than the pending or completed one are ignored.
+    void schedule(const diagnostics_request& request);
+
+    /// Returns the latest completed diagnostics of file with their
+    /// generation, without blocking on pending requests.
+    std::string get_latest(const std::string& file);
+
+    /// Same as get_latest(), but first waits until the diagnostics of
+    /// generation or a newer one are completed, as long as any request of
+    /// file is pending or running.
+    std::string wait_for(const std::string& file,
+                         unsigned long long generation);
+};
+
+diagnostics_engine& get_diagnostics_engine();
+
+/// Wrapper around diagnostics_engine::schedule().
+const char* schedule_diagnostics(const diagnostics_request& request);
+
+/// Wrapper around diagnostics_engine::get_latest().
+const char* get_latest_diagnostics(const std::string& file);
+
+/// Wrapper around diagnostics_engine::wait_for().
+const char* wait_for_diagnostics(const std::string& file,
+                                 unsigned long long generation);
+
+} // namespace libclang_vim
+
+#endif // LIBCLANG_VIM_DIAGNOSTICS_ENGINE_HPP_INCLUDED
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,308 @@
+#include "function_metrics.hpp"
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+
+#include "AST_extracter.hpp"
+
+namespace {
+
+const size_t no_function = static_cast<size_t>(-1);
+
+using function_list = std::vector<libclang_vim::function_metrics>;
+
+/// Content hashes of the headers of a translation unit, by absolute name.
+using inclusion_hashes = std::map<std::string, unsigned long long>;
+
+/// Client data of measure_cursor().
+class metrics_visitor_data {
+  public:
+    function_list& functions;
+    /// Index of the innermost definition in functions, or no_function.
+    size_t function;
+    /// Nesting depth inside that definition.
+    unsigned depth;
+};
+
+bool is_nesting_kind(CXCursorKind kind) {
+    switch (kind) {
+    case CXCursor_IfStmt:
+    case CXCursor_SwitchStmt:
+    case CXCursor_CXXTryStmt:
+        return true;
+    default:
+        return libclang_vim::is_loop_kind(kind);
+    }
+}
+
+unsigned get_line(const CXSourceLocation& location) {
+    unsigned line;
+    clang_getSpellingLocation(location, nullptr, &line, nullptr, nullptr);
+    return line;
+}
+
+CXChildVisitResult measure_cursor(CXCursor cursor, CXCursor parent,
+                                  CXClientData client_data) {
+    auto& data = *static_cast<metrics_visitor_data*>(client_data);
+    if (!libclang_vim::is_extracted(
+            libclang_vim::extraction_policy::current_file, cursor))
+        return CXChildVisit_Continue;
+
+    const CXCursorKind kind = clang_getCursorKind(cursor);
+    const size_t function = data.function;
+    const unsigned depth = data.depth;
+    if (libclang_vim::is_function_decl_kind(kind) &&
+        clang_isCursorDefinition(cursor)) {
+        const CXSourceRange extent = clang_getCursorExtent(cursor);
+        libclang_vim::function_metrics metrics = {};
+        metrics.name = libclang_vim::get_qualified_name(cursor);
+        metrics.line = get_line(clang_getCursorLocation(cursor));
+        metrics.lines = get_line(clang_getRangeEnd(extent)) -
+                        get_line(clang_getRangeStart(extent)) + 1;
+        data.functions.push_back(metrics);
+        data.function = data.functions.size() - 1;
+        data.depth = 0;
+    }
+
+    if (data.function != no_function) {
+        libclang_vim::function_metrics& metrics = data.functions[data.function];
+        ++metrics.nodes;
+        // Expression statements are just expressions in the AST.
+        if ((clang_isStatement(kind) && kind != CXCursor_CompoundStmt) ||
+            clang_getCursorKind(parent) == CXCursor_CompoundStmt)
+            ++metrics.statements;
+        if (libclang_vim::is_loop_kind(kind))
+            ++metrics.loops;
+        if (kind == CXCursor_CallExpr)
+            ++metrics.calls;
+        if (is_nesting_kind(kind)) {
+            ++data.depth;
+            metrics.max_depth = std::max(metrics.max_depth, data.depth);
+        }
+    }
+
+    clang_visitChildren(cursor, measure_cursor, client_data);
+    data.function = function;
+    data.depth = depth;
+    return CXChildVisit_Continue;
+}
+
+/// Client data of collect_inclusion().
+class inclusion_visitor_data {
+  public:
+    /// Relative names of included files are relative to it.
+    const std::string& directory;
+    inclusion_hashes& hashes;
+    /// Cleared if a header can't be read.
+    bool complete;
+};
+
+void collect_inclusion(CXFile included_file, CXSourceLocation*,
+                       unsigned include_len, CXClientData client_data) {
+    // The main file is hashed by the caller, it may be an unsaved buffer.
+    if (!include_len)
+        return;
+
+    auto& data = *static_cast<inclusion_visitor_data*>(client_data);
+    libclang_vim::cxstring_ptr name = clang_getFileName(included_file);
+    const std::string file =
+        libclang_vim::get_absolute_path(clang_getCString(name), data.directory);
+    unsigned long long hash;
+    if (libclang_vim::get_file_content_hash(file, hash))
+        data.hashes[file] = hash;
+    else
+        data.complete = false;
+}
+
+/// The directory of the -working-directory= argument of a compile command,
+/// or an empty string for the working directory of the process.
+std::string get_working_directory(const libclang_vim::args_type& args) {
+    const std::string option = "-working-directory=";
+    for (const auto& arg : args) {
+        if (arg.compare(0, option.size(), option) == 0)
+            return arg.substr(option.size());
+    }
+    return std::string();
+}
+
+/// Returns true if all headers still have the recorded hashes.
+bool are_inclusions_current(const inclusion_hashes& inclusions) {
+    for (const auto& inclusion : inclusions) {
+        unsigned long long hash;
+        if (!libclang_vim::get_file_content_hash(inclusion.first, hash) ||
+            hash != inclusion.second)
+            return false;
+    }
+    return true;
+}
+
+/// Metrics of recently measured files, shared by all threads.
+class function_metrics_cache {
+    struct entry {
+        libclang_vim::args_type args;
+        unsigned long long content_hash;
+        std::shared_ptr<const inclusion_hashes> inclusions;
+        std::shared_ptr<const function_list> functions;
+        unsigned long last_use;
+    };
+
+    std::mutex _mutex;
+    std::map<std::string, entry> _entries;
+    unsigned long _use_counter;
+
+  public:
+    /// Enough for every translation unit of a large project, the metrics are
+    /// small.
+    static const size_t max_entries = 4096;
+
+    function_metrics_cache() : _use_counter(0) {}
+
+    std::shared_ptr<const function_list>
+    find(const std::string& key, const libclang_vim::args_type& args,
+         unsigned long long content_hash);
+
+    void insert(const std::string& key, const libclang_vim::args_type& args,
+                unsigned long long content_hash,
+                std::shared_ptr<const inclusion_hashes> inclusions,
+                std::shared_ptr<const function_list> functions);
+};
+
+std::shared_ptr<const function_list>
+function_metrics_cache::find(const std::string& key,
+                             const libclang_vim::args_type& args,
+                             unsigned long long content_hash) {
+    std::shared_ptr<const inclusion_hashes> inclusions;
+    std::shared_ptr<const function_list> functions;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto const it = _entries.find(key);
+        if (it == _entries.end() || it->second.args != args ||
+            it->second.content_hash != content_hash)
+            return nullptr;
+
+        it->second.last_use = ++_use_counter;
+        inclusions = it->second.inclusions;
+        functions = it->second.functions;
+    }
+
+    // Read the headers outside of the lock, so threads validate in parallel.
+    if (!are_inclusions_current(*inclusions))
+        return nullptr;
+    return functions;
+}
+
+void function_metrics_cache::insert(
+    const std::string& key, const libclang_vim::args_type& args,
+    unsigned long long content_hash,
+    std::shared_ptr<const inclusion_hashes> inclusions,
+    std::shared_ptr<const function_list> functions) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_entries.count(key) && _entries.size() >= max_entries) {
+        auto oldest = _entries.begin();
+        for (auto entry = _entries.begin(); entry != _entries.end(); ++entry) {
+            if (entry->second.last_use < oldest->second.last_use)
+                oldest = entry;
+        }
+        _entries.erase(oldest);
+    }
+
+    entry& cached = _entries[key];
+    cached.args = args;
+    cached.content_hash = content_hash;
+    cached.inclusions = std::move(inclusions);
+    cached.functions = std::move(functions);
+    cached.last_use = ++_use_counter;
+}
+
+function_metrics_cache& get_function_metrics_cache() {
+    static function_metrics_cache cache;
+    return cache;
+}
+}
+
+std::string libclang_vim::stringize_function_metrics(
+    const function_metrics& metrics) {
+    std::stringstream ss;
+    ss << "'name':'" << escape_single_quotes(metrics.name) << "',";
+    ss << "'line':" << metrics.line << ",";
+    ss << "'statements':" << metrics.statements << ",";
+    ss << "'nodes':" << metrics.nodes << ",";
+    ss << "'max_depth':" << metrics.max_depth << ",";
+    ss << "'loops':" << metrics.loops << ",";
+    ss << "'calls':" << metrics.calls << ",";
+    ss << "'lines':" << metrics.lines << ",";
+    return ss.str();
+}
+
+std::vector<libclang_vim::function_metrics>
+libclang_vim::measure_functions(CXTranslationUnit translation_unit) {
+    std::vector<function_metrics> functions;
+    metrics_visitor_data data = {functions, no_function, 0};
+    clang_visitChildren(clang_getTranslationUnitCursor(translation_unit),
+                        measure_cursor, &data);
+    return functions;
+}
+
+std::shared_ptr<const std::vector<libclang_vim::function_metrics>>
+libclang_vim::get_function_metrics(const location_tuple& location_info,
+                                   CXIndex index, bool& cached) {
+    unsigned long long content_hash;
+    if (!location_info.unsaved_file.empty())
+        content_hash = get_content_hash(location_info.unsaved_file.data(),
+                                        location_info.unsaved_file.size());
+    else if (!get_file_content_hash(location_info.file, content_hash))
+        return nullptr;
+
+    const std::string key = get_absolute_path(location_info.file);
+    auto functions = get_function_metrics_cache().find(
+        key, location_info.args, content_hash);
+    cached = functions != nullptr;
+    if (functions)
+        return functions;
+
+    // Parse outside of the cache lock, so threads measure in parallel.
+    auto const args_ptrs = get_args_ptrs(location_info.args);
+    std::vector<CXUnsavedFile> unsaved_files =
+        create_unsaved_files(location_info);
+    cxtranslation_unit_ptr translation_unit(clang_parseTranslationUnit(
+        index, location_info.file.c_str(), args_ptrs.data(), args_ptrs.size(),
+        unsaved_files.data(), unsaved_files.size(),
+        CXTranslationUnit_Incomplete));
+    if (!translation_unit)
+        return nullptr;
+
+    functions = std::make_shared<std::vector<function_metrics>>(
+        measure_functions(translation_unit));
+
+    // Macros and declarations of the headers change the metrics, too.
+    const std::string directory = get_working_directory(location_info.args);
+    auto inclusions = std::make_shared<inclusion_hashes>();
+    inclusion_visitor_data data = {directory, *inclusions, true};
+    clang_getInclusions(translation_unit, collect_inclusion, &data);
+    if (data.complete)
+        get_function_metrics_cache().insert(key, location_info.args,
+                                            content_hash, inclusions,
+                                            functions);
+    return functions;
+}
+
+const char*
+libclang_vim::extract_function_metrics(const location_tuple& location_info) {
+    thread_local std::string vimson;
+
+    cxindex_ptr index = clang_createIndex(/*excludeDeclarationsFromPCH=*/1,
+                                          /*displayDiagnostics=*/0);
+    bool cached;
+    auto const functions = get_function_metrics(location_info, index, cached);
+    if (!functions)
+        return "[]";
+
+    vimson = "[";
+    for (const auto& metrics : *functions)
+        vimson += "{" + stringize_function_metrics(metrics) + "},";
+    vimson += "]";
+    return vimson.c_str();
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
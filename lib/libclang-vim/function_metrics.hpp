@@ -0,0 +1,61 @@
+#if !defined LIBCLANG_VIM_FUNCTION_METRICS_HPP_INCLUDED
+#define LIBCLANG_VIM_FUNCTION_METRICS_HPP_INCLUDED
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <clang-c/Index.h>
+
+#include "helpers.hpp"
+
+namespace libclang_vim {
+
+/// Size and shape of one function definition, to spot the ones that are too
+/// big to be inlined.
+class function_metrics {
+  public:
+    /// Qualified name.
+    std::string name;
+    unsigned line;
+    /// Statement nodes other than compound statements, and the expressions
+    /// directly inside compound statements.
+    unsigned statements;
+    /// Cursors of the definition, including the definition itself.
+    unsigned nodes;
+    /// Deepest nesting of if, switch, loop and try statements.
+    unsigned max_depth;
+    unsigned loops;
+    unsigned calls;
+    /// Number of lines of the definition.
+    unsigned lines;
+};
+
+/// Returns "'name':'..','line':..,'statements':..,'nodes':..,'max_depth':..,
+/// 'loops':..,'calls':..,'lines':..,".
+std::string stringize_function_metrics(const function_metrics& metrics);
+
+/// Measures the function definitions of the main file of translation_unit,
+/// in one pass. Definitions inside other ones (e.g. methods of local classes)
+/// are measured separately, lambdas are part of their enclosing function.
+std::vector<function_metrics>
+measure_functions(CXTranslationUnit translation_unit);
+
+/// Returns the metrics of the function definitions of location_info, parsed
+/// with index only if the arguments, the main file or one of its headers
+/// changed since the last call; cached is set accordingly. Can be called
+/// from multiple threads, each with its own index. Returns nullptr if the
+/// file can't be read or parsed.
+std::shared_ptr<const std::vector<function_metrics>>
+get_function_metrics(const location_tuple& location_info, CXIndex index,
+                     bool& cached);
+
+/// Statement, AST node, loop and call counts, maximum nesting depth and line
+/// span of every function definition of the main file of location_info.
+const char* extract_function_metrics(const location_tuple& location_info);
+
+} // namespace libclang_vim
+
+#endif // LIBCLANG_VIM_FUNCTION_METRICS_HPP_INCLUDED
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -1,5 +1,13 @@
 #include "helpers.hpp"
 
+#include <cctype>
+#include <cstdio>
+#include <stack>
+
+#include <unistd.h>
+
+#include "translation_unit_cache.hpp"
+
 namespace {
 
 using DataType =
@@ -7,6 +15,9 @@ using DataType =
 
 CXChildVisitResult search_kind_visitor(CXCursor cursor, CXCursor,
                                        CXClientData data) {
+    if (libclang_vim::is_cancelled())
+        return CXChildVisit_Break;
+
     auto const kind = clang_getCursorKind(cursor);
     if ((reinterpret_cast<DataType*>(data)->second(kind))) {
         (reinterpret_cast<DataType*>(data))->first = cursor;
@@ -17,6 +28,8 @@ CXChildVisitResult search_kind_visitor(CXCursor cursor, CXCursor,
     return CXChildVisit_Continue;
 }
 
+thread_local const libclang_vim::cancellation_token* current_token = nullptr;
+
 libclang_vim::args_type parse_compiler_args(const std::string& s) {
     using iterator = std::istream_iterator<std::string>;
     libclang_vim::args_type result;
@@ -91,6 +104,75 @@ std::string libclang_vim::stringize_key_value(const char* key_name,
         return "'" + (key_name + ("':'" + s + "',"));
 }
 
+std::string libclang_vim::escape_single_quotes(const std::string& s) {
+    std::string result;
+    result.reserve(s.size());
+    for (const char c : s) {
+        if (c == '\'')
+            result += '\'';
+        result += c;
+    }
+    return result;
+}
+
+std::string libclang_vim::escape_json(const std::string& s) {
+    std::string ret;
+    for (char c : s) {
+        switch (c) {
+        case '"':
+            ret += "\\\"";
+            break;
+        case '\\':
+            ret += "\\\\";
+            break;
+        case '\n':
+            ret += "\\n";
+            break;
+        case '\t':
+            ret += "\\t";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char buffer[8];
+                std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                ret += buffer;
+            } else
+                ret += c;
+        }
+    }
+    return ret;
+}
+
+std::string libclang_vim::vimson_to_json(const std::string& vimson) {
+    std::string ret;
+    ret.reserve(vimson.size());
+    for (size_t i = 0; i < vimson.size(); ++i) {
+        const char c = vimson[i];
+        if (c == '\'') {
+            // A quote inside a literal string is doubled.
+            std::string literal;
+            for (++i; i < vimson.size(); ++i) {
+                if (vimson[i] == '\'') {
+                    if (i + 1 >= vimson.size() || vimson[i + 1] != '\'')
+                        break;
+                    ++i;
+                }
+                literal += vimson[i];
+            }
+            ret += "\"" + escape_json(literal) + "\"";
+        } else if (c == ',') {
+            // Vim allows a trailing comma, JSON doesn't.
+            const size_t next = vimson.find_first_not_of(" \t\n", i + 1);
+            if (next == std::string::npos || vimson[next] == ']' ||
+                vimson[next] == '}')
+                continue;
+            ret += c;
+        } else
+            ret += c;
+    }
+    return ret;
+}
+
 bool libclang_vim::is_class_decl_kind(const CXCursorKind& kind) {
     switch (kind) {
     case CXCursor_StructDecl:
@@ -144,6 +226,159 @@ bool libclang_vim::is_parameter(const CXCursor& cursor) {
     return is_parameter_kind(clang_getCursorKind(cursor));
 }
 
+bool libclang_vim::is_loop_kind(const CXCursorKind& kind) {
+    switch (kind) {
+    case CXCursor_ForStmt:
+    case CXCursor_CXXForRangeStmt:
+    case CXCursor_WhileStmt:
+    case CXCursor_DoStmt:
+        return true;
+    default:
+        return false;
+    }
+}
+
+std::string libclang_vim::get_qualified_name(const CXCursor& cursor) {
+    std::stack<std::string> stack;
+    CXCursor current = cursor;
+    while (true) {
+        cxstring_ptr aString = clang_getCursorSpelling(current);
+        if (!strlen(clang_getCString(aString)))
+            stack.push("(anonymous namespace)");
+        else
+            stack.push(clang_getCString(aString));
+
+        current = clang_getCursorSemanticParent(current);
+        const CXCursorKind kind = clang_getCursorKind(current);
+        if (kind == CXCursor_TranslationUnit || clang_isInvalid(kind))
+            break;
+    }
+
+    std::string ret;
+    while (!stack.empty()) {
+        if (!ret.empty())
+            ret += "::";
+        ret += stack.top();
+        stack.pop();
+    }
+    return ret;
+}
+
+unsigned long long libclang_vim::get_content_hash(const char* data,
+                                                  size_t size) {
+    unsigned long long hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+bool libclang_vim::get_file_content_hash(const std::string& file,
+                                         unsigned long long& hash) {
+    std::ifstream stream(file.c_str(), std::ios::in | std::ios::binary);
+    if (!stream.good())
+        return false;
+
+    std::vector<char> contents((std::istreambuf_iterator<char>(stream)),
+                               std::istreambuf_iterator<char>());
+    hash = get_content_hash(contents.data(), contents.size());
+    return true;
+}
+
+unsigned long
+libclang_vim::get_memory_usage(CXTranslationUnit translation_unit) {
+    CXTUResourceUsage usage = clang_getCXTUResourceUsage(translation_unit);
+    unsigned long ret = 0;
+    for (unsigned i = 0; i < usage.numEntries; ++i)
+        ret += usage.entries[i].amount;
+    clang_disposeCXTUResourceUsage(usage);
+    return ret;
+}
+
+std::string libclang_vim::get_absolute_path(const std::string& file) {
+    if (!file.empty() && file[0] == '/')
+        return file;
+
+    std::vector<char> buffer(4096);
+    if (!getcwd(buffer.data(), buffer.size()))
+        return file;
+    return std::string(buffer.data()) + "/" + file;
+}
+
+std::string libclang_vim::get_absolute_path(const std::string& file,
+                                            const std::string& directory) {
+    const bool relative =
+        !directory.empty() && (file.empty() || file[0] != '/');
+    const std::string path =
+        get_absolute_path(relative ? directory + "/" + file : file);
+    if (path.empty() || path[0] != '/')
+        return path;
+
+    // Drop the "." and ".." components of e.g. "-I../include", so the names
+    // match the ones of Vim buffers.
+    std::vector<std::string> components;
+    size_t begin = 0;
+    while (begin < path.size()) {
+        size_t end = path.find('/', begin);
+        if (end == std::string::npos)
+            end = path.size();
+        const std::string component = path.substr(begin, end - begin);
+        if (component == "..") {
+            if (!components.empty())
+                components.pop_back();
+        } else if (!component.empty() && component != ".")
+            components.push_back(component);
+        begin = end + 1;
+    }
+
+    std::string ret;
+    for (const auto& component : components)
+        ret += "/" + component;
+    return ret.empty() ? "/" : ret;
+}
+
+int libclang_vim::get_fuzzy_score(const std::string& pattern,
+                                  const std::string& candidate) {
+    if (pattern.empty())
+        return 0;
+
+    int score = 0;
+    size_t matched = 0;
+    size_t previous = std::string::npos;
+    // The <cctype> functions take unsigned char values, the bytes of UTF-8
+    // sequences are negative as plain char.
+    auto const at = [](const std::string& s, size_t i) {
+        return static_cast<unsigned char>(s[i]);
+    };
+    for (size_t i = 0; i < candidate.size() && matched < pattern.size(); ++i) {
+        const unsigned char c = at(candidate, i);
+        const unsigned char p = at(pattern, matched);
+        if (std::tolower(c) != std::tolower(p))
+            continue;
+
+        score += 1;
+        if (c == p)
+            score += 1;
+        // Start of a word: "foo", "_foo", "fooBar".
+        if (i == 0 || candidate[i - 1] == '_' ||
+            (std::islower(at(candidate, i - 1)) && std::isupper(c)))
+            score += 3;
+        if (previous != std::string::npos && previous + 1 == i)
+            score += 2;
+        previous = i;
+        ++matched;
+    }
+    if (matched < pattern.size())
+        return -1;
+
+    if (candidate.compare(0, pattern.size(), pattern) == 0)
+        score += 10;
+    // Prefer shorter candidates among otherwise equal matches.
+    score -= static_cast<int>((candidate.size() - pattern.size()) / 4);
+    return std::max(score, 0);
+}
+
 libclang_vim::location_tuple
 libclang_vim::parse_default_args(const std::string& args_string) {
     location_tuple info;
@@ -238,18 +473,11 @@ std::vector<const char*> libclang_vim::get_args_ptrs(const args_type& args) {
 const char* libclang_vim::at_specific_location(
     const location_tuple& location_tuple,
     const std::function<std::string(CXCursor const&)>& predicate) {
-    static std::string vimson;
+    thread_local std::string vimson;
     char const* file_name = location_tuple.file.c_str();
-    auto const args_ptrs = get_args_ptrs(location_tuple.args);
-
-    cxindex_ptr index =
-        clang_createIndex(/*excludeDeclsFromPCH*/ 1, /*displayDiagnostics*/ 0);
-    std::vector<CXUnsavedFile> unsaved_files =
-        create_unsaved_files(location_tuple);
-    cxtranslation_unit_ptr translation_unit(clang_parseTranslationUnit(
-        index, file_name, args_ptrs.data(), args_ptrs.size(),
-        unsaved_files.data(), unsaved_files.size(),
-        CXTranslationUnit_Incomplete));
+
+    auto const translation_unit =
+        get_translation_unit_cache().get_current(location_tuple);
     if (!translation_unit)
         return "{}";
 
@@ -258,6 +486,10 @@ const char* libclang_vim::at_specific_location(
         translation_unit, file, location_tuple.line, location_tuple.col);
     CXCursor const cursor = clang_getCursor(translation_unit, location);
 
+    // The parse can't be interrupted, but the query can be skipped.
+    if (is_cancelled())
+        return "{}";
+
     vimson = predicate(cursor);
 
     return vimson.c_str();
@@ -276,4 +508,26 @@ CXCursor libclang_vim::search_kind(
     return kind_visitor_data.first;
 }
 
+libclang_vim::cancellation_token::cancellation_token() : _cancelled(false) {}
+
+void libclang_vim::cancellation_token::cancel() { _cancelled = true; }
+
+bool libclang_vim::cancellation_token::is_cancelled() const {
+    return _cancelled;
+}
+
+libclang_vim::cancellation_scope::cancellation_scope(
+    const cancellation_token& token)
+    : _previous(current_token) {
+    current_token = &token;
+}
+
+libclang_vim::cancellation_scope::~cancellation_scope() {
+    current_token = _previous;
+}
+
+bool libclang_vim::is_cancelled() {
+    return current_token && current_token->is_cancelled();
+}
+
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
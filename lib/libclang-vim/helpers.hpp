@@ -1,12 +1,15 @@
 #if !defined LIBCLANG_VIM_HELPERS_HPP_INCLUDED
 #define LIBCLANG_VIM_HELPERS_HPP_INCLUDED
 
+#include <atomic>
+#include <cctype>
 #include <cstring>
 #include <cstddef>
 #include <string>
 #include <memory>
 #include <fstream>
 #include <algorithm>
+#include <functional>
 #include <vector>
 #include <sstream>
 #include <iterator>
@@ -68,6 +71,16 @@ std::string stringize_key_value(const char* key_name, const cxstring_ptr& p);
 
 std::string stringize_key_value(const char* key_name, const std::string& s);
 
+/// Escapes s, so it can be used inside a single-quoted Vim string.
+std::string escape_single_quotes(const std::string& s);
+
+/// Escapes s, so it can be used inside a JSON string.
+std::string escape_json(const std::string& s);
+
+/// Converts the result of a query, a Vim expression of lists, dictionaries,
+/// numbers and literal strings, to JSON.
+std::string vimson_to_json(const std::string& vimson);
+
 bool is_class_decl_kind(const CXCursorKind& kind);
 
 bool is_class_decl(const CXCursor& cursor);
@@ -80,6 +93,35 @@ bool is_parameter_kind(const CXCursorKind& kind);
 
 bool is_parameter(const CXCursor& cursor);
 
+/// for, range-based for, while and do statements.
+bool is_loop_kind(const CXCursorKind& kind);
+
+/// Spelling of cursor with its semantic parents, e.g. "ns::cls::method".
+std::string get_qualified_name(const CXCursor& cursor);
+
+/// FNV-1a hash of a buffer, used to detect content changes.
+unsigned long long get_content_hash(const char* data, size_t size);
+
+/// Hash of the contents of file on disk, returns false if it can't be read.
+bool get_file_content_hash(const std::string& file, unsigned long long& hash);
+
+/// Sum of the memory usage entries of clang_getCXTUResourceUsage(), in
+/// bytes.
+unsigned long get_memory_usage(CXTranslationUnit translation_unit);
+
+/// Prefixes a relative file name with the working directory.
+std::string get_absolute_path(const std::string& file);
+
+/// Prefixes a relative file name with directory, e.g. the one of a compile
+/// command, or with the working directory if directory is empty, and drops
+/// the "." and ".." components of the result.
+std::string get_absolute_path(const std::string& file,
+                              const std::string& directory);
+
+/// Scores candidate as a case-insensitive fuzzy (subsequence) match of
+/// pattern, higher is better. Returns -1 if candidate doesn't match.
+int get_fuzzy_score(const std::string& pattern, const std::string& candidate);
+
 using args_type = std::vector<std::string>;
 
 /// Stores compiler arguments with location.
@@ -117,6 +159,39 @@ const char* at_specific_location(
 CXCursor search_kind(const CXCursor& cursor,
                      const std::function<bool(const CXCursorKind&)>& predicate);
 
+/// Set by another thread when the result of a query is no longer needed,
+/// e.g. because a newer query for the same buffer arrived.
+class cancellation_token {
+    std::atomic<bool> _cancelled;
+
+  public:
+    cancellation_token();
+
+    void cancel();
+
+    bool is_cancelled() const;
+};
+
+/// Makes token the one that is_cancelled() checks on the current thread,
+/// while the scope lives.
+class cancellation_scope {
+    const cancellation_token* _previous;
+
+  public:
+    cancellation_scope(const cancellation_token& token);
+
+    cancellation_scope(const cancellation_scope&) = delete;
+
+    cancellation_scope& operator=(const cancellation_scope&) = delete;
+
+    ~cancellation_scope();
+};
+
+/// Returns true if the query running on the current thread was cancelled,
+/// so AST traversals can stop early. Always false outside of a
+/// cancellation_scope, e.g. for libcall().
+bool is_cancelled();
+
 } // namespace libclang_vim
 
 #endif // LIBCLANG_VIM_HELPERS_HPP_INCLUDED
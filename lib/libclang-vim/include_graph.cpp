@@ -0,0 +1,219 @@
+#include "include_graph.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+
+#include "indexer.hpp"
+
+namespace {
+
+struct inclusion_visitor_data {
+    const std::string& main_file;
+    std::map<std::string, std::vector<libclang_vim::include_directive>>&
+        includes;
+};
+
+void visit_inclusion(CXFile included_file, CXSourceLocation* inclusion_stack,
+                     unsigned include_len, CXClientData client_data) {
+    // The main file has an empty stack, the first entry is the directive.
+    if (!include_len)
+        return;
+
+    auto data = static_cast<inclusion_visitor_data*>(client_data);
+    CXFile includer_file;
+    libclang_vim::include_directive directive;
+    clang_getFileLocation(inclusion_stack[0], &includer_file, &directive.line,
+                          &directive.col, nullptr);
+    libclang_vim::cxstring_ptr included_name = clang_getFileName(included_file);
+    const char* included = clang_getCString(included_name);
+    if (!includer_file || !included || !*included)
+        return;
+    directive.file = included;
+
+    // Use the absolute name of the buffer for the main file, so lookups by
+    // any spelling of the file name of the buffer work.
+    std::string includer = data->main_file;
+    if (include_len > 1) {
+        libclang_vim::cxstring_ptr name = clang_getFileName(includer_file);
+        const char* includer_name = clang_getCString(name);
+        if (!includer_name || !*includer_name)
+            return;
+        includer = includer_name;
+    }
+    data->includes[includer].push_back(directive);
+}
+
+/// Include graphs of recently queried buffers.
+class include_graph_cache {
+    struct entry {
+        libclang_vim::args_type args;
+        unsigned long long content_hash;
+        std::shared_ptr<const libclang_vim::include_graph> graph;
+        unsigned long last_use;
+    };
+
+    std::mutex _mutex;
+    std::map<std::string, entry> _entries;
+    unsigned long _use_counter;
+    /// Keys that are being parsed outside of _mutex.
+    std::set<std::string> _parsing;
+    /// Notified when a key leaves _parsing.
+    std::condition_variable _parsed;
+
+  public:
+    static const size_t max_entries = 16;
+
+    include_graph_cache() : _use_counter(0) {}
+
+    std::shared_ptr<const libclang_vim::include_graph>
+    get(const libclang_vim::location_tuple& location_info);
+};
+
+std::shared_ptr<const libclang_vim::include_graph> include_graph_cache::get(
+    const libclang_vim::location_tuple& location_info) {
+    unsigned long long content_hash;
+    if (!location_info.unsaved_file.empty())
+        content_hash = libclang_vim::get_content_hash(
+            location_info.unsaved_file.data(),
+            location_info.unsaved_file.size());
+    else if (!libclang_vim::get_file_content_hash(location_info.file,
+                                                  content_hash))
+        return nullptr;
+
+    const std::string key = libclang_vim::get_absolute_path(location_info.file);
+    {
+        // Concurrent misses of a buffer wait for one parse, which likely saw
+        // the same contents.
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (_parsing.count(key))
+            _parsed.wait(lock);
+
+        auto const it = _entries.find(key);
+        if (it != _entries.end() && it->second.args == location_info.args &&
+            it->second.content_hash == content_hash) {
+            it->second.last_use = ++_use_counter;
+            return it->second.graph;
+        }
+        _parsing.insert(key);
+    }
+
+    // Parse outside of the cache lock, so other buffers can be queried
+    // meanwhile. Only the inclusions are needed: skip the bodies and don't
+    // record the preprocessing details.
+    libclang_vim::cxindex_ptr index =
+        clang_createIndex(/*excludeDeclarationsFromPCH=*/1,
+                          /*displayDiagnostics=*/0);
+    std::vector<const char*> args_ptrs =
+        libclang_vim::get_args_ptrs(location_info.args);
+    std::vector<CXUnsavedFile> unsaved_files =
+        libclang_vim::create_unsaved_files(location_info);
+    libclang_vim::cxtranslation_unit_ptr translation_unit(
+        clang_parseTranslationUnit(
+            index, location_info.file.c_str(), args_ptrs.data(),
+            args_ptrs.size(), unsaved_files.data(), unsaved_files.size(),
+            CXTranslationUnit_Incomplete |
+                CXTranslationUnit_SkipFunctionBodies));
+    std::shared_ptr<const libclang_vim::include_graph> graph;
+    if (translation_unit)
+        graph = std::make_shared<libclang_vim::include_graph>(
+            translation_unit, location_info.file);
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _parsing.erase(key);
+        if (graph) {
+            if (!_entries.count(key) && _entries.size() >= max_entries) {
+                auto oldest = _entries.begin();
+                for (auto entry = _entries.begin(); entry != _entries.end();
+                     ++entry) {
+                    if (entry->second.last_use < oldest->second.last_use)
+                        oldest = entry;
+                }
+                _entries.erase(oldest);
+            }
+
+            entry& cached = _entries[key];
+            cached.args = location_info.args;
+            cached.content_hash = content_hash;
+            cached.graph = graph;
+            cached.last_use = ++_use_counter;
+        }
+    }
+    _parsed.notify_all();
+    return graph;
+}
+
+include_graph_cache& get_include_graph_cache() {
+    static include_graph_cache cache;
+    return cache;
+}
+}
+
+libclang_vim::include_graph::include_graph(CXTranslationUnit translation_unit,
+                                           const std::string& main_file) {
+    const std::string main_path = get_absolute_path(main_file);
+    inclusion_visitor_data data = {main_path, _includes};
+    clang_getInclusions(translation_unit, visit_inclusion, &data);
+    for (auto& includes : _includes) {
+        std::sort(includes.second.begin(), includes.second.end(),
+                  [](const include_directive& a, const include_directive& b) {
+                      return a.line < b.line;
+                  });
+    }
+}
+
+const std::map<std::string, std::vector<libclang_vim::include_directive>>&
+libclang_vim::include_graph::get_includes() const {
+    return _includes;
+}
+
+const libclang_vim::include_directive*
+libclang_vim::include_graph::find(const std::string& file,
+                                  unsigned line) const {
+    auto const includes = _includes.find(get_absolute_path(file));
+    if (includes == _includes.end())
+        return nullptr;
+
+    auto const directive = std::lower_bound(
+        includes->second.begin(), includes->second.end(), line,
+        [](const include_directive& a, unsigned b) { return a.line < b; });
+    if (directive == includes->second.end() || directive->line != line)
+        return nullptr;
+    return &*directive;
+}
+
+std::shared_ptr<const libclang_vim::include_graph>
+libclang_vim::get_include_graph(const location_tuple& location_info) {
+    return get_include_graph_cache().get(location_info);
+}
+
+const char* libclang_vim::get_include_at(const location_tuple& location_info) {
+    thread_local std::string vimson;
+
+    auto const graph = get_include_graph(location_info);
+    if (!graph)
+        return "{}";
+
+    const include_directive* directive =
+        graph->find(location_info.file, location_info.line);
+    if (!directive)
+        return "{}";
+
+    vimson = "{'file':'" + escape_single_quotes(directive->file) + "'}";
+    return vimson.c_str();
+}
+
+const char* libclang_vim::get_project_includers(const std::string& file) {
+    thread_local std::string vimson;
+
+    auto const index = get_index_of_file(file);
+    if (!index)
+        return "[]";
+
+    vimson = index->find_includers(file);
+    return vimson.c_str();
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
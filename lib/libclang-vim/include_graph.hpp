@@ -0,0 +1,55 @@
+#if !defined LIBCLANG_VIM_INCLUDE_GRAPH_HPP_INCLUDED
+#define LIBCLANG_VIM_INCLUDE_GRAPH_HPP_INCLUDED
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <clang-c/Index.h>
+
+#include "helpers.hpp"
+#include "symbol_index.hpp"
+
+namespace libclang_vim {
+
+/// Direct includes of each file of one translation unit, from
+/// clang_getInclusions(). The includer names are the ones of libclang, except
+/// for the main file, which is stored under its absolute path.
+class include_graph {
+    /// Sorted by line, by includer.
+    std::map<std::string, std::vector<include_directive>> _includes;
+
+  public:
+    /// main_file is the name the translation unit was parsed with, its
+    /// absolute path is the includer name of the directives in the main
+    /// file.
+    include_graph(CXTranslationUnit translation_unit,
+                  const std::string& main_file);
+
+    const std::map<std::string, std::vector<include_directive>>&
+    get_includes() const;
+
+    /// Returns the directive on line of file, or nullptr. file may be
+    /// relative to the working directory.
+    const include_directive* find(const std::string& file,
+                                  unsigned line) const;
+};
+
+/// Returns the include graph of location_info, parsing it only if the buffer
+/// or the arguments changed since the last call.
+std::shared_ptr<const include_graph>
+get_include_graph(const location_tuple& location_info);
+
+/// Returns the file included by the directive at location_info.
+const char* get_include_at(const location_tuple& location_info);
+
+/// Files of the project index that include file directly or transitively,
+/// closest first.
+const char* get_project_includers(const std::string& file);
+
+} // namespace libclang_vim
+
+#endif // LIBCLANG_VIM_INCLUDE_GRAPH_HPP_INCLUDED
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
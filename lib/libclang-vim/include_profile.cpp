@@ -0,0 +1,223 @@
+#include "include_profile.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+
+#include "include_graph.hpp"
+#include "project.hpp"
+
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+/// What parsing (a prefix of) the main file cost.
+struct parse_cost {
+    clock::duration time;
+    unsigned long memory;
+    /// Number of entered headers.
+    size_t headers;
+};
+
+void count_inclusion(CXFile, CXSourceLocation*, unsigned include_len,
+                     CXClientData data) {
+    if (include_len)
+        ++*static_cast<size_t*>(data);
+}
+
+/// Parses the first size bytes of contents as the main file.
+CXTranslationUnit
+parse_prefix(CXIndex index, const libclang_vim::location_tuple& location_info,
+             const std::vector<char>& contents, size_t size,
+             parse_cost& cost) {
+    CXUnsavedFile unsaved_file;
+    unsaved_file.Filename = location_info.file.c_str();
+    unsaved_file.Contents = contents.data();
+    unsaved_file.Length = size;
+    auto const args_ptrs = libclang_vim::get_args_ptrs(location_info.args);
+
+    const clock::time_point start = clock::now();
+    CXTranslationUnit translation_unit = clang_parseTranslationUnit(
+        index, location_info.file.c_str(), args_ptrs.data(), args_ptrs.size(),
+        &unsaved_file, 1, CXTranslationUnit_Incomplete);
+    cost.time = clock::now() - start;
+    if (!translation_unit)
+        return nullptr;
+
+    cost.memory = libclang_vim::get_memory_usage(translation_unit);
+    cost.headers = 0;
+    clang_getInclusions(translation_unit, count_inclusion, &cost.headers);
+    return translation_unit;
+}
+
+struct header_stats {
+    /// Shortest include depth, 1 for headers of the main file.
+    unsigned depth;
+    /// How many times the header was entered.
+    unsigned entries;
+    /// The header of the main file it was included from at that depth.
+    std::string via;
+};
+
+void collect_header_stats(CXFile included_file,
+                          CXSourceLocation* inclusion_stack,
+                          unsigned include_len, CXClientData data) {
+    if (!include_len)
+        return;
+
+    libclang_vim::cxstring_ptr name = clang_getFileName(included_file);
+    const char* file_name = clang_getCString(name);
+    if (!file_name || !*file_name)
+        return;
+
+    auto& headers = *static_cast<std::map<std::string, header_stats>*>(data);
+    auto const result =
+        headers.insert(std::make_pair(file_name, header_stats()));
+    header_stats& header = result.first->second;
+    ++header.entries;
+    if (!result.second && header.depth <= include_len)
+        return;
+
+    header.depth = include_len;
+    header.via = file_name;
+    if (include_len > 1) {
+        // The last entry is in the main file, the one before it is in the
+        // header that directive included.
+        CXFile via_file;
+        clang_getFileLocation(inclusion_stack[include_len - 2], &via_file,
+                              nullptr, nullptr, nullptr);
+        libclang_vim::cxstring_ptr via_name = clang_getFileName(via_file);
+        const char* via = clang_getCString(via_name);
+        header.via = via ? via : "";
+    }
+}
+
+std::string stringize_share(double part, double whole) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.3f",
+                  whole > 0 ? part / whole : 0.0);
+    return buffer;
+}
+
+struct include_cost {
+    libclang_vim::include_directive directive;
+    parse_cost cost;
+};
+}
+
+const char*
+libclang_vim::profile_includes(const location_tuple& location_info) {
+    thread_local std::string vimson;
+
+    std::vector<char> contents = location_info.unsaved_file;
+    if (contents.empty()) {
+        std::ifstream stream(location_info.file.c_str(),
+                             std::ios::in | std::ios::binary);
+        if (!stream.good())
+            return "{}";
+        contents.assign(std::istreambuf_iterator<char>(stream),
+                        std::istreambuf_iterator<char>());
+    }
+
+    cxindex_ptr index = clang_createIndex(/*excludeDeclarationsFromPCH=*/1,
+                                          /*displayDiagnostics=*/0);
+    parse_cost total;
+    cxtranslation_unit_ptr translation_unit(parse_prefix(
+        index, location_info, contents, contents.size(), total));
+    if (!translation_unit)
+        return "{}";
+
+    std::map<std::string, header_stats> headers;
+    clang_getInclusions(translation_unit, collect_header_stats, &headers);
+    const include_graph graph(translation_unit, location_info.file);
+    std::vector<include_directive> directives;
+    auto const includes =
+        graph.get_includes().find(get_absolute_path(location_info.file));
+    if (includes != graph.get_includes().end())
+        directives = includes->second;
+
+    // Offset after each line.
+    std::vector<size_t> line_ends;
+    for (size_t i = 0; i < contents.size(); ++i) {
+        if (contents[i] == '\n')
+            line_ends.push_back(i + 1);
+    }
+    line_ends.push_back(contents.size());
+
+    parse_cost previous;
+    {
+        cxtranslation_unit_ptr empty(
+            parse_prefix(index, location_info, contents, 0, previous));
+        if (!empty)
+            return "{}";
+    }
+    std::vector<include_cost> costs;
+    for (const auto& directive : directives) {
+        const size_t size = directive.line <= line_ends.size()
+                                ? line_ends[directive.line - 1]
+                                : contents.size();
+        parse_cost current;
+        cxtranslation_unit_ptr prefix(
+            parse_prefix(index, location_info, contents, size, current));
+        if (!prefix)
+            continue;
+
+        // Timing noise can make a cheap include look negative.
+        include_cost cost;
+        cost.directive = directive;
+        cost.cost.time = std::max(current.time - previous.time,
+                                  clock::duration::zero());
+        cost.cost.memory = current.memory > previous.memory
+                               ? current.memory - previous.memory
+                               : 0;
+        cost.cost.headers = current.headers > previous.headers
+                                ? current.headers - previous.headers
+                                : 0;
+        costs.push_back(cost);
+        previous = current;
+    }
+    std::stable_sort(costs.begin(), costs.end(),
+                     [](const include_cost& a, const include_cost& b) {
+                         return a.cost.time > b.cost.time;
+                     });
+
+    std::vector<std::pair<std::string, header_stats>> sorted_headers(
+        headers.begin(), headers.end());
+    std::stable_sort(sorted_headers.begin(), sorted_headers.end(),
+                     [](const std::pair<std::string, header_stats>& a,
+                        const std::pair<std::string, header_stats>& b) {
+                         return a.second.depth < b.second.depth;
+                     });
+
+    const double total_time = std::chrono::duration<double>(total.time).count();
+    std::stringstream ss;
+    ss << "{'file':'" << escape_single_quotes(location_info.file) << "',";
+    ss << "'parse_time':" << stringize_seconds(total.time) << ",";
+    ss << "'memory':" << total.memory << ",'includes':[";
+    for (const auto& cost : costs) {
+        ss << "{'file':'" << escape_single_quotes(cost.directive.file) << "',";
+        ss << "'line':" << cost.directive.line << ",";
+        ss << "'parse_time':" << stringize_seconds(cost.cost.time) << ",";
+        ss << "'time_share':"
+           << stringize_share(
+                  std::chrono::duration<double>(cost.cost.time).count(),
+                  total_time)
+           << ",";
+        ss << "'memory':" << cost.cost.memory << ",";
+        ss << "'memory_share':"
+           << stringize_share(cost.cost.memory, total.memory) << ",";
+        ss << "'headers':" << cost.cost.headers << "},";
+    }
+    ss << "],'headers':[";
+    for (const auto& header : sorted_headers) {
+        ss << "{'file':'" << escape_single_quotes(header.first) << "',";
+        ss << "'depth':" << header.second.depth << ",";
+        ss << "'entries':" << header.second.entries << ",";
+        ss << "'via':'" << escape_single_quotes(header.second.via) << "'},";
+    }
+    ss << "]}";
+    vimson = ss.str();
+    return vimson.c_str();
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,21 @@
+#if !defined LIBCLANG_VIM_INCLUDE_PROFILE_HPP_INCLUDED
+#define LIBCLANG_VIM_INCLUDE_PROFILE_HPP_INCLUDED
+
+#include "helpers.hpp"
+
+namespace libclang_vim {
+
+/// Estimates what the includes of location_info cost. The main file is
+/// parsed once, then once for each prefix that ends with an #include of the
+/// main file: the difference to the previous prefix is the parse time and
+/// the memory (from clang_getCXTUResourceUsage()) of that include, including
+/// the headers it pulls in first. Every included header is listed with its
+/// depth, how many times it was entered and the include of the main file it
+/// came from.
+const char* profile_includes(const location_tuple& location_info);
+
+} // namespace libclang_vim
+
+#endif // LIBCLANG_VIM_INCLUDE_PROFILE_HPP_INCLUDED
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
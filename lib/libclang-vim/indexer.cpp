@@ -0,0 +1,643 @@
+#include "indexer.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <set>
+
+#include <sys/stat.h>
+
+#include "compilation_database.hpp"
+#include "include_graph.hpp"
+#include "project.hpp"
+#include "thread_pool.hpp"
+#include "translation_unit_cache.hpp"
+#include "virtual_calls.hpp"
+
+namespace {
+
+/// Decides which translation unit records the occurrences of a file, shared
+/// by all workers.
+class file_owners {
+    std::mutex _mutex;
+    std::map<std::string, std::string> _owners;
+
+  public:
+    explicit file_owners(std::map<std::string, std::string> owners)
+        : _owners(std::move(owners)) {}
+
+    /// Returns true if file has no owner yet, or is owned by owner.
+    bool is_available(const std::string& file, const std::string& owner) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto const it = _owners.find(file);
+        return it == _owners.end() || it->second == owner;
+    }
+
+    /// Returns true if file is (now) owned by owner.
+    bool claim(const std::string& file, const std::string& owner) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto const result = _owners.insert(std::make_pair(file, owner));
+        return result.first->second == owner;
+    }
+};
+
+/// Client data of clang_indexSourceFile(): collects the occurrences of one
+/// translation unit.
+class translation_unit_indexer {
+    const std::string& _main_file;
+    /// Relative file names of libclang are relative to it.
+    const std::string& _directory;
+    file_owners& _owners;
+    /// nullptr for files owned by an other translation unit.
+    std::map<CXFile, libclang_vim::file_shard*> _files;
+
+    libclang_vim::file_shard* get_shard(CXFile file) {
+        auto const it = _files.find(file);
+        if (it != _files.end())
+            return it->second;
+
+        libclang_vim::cxstring_ptr name = clang_getFileName(file);
+        const char* file_name = clang_getCString(name);
+        libclang_vim::file_shard* shard = get_shard(
+            file_name && *file_name
+                ? libclang_vim::get_absolute_path(file_name, _directory)
+                : std::string());
+        _files[file] = shard;
+        return shard;
+    }
+
+  public:
+    std::map<std::string, libclang_vim::file_shard> shards;
+
+    /// Returns the shard of file_name, an absolute path, or nullptr if an
+    /// other translation unit owns it. The file is claimed only when the
+    /// translation unit is committed, see index_translation_units().
+    libclang_vim::file_shard* get_shard(const std::string& file_name) {
+        if (file_name.empty() || !_owners.is_available(file_name, _main_file))
+            return nullptr;
+
+        libclang_vim::file_shard* shard = &shards[file_name];
+        shard->owner = _main_file;
+        return shard;
+    }
+
+    translation_unit_indexer(const libclang_vim::compile_command& command,
+                             file_owners& owners)
+        : _main_file(command.file), _directory(command.directory),
+          _owners(owners) {}
+
+    /// Returns the shard of the occurrence, or nullptr if it's not recorded.
+    libclang_vim::file_shard* add(CXIdxLoc location, const char* usr,
+                                  libclang_vim::occurrence_role role) {
+        if (!usr || !*usr)
+            return nullptr;
+
+        CXFile file;
+        unsigned line;
+        unsigned col;
+        clang_indexLoc_getFileLocation(location, nullptr, &file, &line, &col,
+                                       nullptr);
+        if (!file)
+            return nullptr;
+
+        libclang_vim::file_shard* shard = get_shard(file);
+        if (!shard)
+            return nullptr;
+
+        libclang_vim::symbol_occurrence occurrence;
+        occurrence.usr = usr;
+        occurrence.line = line;
+        occurrence.col = col;
+        occurrence.role = role;
+        shard->occurrences.push_back(occurrence);
+        return shard;
+    }
+};
+
+void index_declaration(CXClientData client_data, const CXIdxDeclInfo* info) {
+    if (info->isImplicit || !info->entityInfo)
+        return;
+
+    auto indexer = static_cast<translation_unit_indexer*>(client_data);
+    const char* usr = info->entityInfo->USR;
+    libclang_vim::file_shard* shard =
+        indexer->add(info->loc, usr,
+                     info->isDefinition
+                         ? libclang_vim::occurrence_role::definition
+                         : libclang_vim::occurrence_role::declaration);
+    if (!shard)
+        return;
+
+    // Once per method, at its first declaration, so the overriders of a
+    // method are known without parsing the translation units that declare
+    // them.
+    if (info->entityInfo->kind == CXIdxEntity_CXXInstanceMethod &&
+        clang_CXXMethod_isVirtual(info->cursor) &&
+        clang_equalCursors(info->cursor,
+                           clang_getCanonicalCursor(info->cursor))) {
+        for (const CXCursor& method :
+             libclang_vim::get_overridden_methods(info->cursor)) {
+            libclang_vim::cxstring_ptr overridden = clang_getCursorUSR(method);
+            indexer->add(info->loc, libclang_vim::to_c_str(overridden),
+                         libclang_vim::occurrence_role::override);
+        }
+    }
+
+    if (shard->symbols.count(usr))
+        return;
+
+    // Only once per file, walking the semantic parents is not free.
+    libclang_vim::symbol_info& symbol = shard->symbols[usr];
+    symbol.name = libclang_vim::get_qualified_name(info->cursor);
+    symbol.kind = info->entityInfo->kind;
+}
+
+void index_entity_reference(CXClientData client_data,
+                            const CXIdxEntityRefInfo* info) {
+    if (info->kind != CXIdxEntityRef_Direct || !info->referencedEntity)
+        return;
+
+    auto indexer = static_cast<translation_unit_indexer*>(client_data);
+    indexer->add(info->loc, info->referencedEntity->USR,
+                 clang_Cursor_isDynamicCall(info->cursor)
+                     ? libclang_vim::occurrence_role::dynamic_call
+                     : libclang_vim::occurrence_role::reference);
+}
+
+/// Identifies one version of the index file.
+class file_signature {
+  public:
+    ino_t inode;
+    time_t mtime;
+    off_t size;
+
+    bool operator==(const file_signature& other) const {
+        return inode == other.inode && mtime == other.mtime &&
+               size == other.size;
+    }
+};
+
+bool get_file_signature(const std::string& path, file_signature& signature) {
+    struct stat buffer;
+    if (stat(path.c_str(), &buffer) != 0)
+        return false;
+
+    signature.inode = buffer.st_ino;
+    signature.mtime = buffer.st_mtime;
+    signature.size = buffer.st_size;
+    return true;
+}
+
+/// Mapped project indexes, by the directory of their compile_commands.json.
+class project_index_cache {
+    struct entry {
+        file_signature signature;
+        std::shared_ptr<const libclang_vim::mapped_symbol_index> index;
+    };
+
+    std::mutex _mutex;
+    std::map<std::string, entry> _entries;
+
+  public:
+    std::shared_ptr<const libclang_vim::mapped_symbol_index>
+    get(const std::string& directory) {
+        const std::string path = libclang_vim::get_symbol_index_path(directory);
+        file_signature signature;
+        if (!get_file_signature(path, signature))
+            return nullptr;
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto const it = _entries.find(directory);
+        if (it != _entries.end() && it->second.signature == signature)
+            return it->second.index;
+
+        std::shared_ptr<libclang_vim::mapped_symbol_index> index(
+            new libclang_vim::mapped_symbol_index());
+        if (!index->open(path))
+            return nullptr;
+
+        entry& cached = _entries[directory];
+        cached.signature = signature;
+        cached.index = index;
+        return index;
+    }
+};
+
+project_index_cache& get_project_index_cache() {
+    static project_index_cache cache;
+    return cache;
+}
+
+/// Returns the USR of the entity referenced at location_info.
+std::string get_usr_at(const libclang_vim::location_tuple& location_info) {
+    auto const translation_unit =
+        libclang_vim::get_translation_unit_cache().get_current(location_info);
+    if (!translation_unit)
+        return std::string();
+
+    CXFile file = clang_getFile(translation_unit, location_info.file.c_str());
+    CXSourceLocation location = clang_getLocation(
+        translation_unit, file, location_info.line, location_info.col);
+    CXCursor cursor = clang_getCursor(translation_unit, location);
+    if (clang_Cursor_isNull(cursor) ||
+        clang_isInvalid(clang_getCursorKind(cursor)))
+        return std::string();
+
+    CXCursor referenced_cursor = clang_getCursorReferenced(cursor);
+    if (!clang_Cursor_isNull(referenced_cursor) &&
+        !clang_isInvalid(clang_getCursorKind(referenced_cursor)))
+        cursor = referenced_cursor;
+
+    libclang_vim::cxstring_ptr usr = clang_getCursorUSR(cursor);
+    const char* usr_string = libclang_vim::to_c_str(usr);
+    return usr_string ? usr_string : std::string();
+}
+
+/// Caches content hashes during one update, shared by all workers: headers
+/// are included by many translation units.
+class content_hashes {
+    std::mutex _mutex;
+    /// false as first if the file can't be read.
+    std::map<std::string, std::pair<bool, unsigned long long>> _hashes;
+
+  public:
+    bool get(const std::string& file, unsigned long long& hash) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto const it = _hashes.find(file);
+            if (it != _hashes.end()) {
+                hash = it->second.second;
+                return it->second.first;
+            }
+        }
+
+        const bool found = libclang_vim::get_file_content_hash(file, hash);
+        std::lock_guard<std::mutex> lock(_mutex);
+        _hashes[file] = std::make_pair(found, hash);
+        return found;
+    }
+};
+
+unsigned long long get_args_hash(const libclang_vim::args_type& args) {
+    std::string joined;
+    for (const auto& arg : args) {
+        joined += arg;
+        joined += '\0';
+    }
+    return libclang_vim::get_content_hash(joined.data(), joined.size());
+}
+
+/// Runs clang_indexSourceFile() on command, and records the includes of the
+/// owned files and the hashes of the included files. Returns false on
+/// failure.
+bool index_translation_unit(CXIndex index,
+                            const libclang_vim::compile_command& command,
+                            IndexerCallbacks& callbacks, content_hashes& hashes,
+                            translation_unit_indexer& indexer,
+                            libclang_vim::translation_unit_record& record) {
+    auto const args_ptrs = libclang_vim::get_args_ptrs(command.args);
+    CXIndexAction action = clang_IndexAction_create(index);
+    CXTranslationUnit translation_unit = nullptr;
+    int error = clang_indexSourceFile(
+        action, &indexer, &callbacks, sizeof(callbacks),
+        CXIndexOpt_SuppressWarnings, command.file.c_str(), args_ptrs.data(),
+        args_ptrs.size(), nullptr, 0, &translation_unit,
+        CXTranslationUnit_Incomplete);
+    clang_IndexAction_dispose(action);
+    if (!translation_unit)
+        return false;
+
+    const libclang_vim::include_graph graph(translation_unit, command.file);
+    clang_disposeTranslationUnit(translation_unit);
+
+    // libclang names the files found through e.g. "-Iinclude" relative to
+    // the compile directory.
+    std::set<std::string> files;
+    files.insert(command.file);
+    for (const auto& includes : graph.get_includes()) {
+        std::vector<libclang_vim::include_directive> directives =
+            includes.second;
+        for (auto& directive : directives) {
+            directive.file = libclang_vim::get_absolute_path(directive.file,
+                                                             command.directory);
+            files.insert(directive.file);
+        }
+        libclang_vim::file_shard* shard = indexer.get_shard(
+            libclang_vim::get_absolute_path(includes.first, command.directory));
+        if (shard)
+            shard->includes = std::move(directives);
+    }
+
+    record.args_hash = get_args_hash(command.args);
+    for (const auto& file : files) {
+        unsigned long long hash;
+        if (hashes.get(file, hash))
+            record.inclusions[file] = hash;
+    }
+    return !error;
+}
+
+/// Indexes the items of commands on jobs threads, into index. Returns the
+/// number of translation units that failed.
+size_t index_translation_units(
+    const std::vector<libclang_vim::compile_command>& commands,
+    const std::vector<size_t>& items, unsigned jobs,
+    libclang_vim::symbol_index& index) {
+    if (!jobs)
+        jobs = libclang_vim::get_default_jobs();
+
+    // A CXIndex is not meant to be used from multiple threads at the same
+    // time, so each worker gets its own.
+    std::vector<std::unique_ptr<libclang_vim::cxindex_ptr>> indexes;
+    for (unsigned i = 0; i < jobs; ++i)
+        indexes.emplace_back(new libclang_vim::cxindex_ptr(clang_createIndex(
+            /*excludeDeclsFromPCH*/ 0, /*displayDiagnostics*/ 0)));
+
+    IndexerCallbacks callbacks = {};
+    callbacks.indexDeclaration = index_declaration;
+    callbacks.indexEntityReference = index_entity_reference;
+
+    file_owners owners(index.get_file_owners());
+    content_hashes hashes;
+    std::mutex mutex;
+    size_t failed = 0;
+    libclang_vim::parallel_for(
+        items.size(), jobs, [&](size_t item, unsigned worker) {
+            const libclang_vim::compile_command& command =
+                commands[items[item]];
+            translation_unit_indexer indexer(command, owners);
+            libclang_vim::translation_unit_record record;
+            const bool indexed =
+                index_translation_unit(*indexes[worker], command, callbacks,
+                                       hashes, indexer, record);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!indexed) {
+                // Not recorded, so the next update tries again.
+                ++failed;
+                return;
+            }
+            index.set_translation_unit(command.file, std::move(record));
+            // A failed translation unit leaves its files to the others. A
+            // file may have been committed by an other one meanwhile, then
+            // its shard is a duplicate.
+            for (auto& shard : indexer.shards) {
+                if (owners.claim(shard.first, command.file))
+                    index.set_shard(shard.first, std::move(shard.second));
+            }
+        });
+    return failed;
+}
+
+/// Returns why the translation unit of command has to be indexed again, or
+/// an empty string if its index is up to date.
+std::string get_reindex_reason(const libclang_vim::symbol_index& index,
+                               const libclang_vim::compile_command& command,
+                               content_hashes& hashes) {
+    const auto& units = index.get_translation_units();
+    auto const unit = units.find(command.file);
+    if (unit == units.end())
+        return "new";
+
+    if (unit->second.args_hash != get_args_hash(command.args))
+        return "arguments changed";
+
+    for (const auto& inclusion : unit->second.inclusions) {
+        unsigned long long hash;
+        if (!hashes.get(inclusion.first, hash))
+            return inclusion.first + " removed";
+        if (hash != inclusion.second)
+            return inclusion.first + " changed";
+    }
+
+    return std::string();
+}
+
+/// Saves index, so it becomes the current index of the project. Returns the
+/// saved version.
+std::shared_ptr<const libclang_vim::mapped_symbol_index>
+publish_index(const std::string& database_directory,
+              const libclang_vim::symbol_index& index) {
+    if (!index.save(libclang_vim::get_symbol_index_path(database_directory)))
+        return nullptr;
+
+    return libclang_vim::get_project_index(database_directory);
+}
+}
+
+std::string libclang_vim::index_project(const std::string& directory,
+                                        unsigned jobs) {
+    using clock = std::chrono::steady_clock;
+    const clock::time_point start = clock::now();
+
+    const std::string database_directory =
+        find_compilation_database(directory);
+    if (database_directory.empty())
+        return "{}";
+
+    const std::vector<compile_command> commands =
+        get_all_compile_commands(database_directory);
+    std::vector<size_t> items(commands.size());
+    for (size_t i = 0; i < items.size(); ++i)
+        items[i] = i;
+
+    symbol_index index;
+    const size_t failed = index_translation_units(commands, items, jobs, index);
+    auto const published = publish_index(database_directory, index);
+    if (!published)
+        return "{}";
+
+    return "{'translation_units':" + std::to_string(commands.size()) +
+           ",'failed':" + std::to_string(failed) + ",'files':" +
+           std::to_string(published->get_file_count()) + ",'symbols':" +
+           std::to_string(published->get_symbol_count()) + ",'wall_time':" +
+           stringize_seconds(clock::now() - start) + "}";
+}
+
+std::string libclang_vim::update_project_index(const std::string& directory,
+                                               unsigned jobs) {
+    using clock = std::chrono::steady_clock;
+    const clock::time_point start = clock::now();
+
+    const std::string database_directory =
+        find_compilation_database(directory);
+    if (database_directory.empty())
+        return "{}";
+
+    const std::vector<compile_command> commands =
+        get_all_compile_commands(database_directory);
+
+    // Update a copy, readers keep using the current index meanwhile.
+    symbol_index index;
+    auto const current = get_project_index(database_directory);
+    if (current)
+        index.load(*current);
+
+    // Translation units that are no longer in the compilation database.
+    std::set<std::string> main_files;
+    for (const auto& command : commands)
+        main_files.insert(command.file);
+    std::vector<std::string> removed;
+    for (const auto& unit : index.get_translation_units()) {
+        if (!main_files.count(unit.first))
+            removed.push_back(unit.first);
+    }
+    std::set<std::string> orphans;
+    for (const auto& main_file : removed) {
+        for (const auto& file : index.remove_translation_unit(main_file))
+            orphans.insert(file);
+    }
+
+    content_hashes hashes;
+    std::vector<std::string> reasons(commands.size());
+    parallel_for(commands.size(), jobs, [&](size_t item, unsigned) {
+        reasons[item] = get_reindex_reason(index, commands[item], hashes);
+    });
+
+    std::vector<bool> done(commands.size());
+    std::vector<size_t> items;
+    for (size_t i = 0; i < commands.size(); ++i) {
+        if (!reasons[i].empty())
+            items.push_back(i);
+    }
+    size_t failed = 0;
+    while (true) {
+        // Drop the old occurrences, the translation units claim their files
+        // again while they are indexed.
+        for (size_t item : items) {
+            done[item] = true;
+            for (const auto& file :
+                 index.remove_translation_unit(commands[item].file))
+                orphans.insert(file);
+        }
+        failed += index_translation_units(commands, items, jobs, index);
+
+        // A file whose owner no longer includes it must be indexed by one of
+        // its other includers.
+        const std::map<std::string, std::string> owners =
+            index.get_file_owners();
+        for (auto it = orphans.begin(); it != orphans.end();) {
+            if (owners.count(*it))
+                it = orphans.erase(it);
+            else
+                ++it;
+        }
+        items.clear();
+        const auto& units = index.get_translation_units();
+        for (size_t i = 0; i < commands.size() && !orphans.empty(); ++i) {
+            auto const unit = units.find(commands[i].file);
+            if (done[i] || unit == units.end())
+                continue;
+            for (const auto& orphan : orphans) {
+                if (unit->second.inclusions.count(orphan)) {
+                    reasons[i] = orphan + " lost its owner";
+                    items.push_back(i);
+                    break;
+                }
+            }
+        }
+        if (items.empty())
+            break;
+    }
+
+    if (!publish_index(database_directory, index))
+        return "{}";
+
+    std::stringstream ss;
+    ss << "{'translation_units':" << commands.size() << ",'failed':" << failed
+       << ",'reindexed':[";
+    for (size_t i = 0; i < commands.size(); ++i) {
+        if (!done[i])
+            continue;
+        ss << "{'file':'" << escape_single_quotes(commands[i].file) << "',";
+        ss << "'reason':'" << escape_single_quotes(reasons[i]) << "'},";
+    }
+    ss << "],'removed':[";
+    for (const auto& main_file : removed)
+        ss << "'" << escape_single_quotes(main_file) << "',";
+    ss << "],'wall_time':" << stringize_seconds(clock::now() - start) << "}";
+    return ss.str();
+}
+
+std::shared_ptr<const libclang_vim::mapped_symbol_index>
+libclang_vim::get_project_index(const std::string& directory) {
+    return get_project_index_cache().get(directory);
+}
+
+std::shared_ptr<const libclang_vim::mapped_symbol_index>
+libclang_vim::get_index_of_file(const std::string& file) {
+    std::size_t found = file.find_last_of("/\\");
+    std::string directory = find_compilation_database(
+        found == std::string::npos ? std::string(".") : file.substr(0, found));
+    if (directory.empty())
+        return nullptr;
+
+    return get_project_index(directory);
+}
+
+const char*
+libclang_vim::get_project_definition_at(const location_tuple& location_info) {
+    thread_local std::string vimson;
+
+    auto const index = get_index_of_file(location_info.file);
+    const std::string usr = get_usr_at(location_info);
+    if (!index || usr.empty())
+        return "[]";
+
+    occurrence_role role = occurrence_role::definition;
+    if (!index->has_occurrences(usr, role))
+        role = occurrence_role::declaration;
+    vimson = index->find_occurrences(usr, {role});
+    return vimson.c_str();
+}
+
+const char*
+libclang_vim::get_project_references_at(const location_tuple& location_info) {
+    thread_local std::string vimson;
+
+    auto const index = get_index_of_file(location_info.file);
+    const std::string usr = get_usr_at(location_info);
+    if (!index || usr.empty())
+        return "[]";
+
+    vimson = index->find_occurrences(
+        usr, {occurrence_role::declaration, occurrence_role::definition,
+              occurrence_role::reference, occurrence_role::dynamic_call});
+    return vimson.c_str();
+}
+
+libclang_vim::symbol_query::symbol_query() : limit(0) {}
+
+libclang_vim::symbol_query
+libclang_vim::parse_symbol_query(const std::string& args_string) {
+    symbol_query query;
+    const auto directory_colon = args_string.find(':');
+    const auto limit_colon = args_string.rfind(':');
+    if (directory_colon == std::string::npos || directory_colon == limit_colon)
+        return query;
+
+    query.directory = args_string.substr(0, directory_colon);
+    query.query = args_string.substr(directory_colon + 1,
+                                     limit_colon - directory_colon - 1);
+    std::sscanf(args_string.c_str() + limit_colon + 1, "%zu", &query.limit);
+    return query;
+}
+
+const char* libclang_vim::search_project_symbols(const symbol_query& query) {
+    thread_local std::string vimson;
+
+    const std::string database_directory =
+        find_compilation_database(query.directory);
+    if (database_directory.empty() || query.query.empty())
+        return "[]";
+
+    auto const index = get_project_index(database_directory);
+    if (!index)
+        return "[]";
+
+    vimson = index->search_symbols(query.query, query.limit);
+    return vimson.c_str();
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
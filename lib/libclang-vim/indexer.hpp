@@ -0,0 +1,62 @@
+#if !defined LIBCLANG_VIM_INDEXER_HPP_INCLUDED
+#define LIBCLANG_VIM_INDEXER_HPP_INCLUDED
+
+#include <memory>
+#include <string>
+
+#include "helpers.hpp"
+#include "symbol_index.hpp"
+
+namespace libclang_vim {
+
+/// Indexes every entry of the compilation database found from directory with
+/// clang_indexSourceFile() on jobs threads (0 means one per core), and saves
+/// the result next to compile_commands.json. Returns the number of
+/// translation units, failed ones, indexed files, symbols and the wall time.
+std::string index_project(const std::string& directory, unsigned jobs);
+
+/// Same as index_project(), but only indexes the translation units again
+/// that are new, or whose arguments, main file or included files changed
+/// since the last indexing. Returns which translation units were indexed
+/// again and why.
+std::string update_project_index(const std::string& directory, unsigned jobs);
+
+/// Returns the saved index of the project that has its compile_commands.json
+/// in directory, mapping it on first use and when it changes on disk.
+std::shared_ptr<const mapped_symbol_index>
+get_project_index(const std::string& directory);
+
+/// Returns the saved index of the project file belongs to.
+std::shared_ptr<const mapped_symbol_index>
+get_index_of_file(const std::string& file);
+
+/// Definitions of the symbol at location_info in the whole project, or its
+/// declarations if the index knows no definition.
+const char* get_project_definition_at(const location_tuple& location_info);
+
+/// All occurrences of the symbol at location_info in the whole project.
+const char* get_project_references_at(const location_tuple& location_info);
+
+/// Stores a workspace symbol search request.
+class symbol_query {
+  public:
+    /// Any directory of the project.
+    std::string directory;
+    std::string query;
+    /// Maximum number of returned symbols, 0 means no limit.
+    size_t limit;
+
+    symbol_query();
+};
+
+/// Parse "directory:query:limit", the query may contain colons.
+symbol_query parse_symbol_query(const std::string& args_string);
+
+/// Searches the project index for symbols with a name like query.
+const char* search_project_symbols(const symbol_query& query);
+
+} // namespace libclang_vim
+
+#endif // LIBCLANG_VIM_INDEXER_HPP_INCLUDED
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,202 @@
+#include "layout.hpp"
+
+namespace {
+
+CXVisitorResult collect_field(CXCursor cursor, CXClientData data) {
+    auto& fields = *static_cast<std::vector<libclang_vim::field_layout>*>(data);
+    libclang_vim::field_layout field;
+    field.offset_bits = clang_Cursor_getOffsetOfField(cursor);
+    if (field.offset_bits < 0)
+        return CXVisit_Continue;
+
+    const CXType type = clang_getCursorType(cursor);
+    libclang_vim::cxstring_ptr name = clang_getCursorSpelling(cursor);
+    libclang_vim::cxstring_ptr type_name = clang_getTypeSpelling(type);
+    field.name = clang_getCString(name);
+    field.type = clang_getCString(type_name);
+    field.bit_field = clang_Cursor_isBitField(cursor);
+    // Flexible array members have no size.
+    field.size_bits = field.bit_field ? clang_getFieldDeclBitWidth(cursor)
+                                      : clang_Type_getSizeOf(type) * 8;
+    if (field.size_bits < 0)
+        field.size_bits = 0;
+    field.align = clang_Type_getAlignOf(type);
+    fields.push_back(field);
+    return CXVisit_Continue;
+}
+
+CXChildVisitResult find_base_or_virtual(CXCursor cursor, CXCursor,
+                                        CXClientData data) {
+    const CXCursorKind kind = clang_getCursorKind(cursor);
+    if (kind == CXCursor_CXXBaseSpecifier ||
+        ((kind == CXCursor_CXXMethod || kind == CXCursor_Destructor) &&
+         clang_CXXMethod_isVirtual(cursor))) {
+        *static_cast<bool*>(data) = true;
+        return CXChildVisit_Break;
+    }
+    return CXChildVisit_Continue;
+}
+
+/// Strips pointers and references.
+CXType get_pointee_record(CXType type) {
+    type = clang_getCanonicalType(type);
+    while (type.kind == CXType_Pointer || type.kind == CXType_LValueReference ||
+           type.kind == CXType_RValueReference)
+        type = clang_getCanonicalType(clang_getPointeeType(type));
+    return type;
+}
+}
+
+long long libclang_vim::field_layout::get_offset() const {
+    return offset_bits / 8;
+}
+
+long long libclang_vim::field_layout::get_end() const {
+    return (offset_bits + size_bits + 7) / 8;
+}
+
+bool libclang_vim::field_layout::straddles_cache_line() const {
+    const long long end = get_end();
+    return end > get_offset() &&
+           get_offset() / cache_line_size != (end - 1) / cache_line_size;
+}
+
+long long libclang_vim::record_layout::get_padding() const {
+    long long ret = 0;
+    for (const auto& hole : holes)
+        ret += hole.size;
+    return ret;
+}
+
+bool libclang_vim::record_layout::has_straddling_field() const {
+    return std::any_of(
+        fields.begin(), fields.end(),
+        [](const field_layout& field) { return field.straddles_cache_line(); });
+}
+
+bool libclang_vim::get_record_layout(CXType type, record_layout& layout) {
+    type = clang_getCanonicalType(type);
+    if (type.kind != CXType_Record)
+        return false;
+
+    // Negative values are CXTypeLayoutError, e.g. for templates.
+    layout.size = clang_Type_getSizeOf(type);
+    layout.align = clang_Type_getAlignOf(type);
+    if (layout.size < 0 || layout.align < 0)
+        return false;
+
+    cxstring_ptr name = clang_getTypeSpelling(type);
+    layout.name = clang_getCString(name);
+    layout.fields.clear();
+    layout.holes.clear();
+    clang_Type_visitFields(type, collect_field, &layout.fields);
+    std::stable_sort(layout.fields.begin(), layout.fields.end(),
+                     [](const field_layout& a, const field_layout& b) {
+                         return a.offset_bits < b.offset_bits;
+                     });
+
+    bool has_base_or_virtual = false;
+    clang_visitChildren(clang_getTypeDeclaration(type), find_base_or_virtual,
+                        &has_base_or_virtual);
+    layout.base_size = 0;
+    if (has_base_or_virtual)
+        layout.base_size = layout.fields.empty()
+                               ? layout.size
+                               : layout.fields.front().get_offset();
+    // The single byte of an empty class is not padding.
+    if (layout.fields.empty())
+        return true;
+
+    long long end = layout.base_size;
+    std::string previous;
+    for (const auto& field : layout.fields) {
+        if (field.get_offset() > end) {
+            layout_hole hole;
+            hole.offset = end;
+            hole.size = field.get_offset() - end;
+            hole.after = previous;
+            layout.holes.push_back(hole);
+        }
+        end = std::max(end, field.get_end());
+        previous = field.name;
+    }
+    if (layout.size > end) {
+        layout_hole hole;
+        hole.offset = end;
+        hole.size = layout.size - end;
+        hole.after = previous;
+        layout.holes.push_back(hole);
+    }
+    return true;
+}
+
+std::string
+libclang_vim::stringize_record_layout(const record_layout& layout) {
+    std::stringstream ss;
+    ss << "{'name':'" << escape_single_quotes(layout.name) << "',";
+    ss << "'size':" << layout.size << ",'align':" << layout.align << ",";
+    ss << "'base_size':" << layout.base_size << ",";
+    ss << "'padding':" << layout.get_padding() << ",";
+    ss << "'cache_lines':"
+       << (layout.size + cache_line_size - 1) / cache_line_size << ",";
+    ss << "'fields':[";
+    for (const auto& field : layout.fields) {
+        ss << "{'name':'" << escape_single_quotes(field.name) << "',";
+        ss << "'type':'" << escape_single_quotes(field.type) << "',";
+        ss << "'offset':" << field.get_offset() << ",";
+        ss << "'size':" << field.get_end() - field.get_offset() << ",";
+        ss << "'align':" << field.align << ",";
+        if (field.bit_field) {
+            ss << "'bit_offset':" << field.offset_bits << ",";
+            ss << "'bit_width':" << field.size_bits << ",";
+        }
+        ss << "'straddles_cache_line':" << field.straddles_cache_line()
+           << "},";
+    }
+    ss << "],'holes':[";
+    for (const auto& hole : layout.holes) {
+        ss << "{'offset':" << hole.offset << ",'size':" << hole.size << ",";
+        ss << "'after':'" << escape_single_quotes(hole.after) << "'},";
+    }
+    ss << "]}";
+    return ss.str();
+}
+
+CXType libclang_vim::get_record_type_at(const CXCursor& cursor) {
+    CXCursor declaration = cursor;
+    if (clang_getCursorKind(cursor) == CXCursor_TypeRef)
+        declaration = clang_getCursorReferenced(cursor);
+    if (is_class_decl(declaration)) {
+        CXCursor definition = clang_getCursorDefinition(declaration);
+        if (!clang_Cursor_isNull(definition))
+            declaration = definition;
+        return clang_getCursorType(declaration);
+    }
+
+    CXType type = get_pointee_record(clang_getCursorType(cursor));
+    if (type.kind == CXType_Record)
+        return type;
+
+    for (CXCursor parent = clang_getCursorSemanticParent(cursor);
+         !clang_Cursor_isNull(parent) &&
+         !clang_isInvalid(clang_getCursorKind(parent));
+         parent = clang_getCursorSemanticParent(parent)) {
+        if (is_class_decl(parent))
+            return clang_getCursorType(parent);
+    }
+
+    type.kind = CXType_Invalid;
+    return type;
+}
+
+const char* libclang_vim::get_layout_at(const location_tuple& location_info) {
+    return at_specific_location(
+        location_info, [](CXCursor const& cursor) -> std::string {
+            record_layout layout;
+            if (!get_record_layout(get_record_type_at(cursor), layout))
+                return "{}";
+            return stringize_record_layout(layout);
+        });
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
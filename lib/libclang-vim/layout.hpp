@@ -0,0 +1,82 @@
+#if !defined LIBCLANG_VIM_LAYOUT_HPP_INCLUDED
+#define LIBCLANG_VIM_LAYOUT_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+
+#include <clang-c/Index.h>
+
+#include "helpers.hpp"
+
+namespace libclang_vim {
+
+const long long cache_line_size = 64;
+
+/// Position of one field inside its record.
+class field_layout {
+  public:
+    std::string name;
+    std::string type;
+    long long offset_bits;
+    long long size_bits;
+    long long align;
+    bool bit_field;
+
+    /// Offset of the first byte of the field.
+    long long get_offset() const;
+
+    /// Offset after the last byte of the field.
+    long long get_end() const;
+
+    /// True if the first and the last byte are in different cache lines.
+    bool straddles_cache_line() const;
+};
+
+/// Unused bytes between fields, or after the last one.
+class layout_hole {
+  public:
+    long long offset;
+    long long size;
+    /// Name of the field before the hole.
+    std::string after;
+};
+
+/// Memory layout of a record type, from clang_Type_getOffsetOf() and
+/// friends.
+class record_layout {
+  public:
+    std::string name;
+    long long size;
+    long long align;
+    /// Bytes before the first field of a class with base classes or a
+    /// vtable pointer: they are not counted as padding.
+    long long base_size;
+    /// Sorted by offset.
+    std::vector<field_layout> fields;
+    std::vector<layout_hole> holes;
+
+    long long get_padding() const;
+
+    bool has_straddling_field() const;
+};
+
+/// Computes the layout of type. Returns false if it's not a complete,
+/// non-dependent record type.
+bool get_record_layout(CXType type, record_layout& layout);
+
+std::string stringize_record_layout(const record_layout& layout);
+
+/// Returns the record type at cursor: the declared record, the record type
+/// of the declaration or expression (through pointers and references), or
+/// the enclosing record. Its kind is CXType_Invalid if there is none.
+CXType get_record_type_at(const CXCursor& cursor);
+
+/// Field offsets, sizes and alignments, padding holes, total size and cache
+/// line straddling fields of the record at location_info.
+const char* get_layout_at(const location_tuple& location_info);
+
+} // namespace libclang_vim
+
+#endif // LIBCLANG_VIM_LAYOUT_HPP_INCLUDED
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -1,5 +1,7 @@
 #include "location.hpp"
 
+#include "translation_unit_cache.hpp"
+
 namespace {
 
 CXCursor search_AST_upward(CXCursor cursor,
@@ -58,29 +60,8 @@ const char* libclang_vim::get_type_related_to(
         });
 }
 
-const char* libclang_vim::get_all_extents(
-    const libclang_vim::location_tuple& location_info) {
-    static std::string vimson;
-    vimson = "";
-    char const* file_name = location_info.file.c_str();
-
-    cxindex_ptr index =
-        clang_createIndex(/*excludeDeclsFromPCH*/ 1, /*displayDiagnostics*/ 0);
-    auto const args_ptrs = get_args_ptrs(location_info.args);
-    std::vector<CXUnsavedFile> unsaved_files =
-        create_unsaved_files(location_info);
-    unsigned options = CXTranslationUnit_Incomplete;
-    cxtranslation_unit_ptr translation_unit(clang_parseTranslationUnit(
-        index, file_name, args_ptrs.data(), args_ptrs.size(),
-        unsaved_files.data(), unsaved_files.size(), options));
-    if (!translation_unit)
-        return "[]";
-
-    CXFile file = clang_getFile(translation_unit, file_name);
-    auto const location = clang_getLocation(
-        translation_unit, file, location_info.line, location_info.col);
-    CXCursor cursor = clang_getCursor(translation_unit, location);
-    vimson += "{" + stringize_extent(cursor) + "},";
+std::vector<CXCursor> libclang_vim::get_enclosing_extents(CXCursor cursor) {
+    std::vector<CXCursor> extents{cursor};
 
     bool already_pass_expression = false, already_pass_statement = false;
     while (!clang_isInvalid(clang_getCursorKind(cursor))) {
@@ -90,10 +71,30 @@ const char* libclang_vim::get_all_extents(
              clang_isExpression(clang_getCursorKind(cursor))) ||
             (!already_pass_statement &&
              clang_isStatement(clang_getCursorKind(cursor)))) {
-            vimson += "{" + stringize_extent(cursor) + "},";
+            extents.push_back(cursor);
         }
         cursor = clang_getCursorSemanticParent(cursor);
     }
+    return extents;
+}
+
+const char* libclang_vim::get_all_extents(
+    const libclang_vim::location_tuple& location_info) {
+    thread_local std::string vimson;
+    vimson = "";
+    char const* file_name = location_info.file.c_str();
+
+    auto const translation_unit =
+        get_translation_unit_cache().get_current(location_info);
+    if (!translation_unit)
+        return "[]";
+
+    CXFile file = clang_getFile(translation_unit, file_name);
+    auto const location = clang_getLocation(
+        translation_unit, file, location_info.line, location_info.col);
+    CXCursor cursor = clang_getCursor(translation_unit, location);
+    for (const CXCursor& extent : get_enclosing_extents(cursor))
+        vimson += "{" + stringize_extent(extent) + "},";
 
     vimson = "[" + vimson + "]";
 
@@ -4,6 +4,7 @@
 #include <tuple>
 #include <string>
 #include <cstdio>
+#include <vector>
 
 #include <clang-c/Index.h>
 
@@ -22,6 +23,10 @@ get_related_node_of(const location_tuple& location_info,
 const char* get_type_related_to(const location_tuple& location_info,
                                 const std::function<CXType(CXType)>& predicate);
 
+/// cursor and the expressions, statements, functions, classes and
+/// namespaces around it, innermost first.
+std::vector<CXCursor> get_enclosing_extents(CXCursor cursor);
+
 const char* get_all_extents(const location_tuple& location_info);
 
 } // namespace libclang_vim
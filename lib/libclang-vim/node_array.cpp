@@ -0,0 +1,233 @@
+#include "node_array.hpp"
+
+#include <cstdlib>
+
+#include "location.hpp"
+#include "tokenizer.hpp"
+#include "translation_unit_cache.hpp"
+
+namespace {
+
+CXTranslationUnit parse(CXIndex index,
+                        const libclang_vim::location_tuple& location_info) {
+    auto const args_ptrs = libclang_vim::get_args_ptrs(location_info.args);
+    std::vector<CXUnsavedFile> unsaved_files =
+        libclang_vim::create_unsaved_files(location_info);
+    return clang_parseTranslationUnit(
+        index, location_info.file.c_str(), args_ptrs.data(), args_ptrs.size(),
+        unsaved_files.data(), unsaved_files.size(),
+        CXTranslationUnit_Incomplete);
+}
+
+using category_predicate = bool (*)(const CXCursor&);
+
+bool is_any(const CXCursor&) { return true; }
+
+bool is_declaration(const CXCursor& cursor) {
+    return clang_isDeclaration(clang_getCursorKind(cursor));
+}
+
+bool is_attribute(const CXCursor& cursor) {
+    return clang_isAttribute(clang_getCursorKind(cursor));
+}
+
+bool is_expression(const CXCursor& cursor) {
+    return clang_isExpression(clang_getCursorKind(cursor));
+}
+
+bool is_preprocessing(const CXCursor& cursor) {
+    return clang_isPreprocessing(clang_getCursorKind(cursor));
+}
+
+bool is_reference(const CXCursor& cursor) {
+    return clang_isReference(clang_getCursorKind(cursor));
+}
+
+bool is_statement(const CXCursor& cursor) {
+    return clang_isStatement(clang_getCursorKind(cursor));
+}
+
+bool is_definition(const CXCursor& cursor) {
+    return clang_isCursorDefinition(cursor);
+}
+
+/// Same categories as the vim_clang_extract_*() functions, nullptr if
+/// category is unknown.
+category_predicate get_category_predicate(const std::string& category) {
+    static const std::map<std::string, category_predicate> predicates = {
+        {"all", is_any},
+        {"declarations", is_declaration},
+        {"attributes", is_attribute},
+        {"expressions", is_expression},
+        {"preprocessings", is_preprocessing},
+        {"references", is_reference},
+        {"statements", is_statement},
+        {"definitions", is_definition},
+    };
+    auto const it = predicates.find(category);
+    return it == predicates.end() ? nullptr : it->second;
+}
+
+/// Client data of collect_nodes().
+class node_collector {
+  public:
+    libclang_vim::node_array_builder& builder;
+    libclang_vim::extraction_policy policy;
+    category_predicate predicate;
+    /// Index of the closest selected ancestor, or -1.
+    int parent;
+};
+
+CXChildVisitResult collect_nodes(CXCursor cursor, CXCursor,
+                                 CXClientData data) {
+    auto& collector = *static_cast<node_collector*>(data);
+    if (libclang_vim::is_cancelled())
+        return CXChildVisit_Break;
+    if (!libclang_vim::is_extracted(collector.policy, cursor))
+        return CXChildVisit_Continue;
+
+    const int parent = collector.parent;
+    if (collector.predicate(cursor))
+        collector.parent = collector.builder.add_cursor(cursor, parent);
+    clang_visitChildren(cursor, collect_nodes, data);
+    collector.parent = parent;
+    return CXChildVisit_Continue;
+}
+}
+
+libclang_vim::node_array_builder::node_array_builder() : _strings(1, '\0') {}
+
+unsigned libclang_vim::node_array_builder::add_string(const char* s) {
+    if (!s || !*s)
+        return 0;
+
+    const unsigned offset = _strings.size();
+    _strings += s;
+    _strings += '\0';
+    return offset;
+}
+
+int libclang_vim::node_array_builder::add(int kind, const CXSourceRange& range,
+                                          int parent, const char* name) {
+    vim_clang_node node;
+    node.kind = kind;
+    CXFile file;
+    clang_getFileLocation(clang_getRangeStart(range), &file, &node.start_line,
+                          &node.start_column, &node.start_offset);
+    clang_getFileLocation(clang_getRangeEnd(range), nullptr, &node.end_line,
+                          &node.end_column, &node.end_offset);
+    node.parent = parent;
+    node.name = add_string(name);
+
+    cxstring_ptr file_name = clang_getFileName(file);
+    const char* file_string = to_c_str(file_name);
+    auto const it = _files.find(file_string ? file_string : "");
+    if (it != _files.end())
+        node.file = it->second;
+    else {
+        node.file = add_string(file_string);
+        _files[file_string ? file_string : ""] = node.file;
+    }
+
+    _nodes.push_back(node);
+    return _nodes.size() - 1;
+}
+
+int libclang_vim::node_array_builder::add_cursor(const CXCursor& cursor,
+                                                 int parent) {
+    cxstring_ptr spelling = clang_getCursorSpelling(cursor);
+    return add(clang_getCursorKind(cursor), clang_getCursorExtent(cursor),
+               parent, to_c_str(spelling));
+}
+
+vim_clang_nodes* libclang_vim::node_array_builder::release() const {
+    const size_t nodes_size = _nodes.size() * sizeof(vim_clang_node);
+    auto const result = static_cast<vim_clang_nodes*>(
+        std::malloc(sizeof(vim_clang_nodes) + nodes_size + _strings.size()));
+    if (!result)
+        return nullptr;
+
+    result->count = _nodes.size();
+    result->nodes = reinterpret_cast<vim_clang_node*>(result + 1);
+    if (nodes_size)
+        std::memcpy(result->nodes, _nodes.data(), nodes_size);
+    char* strings = reinterpret_cast<char*>(result->nodes) + nodes_size;
+    std::memcpy(strings, _strings.data(), _strings.size());
+    result->strings = strings;
+    return result;
+}
+
+vim_clang_nodes*
+libclang_vim::get_token_nodes(const location_tuple& location_info) {
+    cxindex_ptr index =
+        clang_createIndex(/*excludeDeclsFromPCH*/ 1, /*displayDiagnostics*/ 0);
+    cxtranslation_unit_ptr translation_unit(parse(index, location_info));
+    if (!translation_unit)
+        return nullptr;
+
+    auto const file_range =
+        tokenizer().get_range_whole_file(location_info, translation_unit);
+    if (clang_Range_isNull(file_range))
+        return nullptr;
+
+    CXToken* tokens;
+    unsigned num_tokens;
+    clang_tokenize(translation_unit, file_range, &tokens, &num_tokens);
+    node_array_builder builder;
+    for (unsigned i = 0; i < num_tokens; ++i) {
+        cxstring_ptr spelling =
+            clang_getTokenSpelling(translation_unit, tokens[i]);
+        builder.add(clang_getTokenKind(tokens[i]),
+                    clang_getTokenExtent(translation_unit, tokens[i]), -1,
+                    to_c_str(spelling));
+    }
+    clang_disposeTokens(translation_unit, tokens, num_tokens);
+    return builder.release();
+}
+
+vim_clang_nodes*
+libclang_vim::get_extent_nodes(const location_tuple& location_info) {
+    auto const translation_unit =
+        get_translation_unit_cache().get_current(location_info);
+    if (!translation_unit)
+        return nullptr;
+
+    CXFile file = clang_getFile(translation_unit, location_info.file.c_str());
+    auto const location = clang_getLocation(
+        translation_unit, file, location_info.line, location_info.col);
+    const std::vector<CXCursor> extents =
+        get_enclosing_extents(clang_getCursor(translation_unit, location));
+
+    // Each extent is the parent of the previous one.
+    node_array_builder builder;
+    for (size_t i = 0; i < extents.size(); ++i) {
+        const int parent =
+            i + 1 < extents.size() ? static_cast<int>(i + 1) : -1;
+        builder.add_cursor(extents[i], parent);
+    }
+    return builder.release();
+}
+
+vim_clang_nodes*
+libclang_vim::extract_nodes(const location_tuple& location_info,
+                            extraction_policy policy,
+                            const std::string& category) {
+    const category_predicate predicate = get_category_predicate(category);
+    if (!predicate)
+        return nullptr;
+
+    auto const translation_unit =
+        get_translation_unit_cache().get_current(location_info);
+    if (!translation_unit)
+        return nullptr;
+
+    node_array_builder builder;
+    node_collector collector = {builder, policy, predicate, -1};
+    clang_visitChildren(clang_getTranslationUnitCursor(translation_unit),
+                        collect_nodes, &collector);
+    if (is_cancelled())
+        return nullptr;
+    return builder.release();
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,58 @@
+#if !defined LIBCLANG_VIM_NODE_ARRAY_HPP_INCLUDED
+#define LIBCLANG_VIM_NODE_ARRAY_HPP_INCLUDED
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <clang-c/Index.h>
+
+#include "AST_extracter.hpp"
+#include "clang_vim.h"
+#include "helpers.hpp"
+
+namespace libclang_vim {
+
+/// Collects the nodes and the string pool of a vim_clang_nodes result.
+class node_array_builder {
+    std::vector<vim_clang_node> _nodes;
+    /// Starts with an empty string, so offset 0 is "".
+    std::string _strings;
+    /// Offsets of the file names, each one is in the pool once.
+    std::map<std::string, unsigned> _files;
+
+    unsigned add_string(const char* s);
+
+  public:
+    node_array_builder();
+
+    /// Appends a node spanning range, returns its index.
+    int add(int kind, const CXSourceRange& range, int parent, const char* name);
+
+    /// Appends the extent of cursor, returns its index.
+    int add_cursor(const CXCursor& cursor, int parent);
+
+    /// Copies the nodes and the strings into a single malloc() block, or
+    /// returns nullptr.
+    vim_clang_nodes* release() const;
+};
+
+/// Tokens of the main file of location_info.
+vim_clang_nodes* get_token_nodes(const location_tuple& location_info);
+
+/// Same cursors as get_all_extents(), innermost first.
+vim_clang_nodes* get_extent_nodes(const location_tuple& location_info);
+
+/// AST nodes of location_info that policy and category ("all",
+/// "declarations", "attributes", "expressions", "preprocessings",
+/// "references", "statements" or "definitions") select. The parent of a node
+/// is its closest selected ancestor.
+vim_clang_nodes* extract_nodes(const location_tuple& location_info,
+                               extraction_policy policy,
+                               const std::string& category);
+
+} // namespace libclang_vim
+
+#endif // LIBCLANG_VIM_NODE_ARRAY_HPP_INCLUDED
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,453 @@
+#include "project.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <set>
+
+#include "AST_extracter.hpp"
+#include "compilation_database.hpp"
+#include "function_metrics.hpp"
+#include "indexer.hpp"
+#include "layout.hpp"
+#include "stringizers.hpp"
+#include "thread_pool.hpp"
+
+namespace {
+
+/// Measurements of one translation unit.
+struct translation_unit_profile {
+    std::string file;
+    bool parsed;
+    std::chrono::steady_clock::duration parse_time;
+    /// Largest clang_getCXTUResourceUsage() total seen while profiling.
+    unsigned long peak_memory;
+    size_t included_files;
+    size_t ast_nodes;
+};
+
+void count_inclusion(CXFile, CXSourceLocation*, unsigned include_len,
+                     CXClientData data) {
+    if (include_len)
+        ++*static_cast<size_t*>(data);
+}
+
+CXChildVisitResult count_cursor(CXCursor, CXCursor, CXClientData data) {
+    ++*static_cast<size_t*>(data);
+    return CXChildVisit_Recurse;
+}
+
+std::string escape_csv(const std::string& s) {
+    if (s.find_first_of(",\"\n") == std::string::npos)
+        return s;
+
+    std::string ret = "\"";
+    for (char c : s) {
+        if (c == '"')
+            ret += '"';
+        ret += c;
+    }
+    return ret + "\"";
+}
+
+/// Formats profile as a dictionary (or a CSV row) in format.
+std::string stringize_profile(const translation_unit_profile& profile,
+                              libclang_vim::report_format format) {
+    const std::string parse_time =
+        libclang_vim::stringize_seconds(profile.parse_time);
+    const std::string memory = std::to_string(profile.peak_memory);
+    const std::string included_files = std::to_string(profile.included_files);
+    const std::string ast_nodes = std::to_string(profile.ast_nodes);
+    switch (format) {
+    case libclang_vim::report_format::csv:
+        return escape_csv(profile.file) + "," + parse_time + "," + memory +
+               "," + included_files + "," + ast_nodes + "," +
+               (profile.parsed ? "" : "failed to parse");
+    case libclang_vim::report_format::json:
+        return "{\"file\":\"" + libclang_vim::escape_json(profile.file) +
+               "\",\"parse_time\":" + parse_time +
+               ",\"peak_memory\":" + memory +
+               ",\"included_files\":" + included_files +
+               ",\"ast_nodes\":" + ast_nodes +
+               (profile.parsed ? "" : ",\"error\":\"failed to parse\"") + "}";
+    case libclang_vim::report_format::vimson:
+        break;
+    }
+    return "{'file':'" + libclang_vim::escape_single_quotes(profile.file) +
+           "','parse_time':" + parse_time + ",'peak_memory':" + memory +
+           ",'included_files':" + included_files + ",'ast_nodes':" +
+           ast_nodes + (profile.parsed ? "" : ",'error':'failed to parse'") +
+           "}";
+}
+
+/// A record type with padding or with a field that straddles a cache line.
+struct padded_type {
+    std::string usr;
+    std::string file;
+    unsigned line;
+    libclang_vim::record_layout layout;
+    size_t uses;
+
+    long long get_waste() const {
+        return layout.get_padding() *
+               static_cast<long long>(std::max<size_t>(uses, 1));
+    }
+};
+
+/// Records are defined in headers included by many translation units: only
+/// the first one that sees a USR computes its layout.
+class usr_claims {
+    std::mutex _mutex;
+    std::set<std::string> _usrs;
+
+  public:
+    bool claim(const std::string& usr) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _usrs.insert(usr).second;
+    }
+};
+
+struct padding_visitor_data {
+    usr_claims& claims;
+    std::vector<padded_type>& types;
+};
+
+CXChildVisitResult find_padded_types(CXCursor cursor, CXCursor,
+                                     CXClientData client_data) {
+    if (!libclang_vim::is_extracted(
+            libclang_vim::extraction_policy::non_system_headers, cursor))
+        return CXChildVisit_Continue;
+
+    // Templates have no layout, only their instantiations.
+    const CXCursorKind kind = clang_getCursorKind(cursor);
+    if ((kind != CXCursor_StructDecl && kind != CXCursor_ClassDecl &&
+         kind != CXCursor_UnionDecl) ||
+        !clang_isCursorDefinition(cursor))
+        return CXChildVisit_Recurse;
+
+    auto data = static_cast<padding_visitor_data*>(client_data);
+    libclang_vim::cxstring_ptr usr = clang_getCursorUSR(cursor);
+    const char* usr_string = libclang_vim::to_c_str(usr);
+    if (!usr_string || !*usr_string || !data->claims.claim(usr_string))
+        return CXChildVisit_Recurse;
+
+    padded_type type;
+    if (!libclang_vim::get_record_layout(clang_getCursorType(cursor),
+                                         type.layout) ||
+        (!type.layout.get_padding() && !type.layout.has_straddling_field()))
+        return CXChildVisit_Recurse;
+
+    CXFile file;
+    clang_getFileLocation(clang_getCursorLocation(cursor), &file, &type.line,
+                          nullptr, nullptr);
+    if (!file)
+        return CXChildVisit_Recurse;
+    libclang_vim::cxstring_ptr file_name = clang_getFileName(file);
+    type.file = clang_getCString(file_name);
+    type.usr = usr_string;
+    type.uses = 0;
+    data->types.push_back(type);
+    return CXChildVisit_Recurse;
+}
+}
+
+std::string libclang_vim::stringize_seconds(
+    std::chrono::steady_clock::duration duration) {
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.3f",
+                  std::chrono::duration<double>(duration).count());
+    return buffer;
+}
+
+std::string libclang_vim::sweep_diagnostics(const std::string& directory,
+                                            unsigned jobs,
+                                            const project_callback& callback) {
+    using clock = std::chrono::steady_clock;
+    const clock::time_point start = clock::now();
+
+    const std::vector<compile_command> commands =
+        get_all_compile_commands(directory);
+    if (!jobs)
+        jobs = get_default_jobs();
+
+    // A CXIndex is not meant to be used from multiple threads at the same
+    // time, so each worker gets its own.
+    std::vector<std::unique_ptr<cxindex_ptr>> indexes;
+    for (unsigned i = 0; i < jobs; ++i)
+        indexes.emplace_back(new cxindex_ptr(clang_createIndex(
+            /*excludeDeclsFromPCH*/ 0, /*displayDiagnostics*/ 0)));
+
+    std::mutex mutex;
+    size_t failed = 0;
+    clock::duration parse_time(0);
+    parallel_for(commands.size(), jobs, [&](size_t item, unsigned worker) {
+        const compile_command& command = commands[item];
+        const clock::time_point parse_start = clock::now();
+        auto const args_ptrs = get_args_ptrs(command.args);
+        cxtranslation_unit_ptr translation_unit(clang_parseTranslationUnit(
+            *indexes[worker], command.file.c_str(), args_ptrs.data(),
+            args_ptrs.size(), nullptr, 0, CXTranslationUnit_None));
+        std::string diagnostics = "[]";
+        if (translation_unit)
+            diagnostics = stringize_diagnostics(translation_unit);
+        const clock::duration elapsed = clock::now() - parse_start;
+
+        std::string result = "{'file':'" +
+                             escape_single_quotes(command.file) +
+                             "','parse_time':" + stringize_seconds(elapsed) +
+                             ",'diagnostics':" + diagnostics;
+        if (!translation_unit)
+            result += ",'error':'failed to parse'";
+        result += "}";
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!translation_unit)
+            ++failed;
+        parse_time += elapsed;
+        callback(result);
+    });
+
+    return "{'files':" + std::to_string(commands.size()) + ",'failed':" +
+           std::to_string(failed) + ",'wall_time':" +
+           stringize_seconds(clock::now() - start) + ",'parse_time':" +
+           stringize_seconds(parse_time) + "}";
+}
+
+libclang_vim::report_format
+libclang_vim::parse_report_format(const std::string& name) {
+    if (name == "json")
+        return report_format::json;
+    if (name == "csv")
+        return report_format::csv;
+    return report_format::vimson;
+}
+
+std::string libclang_vim::profile_project(const std::string& directory,
+                                          unsigned jobs, report_format format,
+                                          const project_callback& callback) {
+    using clock = std::chrono::steady_clock;
+    const clock::time_point start = clock::now();
+
+    const std::vector<compile_command> commands =
+        get_all_compile_commands(directory);
+    if (!jobs)
+        jobs = get_default_jobs();
+
+    std::vector<std::unique_ptr<cxindex_ptr>> indexes;
+    for (unsigned i = 0; i < jobs; ++i)
+        indexes.emplace_back(new cxindex_ptr(clang_createIndex(
+            /*excludeDeclsFromPCH*/ 0, /*displayDiagnostics*/ 0)));
+
+    std::mutex mutex;
+    std::vector<translation_unit_profile> profiles(commands.size());
+    parallel_for(commands.size(), jobs, [&](size_t item, unsigned worker) {
+        const compile_command& command = commands[item];
+        translation_unit_profile& profile = profiles[item];
+        profile.file = command.file;
+        profile.peak_memory = 0;
+        profile.included_files = 0;
+        profile.ast_nodes = 0;
+
+        const clock::time_point parse_start = clock::now();
+        auto const args_ptrs = get_args_ptrs(command.args);
+        cxtranslation_unit_ptr translation_unit(clang_parseTranslationUnit(
+            *indexes[worker], command.file.c_str(), args_ptrs.data(),
+            args_ptrs.size(), nullptr, 0, CXTranslationUnit_None));
+        profile.parse_time = clock::now() - parse_start;
+        profile.parsed = translation_unit;
+        if (translation_unit) {
+            // The AST is complete after parsing, but walking it may still
+            // deserialize declarations of a PCH: keep the larger sample.
+            profile.peak_memory = get_memory_usage(translation_unit);
+            clang_getInclusions(translation_unit, count_inclusion,
+                                &profile.included_files);
+            clang_visitChildren(
+                clang_getTranslationUnitCursor(translation_unit),
+                count_cursor, &profile.ast_nodes);
+            profile.peak_memory = std::max(profile.peak_memory,
+                                           get_memory_usage(translation_unit));
+        }
+
+        const std::string result = stringize_profile(profile, format);
+        std::lock_guard<std::mutex> lock(mutex);
+        callback(result);
+    });
+
+    // Slowest first, failed ones last.
+    std::stable_sort(profiles.begin(), profiles.end(),
+                     [](const translation_unit_profile& a,
+                        const translation_unit_profile& b) {
+                         if (a.parsed != b.parsed)
+                             return a.parsed;
+                         return a.parse_time > b.parse_time;
+                     });
+    const size_t failed =
+        std::count_if(profiles.begin(), profiles.end(),
+                      [](const translation_unit_profile& profile) {
+                          return !profile.parsed;
+                      });
+    const std::string wall_time = stringize_seconds(clock::now() - start);
+
+    std::string ret;
+    switch (format) {
+    case report_format::csv:
+        ret = "file,parse_time,peak_memory,included_files,ast_nodes,error\n";
+        for (const auto& profile : profiles)
+            ret += stringize_profile(profile, format) + "\n";
+        return ret;
+    case report_format::json:
+        ret = "{\"translation_units\":[";
+        for (size_t i = 0; i < profiles.size(); ++i) {
+            if (i)
+                ret += ",";
+            ret += stringize_profile(profiles[i], format);
+        }
+        return ret + "],\"failed\":" + std::to_string(failed) +
+               ",\"wall_time\":" + wall_time + "}";
+    case report_format::vimson:
+        break;
+    }
+    ret = "{'translation_units':[";
+    for (const auto& profile : profiles)
+        ret += stringize_profile(profile, format) + ",";
+    return ret + "],'failed':" + std::to_string(failed) + ",'wall_time':" +
+           wall_time + "}";
+}
+
+std::string libclang_vim::scan_padding(const std::string& directory,
+                                       unsigned jobs) {
+    using clock = std::chrono::steady_clock;
+    const clock::time_point start = clock::now();
+
+    const std::vector<compile_command> commands =
+        get_all_compile_commands(directory);
+    if (!jobs)
+        jobs = get_default_jobs();
+
+    std::vector<std::unique_ptr<cxindex_ptr>> indexes;
+    for (unsigned i = 0; i < jobs; ++i)
+        indexes.emplace_back(new cxindex_ptr(clang_createIndex(
+            /*excludeDeclsFromPCH*/ 0, /*displayDiagnostics*/ 0)));
+
+    usr_claims claims;
+    std::mutex mutex;
+    std::vector<padded_type> types;
+    size_t failed = 0;
+    parallel_for(commands.size(), jobs, [&](size_t item, unsigned worker) {
+        const compile_command& command = commands[item];
+        auto const args_ptrs = get_args_ptrs(command.args);
+        // Layouts don't depend on function bodies.
+        cxtranslation_unit_ptr translation_unit(clang_parseTranslationUnit(
+            *indexes[worker], command.file.c_str(), args_ptrs.data(),
+            args_ptrs.size(), nullptr, 0,
+            CXTranslationUnit_Incomplete |
+                CXTranslationUnit_SkipFunctionBodies));
+        std::vector<padded_type> found;
+        if (translation_unit) {
+            padding_visitor_data data = {claims, found};
+            clang_visitChildren(
+                clang_getTranslationUnitCursor(translation_unit),
+                find_padded_types, &data);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!translation_unit)
+            ++failed;
+        std::move(found.begin(), found.end(), std::back_inserter(types));
+    });
+
+    // Weight the waste with how much the type is used.
+    const std::string database_directory =
+        find_compilation_database(directory);
+    auto const index = database_directory.empty()
+                           ? nullptr
+                           : get_project_index(database_directory);
+    for (auto& type : types)
+        type.uses = index ? index->get_occurrence_count(type.usr) : 0;
+    std::sort(types.begin(), types.end(),
+              [](const padded_type& a, const padded_type& b) {
+                  if (a.get_waste() != b.get_waste())
+                      return a.get_waste() > b.get_waste();
+                  return a.layout.name < b.layout.name;
+              });
+
+    std::stringstream ss;
+    ss << "{'translation_units':" << commands.size() << ",'failed':" << failed
+       << ",'types':[";
+    for (const auto& type : types) {
+        ss << "{'name':'" << escape_single_quotes(type.layout.name) << "',";
+        ss << "'file':'" << escape_single_quotes(type.file) << "',";
+        ss << "'line':" << type.line << ",'size':" << type.layout.size << ",";
+        ss << "'padding':" << type.layout.get_padding() << ",";
+        ss << "'uses':" << type.uses << ",'waste':" << type.get_waste() << ",";
+        ss << "'straddles_cache_line':" << type.layout.has_straddling_field()
+           << "},";
+    }
+    ss << "],'wall_time':" << stringize_seconds(clock::now() - start) << "}";
+    return ss.str();
+}
+
+std::string
+libclang_vim::measure_project_functions(const std::string& directory,
+                                        unsigned jobs) {
+    using clock = std::chrono::steady_clock;
+    const clock::time_point start = clock::now();
+
+    const std::vector<compile_command> commands =
+        get_all_compile_commands(directory);
+    if (!jobs)
+        jobs = get_default_jobs();
+
+    std::vector<std::unique_ptr<cxindex_ptr>> indexes;
+    for (unsigned i = 0; i < jobs; ++i)
+        indexes.emplace_back(new cxindex_ptr(clang_createIndex(
+            /*excludeDeclsFromPCH*/ 0, /*displayDiagnostics*/ 0)));
+
+    std::vector<std::shared_ptr<const std::vector<function_metrics>>> results(
+        commands.size());
+    std::mutex mutex;
+    size_t failed = 0;
+    size_t cached = 0;
+    parallel_for(commands.size(), jobs, [&](size_t item, unsigned worker) {
+        location_tuple location_info;
+        location_info.file = commands[item].file;
+        location_info.args = commands[item].args;
+        bool hit = false;
+        results[item] =
+            get_function_metrics(location_info, *indexes[worker], hit);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!results[item])
+            ++failed;
+        else if (hit)
+            ++cached;
+    });
+
+    // Pairs of file and metrics.
+    std::vector<std::pair<size_t, const function_metrics*>> functions;
+    for (size_t i = 0; i < results.size(); ++i) {
+        if (!results[i])
+            continue;
+        for (const auto& metrics : *results[i])
+            functions.push_back(std::make_pair(i, &metrics));
+    }
+    std::stable_sort(
+        functions.begin(), functions.end(),
+        [](const std::pair<size_t, const function_metrics*>& a,
+           const std::pair<size_t, const function_metrics*>& b) {
+            return a.second->nodes > b.second->nodes;
+        });
+
+    std::stringstream ss;
+    ss << "{'translation_units':" << commands.size() << ",'failed':" << failed
+       << ",'cached':" << cached << ",'functions':[";
+    for (const auto& function : functions) {
+        ss << "{'file':'"
+           << escape_single_quotes(commands[function.first].file) << "',";
+        ss << stringize_function_metrics(*function.second) << "},";
+    }
+    ss << "],'wall_time':" << stringize_seconds(clock::now() - start) << "}";
+    return ss.str();
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,60 @@
+#if !defined LIBCLANG_VIM_PROJECT_HPP_INCLUDED
+#define LIBCLANG_VIM_PROJECT_HPP_INCLUDED
+
+#include <chrono>
+#include <functional>
+#include <string>
+
+namespace libclang_vim {
+
+/// Receives the result of one file of a project-wide operation.
+using project_callback = std::function<void(const std::string&)>;
+
+/// Formats a duration as seconds, with millisecond precision.
+std::string stringize_seconds(std::chrono::steady_clock::duration duration);
+
+/// Parses every entry of the compilation database found from directory on
+/// jobs threads (0 means one per core). callback gets
+/// "{'file':'..','parse_time':..,'diagnostics':[..]}" for each file as soon
+/// as it's parsed; it's never invoked concurrently. Returns the number of
+/// files, failed parses, the wall time and the sum of the parse times.
+std::string sweep_diagnostics(const std::string& directory, unsigned jobs,
+                              const project_callback& callback);
+
+enum class report_format { vimson, json, csv };
+
+/// Returns the format called name: "json" or "csv", vimson otherwise.
+report_format parse_report_format(const std::string& name);
+
+/// Parses every entry of the compilation database found from directory on
+/// jobs threads (0 means one per core), and measures the parse time, the
+/// peak memory usage (the largest clang_getCXTUResourceUsage() total sampled
+/// after the parse and after walking the AST), the number of included
+/// files and the number of AST nodes of each translation unit. callback gets
+/// the measurements of each file as soon as it's parsed, as an object (or a
+/// CSV row) in format; it's never invoked concurrently. Returns the report
+/// of all files, slowest first: a list of the files in a dictionary with the
+/// number of failed parses and the wall time, or a CSV table with a header.
+std::string profile_project(const std::string& directory, unsigned jobs,
+                            report_format format,
+                            const project_callback& callback);
+
+/// Parses every entry of the compilation database found from directory on
+/// jobs threads (0 means one per core), and computes the layout of each
+/// record type defined outside of system headers, once per USR. Returns the
+/// ones with padding or with a field that straddles a cache line, ranked by
+/// the padding multiplied by the number of occurrences in the project index.
+std::string scan_padding(const std::string& directory, unsigned jobs);
+
+/// Measures the function definitions of every entry of the compilation
+/// database found from directory on jobs threads (0 means one per core), see
+/// extract_function_metrics(). Files that didn't change since the last run
+/// are not parsed again. Returns the functions with the most AST nodes first.
+std::string measure_project_functions(const std::string& directory,
+                                      unsigned jobs);
+
+} // namespace libclang_vim
+
+#endif // LIBCLANG_VIM_PROJECT_HPP_INCLUDED
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
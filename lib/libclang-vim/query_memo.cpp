@@ -0,0 +1,263 @@
+#include "query_memo.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "helpers.hpp"
+#include "session.hpp"
+
+namespace {
+
+using result_ptr = std::shared_ptr<const std::string>;
+}
+
+/// Results of recent queries of a session, shared by its threads.
+class libclang_vim::query_memo {
+    struct entry {
+        /// nullptr while a call computes it.
+        result_ptr result;
+        std::chrono::steady_clock::time_point stored;
+    };
+
+    /// Identifies the contents of a file on disk that was hashed before.
+    struct file_hash {
+        dev_t device;
+        ino_t inode;
+        off_t size;
+        long long modified;
+        long long changed;
+        unsigned long long hash;
+    };
+
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::map<std::string, entry> _entries;
+    std::map<std::string, file_hash> _file_hashes;
+
+    void evict();
+
+  public:
+    /// Repeated queries at the cursor position, not a project's worth of
+    /// results.
+    static const size_t max_entries = 256;
+
+    /// Long enough for the queries of one cursor movement, short enough to
+    /// notice edits of included headers.
+    static std::chrono::seconds get_lifetime() {
+        return std::chrono::seconds(5);
+    }
+
+    /// Returns the result of key, waiting while another call computes it.
+    /// Otherwise returns nullptr and sets reserved if the caller has to
+    /// compute it for the others, it's not set if the caller was cancelled
+    /// while waiting.
+    result_ptr find_or_reserve(const std::string& key, bool& reserved);
+
+    /// Stores the result of a reserved key, or releases it if result is
+    /// nullptr.
+    void publish(const std::string& key, result_ptr result);
+
+    /// Like get_file_content_hash(), but only reads file again if stat()
+    /// tells that it changed since the last call.
+    bool get_content_hash(const std::string& file, unsigned long long& hash);
+};
+
+namespace {
+
+long long get_nanoseconds(const timespec& time) {
+    return time.tv_sec * 1000000000LL + time.tv_nsec;
+}
+}
+
+void libclang_vim::query_memo::evict() {
+    auto oldest = _entries.end();
+    for (auto it = _entries.begin(); it != _entries.end(); ++it) {
+        if (it->second.result &&
+            (oldest == _entries.end() ||
+             it->second.stored < oldest->second.stored))
+            oldest = it;
+    }
+    if (oldest != _entries.end())
+        _entries.erase(oldest);
+}
+
+result_ptr libclang_vim::query_memo::find_or_reserve(const std::string& key,
+                                                     bool& reserved) {
+    reserved = false;
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        auto const now = std::chrono::steady_clock::now();
+        auto it = _entries.find(key);
+        if (it == _entries.end()) {
+            if (_entries.size() >= max_entries)
+                evict();
+            _entries[key] = entry();
+            reserved = true;
+            return nullptr;
+        }
+
+        entry& found = it->second;
+        if (found.result) {
+            if (now - found.stored < get_lifetime())
+                return found.result;
+            found.result.reset();
+            reserved = true;
+            return nullptr;
+        }
+
+        // Computed by another call. Whatever cancels us, a newer request of
+        // the same method for the same buffer, cancels that call, too, so it
+        // publishes nothing soon and wakes us up.
+        _condition.wait(lock);
+        if (libclang_vim::is_cancelled())
+            return nullptr;
+    }
+}
+
+void libclang_vim::query_memo::publish(const std::string& key,
+                                       result_ptr result) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (result) {
+        entry& stored = _entries[key];
+        stored.result = std::move(result);
+        stored.stored = std::chrono::steady_clock::now();
+    } else
+        _entries.erase(key);
+    _condition.notify_all();
+}
+
+bool libclang_vim::query_memo::get_content_hash(const std::string& file,
+                                                unsigned long long& hash) {
+    struct stat status;
+    if (stat(file.c_str(), &status) != 0)
+        return false;
+
+    file_hash current;
+    current.device = status.st_dev;
+    current.inode = status.st_ino;
+    current.size = status.st_size;
+    current.modified = get_nanoseconds(status.st_mtim);
+    current.changed = get_nanoseconds(status.st_ctim);
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto const it = _file_hashes.find(file);
+        if (it != _file_hashes.end() && it->second.device == current.device &&
+            it->second.inode == current.inode &&
+            it->second.size == current.size &&
+            it->second.modified == current.modified &&
+            it->second.changed == current.changed) {
+            hash = it->second.hash;
+            return true;
+        }
+    }
+
+    // A write in the same timestamp tick as ours leaves the same stat(), so
+    // only recently modified files are read every time.
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    if (!libclang_vim::get_file_content_hash(file, current.hash))
+        return false;
+    hash = current.hash;
+    if (get_nanoseconds(now) - current.modified < 2000000000LL)
+        return true;
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_file_hashes.size() >= max_entries)
+        _file_hashes.clear();
+    _file_hashes[file] = current;
+    return true;
+}
+
+std::shared_ptr<libclang_vim::query_memo>
+libclang_vim::create_query_memo() {
+    return std::make_shared<query_memo>();
+}
+
+namespace {
+
+libclang_vim::query_memo& get_query_memo() {
+    return libclang_vim::get_current_session().get_query_memo();
+}
+
+/// Returns "api\ndirectory\nargument\nhash", where the "#temp file" of an
+/// unsaved buffer is replaced by the hash of its contents, so a new temporary
+/// file with the same contents still matches. Relative file names and include
+/// paths depend on the working directory, so it's part of the key. Returns an
+/// empty key if the buffer can't be read.
+std::string get_query_key(const char* api, const std::string& argument) {
+    const size_t file_end = argument.find(':');
+    std::string file = argument.substr(0, file_end);
+    const std::string rest =
+        file_end == std::string::npos ? "" : argument.substr(file_end);
+
+    unsigned long long hash;
+    const size_t temp_file = file.find('#');
+    if (temp_file != std::string::npos) {
+        if (!get_query_memo().get_content_hash(file.substr(temp_file + 1),
+                                               hash))
+            return std::string();
+        file.erase(temp_file);
+    } else if (!get_query_memo().get_content_hash(file, hash))
+        return std::string();
+
+    std::vector<char> directory(4096);
+    if (!getcwd(directory.data(), directory.size()))
+        return std::string();
+
+    return std::string(api) + "\n" + directory.data() + "\n" + file + rest +
+           "\n" + std::to_string(hash);
+}
+
+/// Keeps the results returned by memoized_query::find() alive, one per
+/// query, like the static buffers of the queries themselves.
+result_ptr& get_returned_result(const char* api) {
+    thread_local std::map<std::string, result_ptr> results;
+    return results[api];
+}
+}
+
+libclang_vim::memoized_query::memoized_query(const char* api,
+                                             const char* argument)
+    : _key(get_query_key(api, argument)), _reserved(false) {
+    get_returned_result(api).reset();
+}
+
+libclang_vim::memoized_query::~memoized_query() {
+    if (_reserved)
+        get_query_memo().publish(_key, nullptr);
+}
+
+const char* libclang_vim::memoized_query::find() {
+    if (_key.empty())
+        return nullptr;
+
+    result_ptr result = get_query_memo().find_or_reserve(_key, _reserved);
+    if (!result)
+        return nullptr;
+
+    const std::string api = _key.substr(0, _key.find('\n'));
+    result_ptr& returned = get_returned_result(api.c_str());
+    returned = std::move(result);
+    return returned->c_str();
+}
+
+const char* libclang_vim::memoized_query::store(const char* result) {
+    if (!_reserved)
+        return result;
+
+    _reserved = false;
+    if (is_cancelled())
+        get_query_memo().publish(_key, nullptr);
+    else
+        get_query_memo().publish(_key, std::make_shared<std::string>(result));
+    return result;
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
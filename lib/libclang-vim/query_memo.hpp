@@ -0,0 +1,63 @@
+#if !defined LIBCLANG_VIM_QUERY_MEMO_HPP_INCLUDED
+#define LIBCLANG_VIM_QUERY_MEMO_HPP_INCLUDED
+
+#include <memory>
+#include <string>
+
+namespace libclang_vim {
+
+/// Results of the recent memoized queries of a session.
+class query_memo;
+
+/// Creates the memo of a new session.
+std::shared_ptr<query_memo> create_query_memo();
+
+/// Memoizes the result of one call of a query that only depends on its
+/// argument: the file, the compiler arguments, the position and the contents
+/// of the buffer. An identical call returns the stored result, and one that
+/// overlaps with it waits for its result instead of computing it again. The
+/// key needs the hash of the buffer: a saved file is only read again when
+/// stat() tells that it changed, the temporary file of an unsaved buffer
+/// every time. Included headers are not part of the key, so results expire
+/// after a few seconds.
+class memoized_query {
+    std::string _key;
+    /// True if this call computes the result of _key for the waiting ones.
+    bool _reserved;
+
+  public:
+    /// api is the name of the query. Nothing is memoized if the buffer of
+    /// argument can't be read.
+    memoized_query(const char* api, const char* argument);
+
+    memoized_query(const memoized_query&) = delete;
+
+    memoized_query& operator=(const memoized_query&) = delete;
+
+    /// Lets the waiting calls compute the result themselves if store() was
+    /// not called.
+    ~memoized_query();
+
+    /// Returns the memoized result, valid until the next call of the same
+    /// query on the same thread, or nullptr if the query has to run.
+    const char* find();
+
+    /// Memoizes result, unless the query was cancelled, and returns it.
+    const char* store(const char* result);
+};
+
+/// Returns the memoized result of api for argument, or the one of query(),
+/// see memoized_query.
+template <typename Query>
+const char* memoize(const char* api, const char* argument, Query query) {
+    memoized_query memo(api, argument);
+    if (const char* memoized = memo.find())
+        return memoized;
+    return memo.store(query());
+}
+
+} // namespace libclang_vim
+
+#endif // LIBCLANG_VIM_QUERY_MEMO_HPP_INCLUDED
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,198 @@
+#include "scheduler.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "project.hpp"
+#include "thread_pool.hpp"
+
+namespace {
+
+const char* const priority_names[] = {"interactive", "visible", "background"};
+
+thread_local const libclang_vim::scheduler_slot* current_slot = nullptr;
+
+bool starts_with(const std::string& s, const char* prefix) {
+    return s.compare(0, std::strlen(prefix), prefix) == 0;
+}
+}
+
+bool libclang_vim::parse_request_priority(const std::string& name,
+                                          request_priority& ret) {
+    for (unsigned i = 0; i < request_priority_count; ++i) {
+        if (name == priority_names[i]) {
+            ret = static_cast<request_priority>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+libclang_vim::request_priority
+libclang_vim::get_default_priority(const std::string& function) {
+    if (function == "vim_clang_index_project" ||
+        function == "vim_clang_update_project_index" ||
+        function == "vim_clang_scan_project_padding" ||
+        function == "vim_clang_measure_project_functions")
+        return request_priority::background;
+
+    if (function == "vim_clang_tokens" ||
+        starts_with(function, "vim_clang_extract_") ||
+        function == "vim_clang_get_diagnostics" ||
+        function == "vim_clang_profile_includes")
+        return request_priority::visible;
+
+    return request_priority::interactive;
+}
+
+libclang_vim::scheduler::class_state::class_state()
+    : waiting(0), running(0), admitted(0), total_wait(0), max_wait(0) {}
+
+libclang_vim::scheduler::scheduler(unsigned capacity) : _capacity(capacity) {}
+
+libclang_vim::scheduler::class_state&
+libclang_vim::scheduler::get_class(request_priority priority) {
+    return _classes[static_cast<unsigned>(priority)];
+}
+
+bool libclang_vim::scheduler::can_admit(request_priority priority) {
+    const class_state& interactive = get_class(request_priority::interactive);
+    const class_state& visible = get_class(request_priority::visible);
+    const class_state& background = get_class(request_priority::background);
+    switch (priority) {
+    case request_priority::interactive:
+        return true;
+    case request_priority::visible:
+        return interactive.running + visible.running < _capacity;
+    case request_priority::background:
+        return !must_yield(priority) &&
+               interactive.running + visible.running + background.running <
+                   _capacity;
+    }
+    return true;
+}
+
+bool libclang_vim::scheduler::must_yield(request_priority priority) {
+    if (priority == request_priority::interactive)
+        return false;
+
+    if (get_class(request_priority::interactive).running)
+        return true;
+    for (unsigned i = 0; i < static_cast<unsigned>(priority); ++i) {
+        if (_classes[i].waiting)
+            return true;
+    }
+    return false;
+}
+
+void libclang_vim::scheduler::enqueue(request_priority priority) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    ++get_class(priority).waiting;
+}
+
+void libclang_vim::scheduler::dequeue(request_priority priority) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    --get_class(priority).waiting;
+    _condition.notify_all();
+}
+
+void libclang_vim::scheduler::admit(request_priority priority,
+                                    clock::time_point queued, bool enqueued) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    class_state& state = get_class(priority);
+    if (!enqueued)
+        ++state.waiting;
+    _condition.wait(lock, [this, priority] { return can_admit(priority); });
+    --state.waiting;
+    ++state.running;
+    ++state.admitted;
+
+    const clock::duration wait = clock::now() - queued;
+    state.total_wait += wait;
+    state.max_wait = std::max(state.max_wait, wait);
+    // Fewer waiting ones of this class may admit lower classes.
+    _condition.notify_all();
+}
+
+void libclang_vim::scheduler::release(request_priority priority) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    --get_class(priority).running;
+    _condition.notify_all();
+}
+
+void libclang_vim::scheduler::yield(request_priority priority, bool running) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (!must_yield(priority))
+        return;
+
+    class_state& state = get_class(priority);
+    if (running) {
+        --state.running;
+        _condition.notify_all();
+    }
+    _condition.wait(lock, [this, priority] { return !must_yield(priority); });
+    if (running)
+        ++state.running;
+}
+
+std::string libclang_vim::scheduler::get_stats() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::string ret = "'capacity':" + std::to_string(_capacity) + ",";
+    for (unsigned i = 0; i < request_priority_count; ++i) {
+        const class_state& state = _classes[i];
+        ret += "'" + std::string(priority_names[i]) + "':{";
+        ret += "'waiting':" + std::to_string(state.waiting) + ",";
+        ret += "'running':" + std::to_string(state.running) + ",";
+        ret += "'admitted':" + std::to_string(state.admitted) + ",";
+        ret += "'wait_time':" + stringize_seconds(state.total_wait) + ",";
+        ret += "'max_wait_time':" + stringize_seconds(state.max_wait) + ",},";
+    }
+    return ret;
+}
+
+libclang_vim::scheduler& libclang_vim::get_scheduler() {
+    static scheduler instance(get_default_jobs());
+    return instance;
+}
+
+libclang_vim::scheduler_slot::scheduler_slot(
+    request_priority priority, scheduler::clock::time_point queued,
+    bool enqueued)
+    : _priority(priority), _previous(current_slot) {
+    if (_previous)
+        _priority = _previous->_priority;
+    else
+        get_scheduler().admit(_priority, queued, enqueued);
+    current_slot = this;
+}
+
+libclang_vim::scheduler_slot::~scheduler_slot() {
+    current_slot = _previous;
+    if (!_previous)
+        get_scheduler().release(_priority);
+}
+
+libclang_vim::request_priority
+libclang_vim::scheduler_slot::get_priority() const {
+    return _priority;
+}
+
+libclang_vim::request_priority libclang_vim::get_current_priority() {
+    return current_slot ? current_slot->get_priority()
+                        : request_priority::background;
+}
+
+void libclang_vim::yield_to_higher_priority(request_priority priority) {
+    if (current_slot)
+        get_scheduler().yield(current_slot->get_priority(), true);
+    else
+        get_scheduler().yield(priority, false);
+}
+
+const char* libclang_vim::get_scheduler_stats() {
+    thread_local std::string vimson;
+    vimson = "{" + get_scheduler().get_stats() + "}";
+    return vimson.c_str();
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,134 @@
+#if !defined LIBCLANG_VIM_SCHEDULER_HPP_INCLUDED
+#define LIBCLANG_VIM_SCHEDULER_HPP_INCLUDED
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+namespace libclang_vim {
+
+/// Classes of work competing for libclang, most urgent first.
+enum class request_priority {
+    /// Queries at the cursor and completion: the user waits for them.
+    interactive,
+    /// Whole-buffer queries and diagnostics of the buffers on screen.
+    visible,
+    /// Project-wide parses, e.g. indexing and diagnostics sweeps.
+    background
+};
+
+const unsigned request_priority_count = 3;
+
+/// Returns the class called name: "interactive", "visible" or "background".
+/// Returns false if name is none of them.
+bool parse_request_priority(const std::string& name, request_priority& ret);
+
+/// Class of a libcall() function by name: project-wide parses are
+/// background, whole-buffer queries are visible, the rest is interactive.
+request_priority get_default_priority(const std::string& function);
+
+/// Admits work by class: interactive work is admitted immediately, visible
+/// work when fewer than capacity interactive and visible calls run, and
+/// background work when no work of a higher class runs or waits, and fewer
+/// than capacity calls run in total. Waiting work of a higher class is
+/// always admitted first.
+class scheduler {
+  public:
+    using clock = std::chrono::steady_clock;
+
+  private:
+    struct class_state {
+        /// Queued or waiting for admission.
+        unsigned waiting;
+        unsigned running;
+        unsigned long admitted;
+        clock::duration total_wait;
+        clock::duration max_wait;
+
+        class_state();
+    };
+
+    const unsigned _capacity;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    class_state _classes[request_priority_count];
+
+    class_state& get_class(request_priority priority);
+
+    bool can_admit(request_priority priority);
+
+    bool must_yield(request_priority priority);
+
+  public:
+    explicit scheduler(unsigned capacity);
+    scheduler(const scheduler&) = delete;
+    scheduler& operator=(const scheduler&) = delete;
+
+    /// Counts work that is queued elsewhere, e.g. by the server, and will be
+    /// admitted later, so lower classes already yield to it.
+    void enqueue(request_priority priority);
+
+    /// Stops counting work of enqueue() that won't be admitted, e.g. because
+    /// it was cancelled.
+    void dequeue(request_priority priority);
+
+    /// Waits until work of priority may run. queued is when it was
+    /// requested, for the statistics; enqueued tells if enqueue() counted
+    /// it.
+    void admit(request_priority priority, clock::time_point queued,
+               bool enqueued);
+
+    void release(request_priority priority);
+
+    /// Called by long work between translation units: while work of a
+    /// higher class runs or waits, gives up running (if running is set) and
+    /// waits.
+    void yield(request_priority priority, bool running);
+
+    /// Per class: "'waiting':..,'running':..,'admitted':..,'wait_time':..,
+    /// 'max_wait_time':..", wait times in seconds.
+    std::string get_stats();
+};
+
+/// The scheduler of the process, with one slot per core.
+scheduler& get_scheduler();
+
+/// Admits the current thread's work at a priority while the slot lives. A
+/// slot inside another one of the same thread is admitted with it.
+class scheduler_slot {
+    request_priority _priority;
+    const scheduler_slot* _previous;
+
+  public:
+    explicit scheduler_slot(
+        request_priority priority,
+        scheduler::clock::time_point queued = scheduler::clock::now(),
+        bool enqueued = false);
+
+    scheduler_slot(const scheduler_slot&) = delete;
+
+    scheduler_slot& operator=(const scheduler_slot&) = delete;
+
+    ~scheduler_slot();
+
+    request_priority get_priority() const;
+};
+
+/// Priority of the innermost slot of the current thread, or background
+/// without a slot, e.g. for project-wide work started by libcall().
+request_priority get_current_priority();
+
+/// Yields work of priority to the higher classes between translation units,
+/// see scheduler::yield(). The slot of the current thread, if any, is given
+/// up meanwhile; helper threads without a slot just wait.
+void yield_to_higher_priority(request_priority priority);
+
+/// Wrapper around scheduler::get_stats(), for all classes.
+const char* get_scheduler_stats();
+
+} // namespace libclang_vim
+
+#endif // LIBCLANG_VIM_SCHEDULER_HPP_INCLUDED
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,44 @@
+#include "session.hpp"
+
+namespace {
+
+thread_local libclang_vim::session* current_session = nullptr;
+}
+
+libclang_vim::session::session()
+    : _completion(create_completion_session()), _memo(create_query_memo()) {}
+
+libclang_vim::translation_unit_cache&
+libclang_vim::session::get_translation_unit_cache() {
+    return _translation_units;
+}
+
+libclang_vim::completion_session&
+libclang_vim::session::get_completion_session() {
+    return *_completion;
+}
+
+libclang_vim::query_memo& libclang_vim::session::get_query_memo() {
+    return *_memo;
+}
+
+libclang_vim::session_scope::session_scope(session& s)
+    : _previous(current_session) {
+    current_session = &s;
+}
+
+libclang_vim::session_scope::~session_scope() {
+    current_session = _previous;
+}
+
+libclang_vim::session& libclang_vim::get_current_session() {
+    if (current_session)
+        return *current_session;
+
+    static session process_session;
+    return process_session;
+}
+
+bool libclang_vim::has_session_scope() { return current_session != nullptr; }
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
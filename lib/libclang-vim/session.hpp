@@ -0,0 +1,60 @@
+#if !defined LIBCLANG_VIM_SESSION_HPP_INCLUDED
+#define LIBCLANG_VIM_SESSION_HPP_INCLUDED
+
+#include <memory>
+
+#include "completion.hpp"
+#include "query_memo.hpp"
+#include "translation_unit_cache.hpp"
+
+namespace libclang_vim {
+
+/// State that queries keep between calls: the cached translation units, the
+/// last completion results and the memoized query results. The libcall()
+/// entry points share a process-wide session, hosts can create their own
+/// ones, so independent queries don't see each other's state.
+class session {
+    translation_unit_cache _translation_units;
+    std::shared_ptr<completion_session> _completion;
+    std::shared_ptr<query_memo> _memo;
+
+  public:
+    session();
+    session(const session&) = delete;
+    session& operator=(const session&) = delete;
+
+    translation_unit_cache& get_translation_unit_cache();
+
+    completion_session& get_completion_session();
+
+    query_memo& get_query_memo();
+};
+
+/// Makes s the session of the queries running on the current thread, while
+/// the scope lives.
+class session_scope {
+    session* _previous;
+
+  public:
+    session_scope(session& s);
+
+    session_scope(const session_scope&) = delete;
+
+    session_scope& operator=(const session_scope&) = delete;
+
+    ~session_scope();
+};
+
+/// The session of the innermost session_scope of the current thread, or the
+/// process-wide one.
+session& get_current_session();
+
+/// If a host's session runs the queries of the current thread, see
+/// session_scope.
+bool has_session_scope();
+
+} // namespace libclang_vim
+
+#endif // LIBCLANG_VIM_SESSION_HPP_INCLUDED
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -217,4 +217,41 @@ std::string libclang_vim::stringize_extent(CXCursor const& cursor) {
     }
 }
 
+std::string libclang_vim::stringize_diagnostic_severity(
+    CXDiagnosticSeverity const& severity) {
+    switch (severity) {
+    case CXDiagnostic_Ignored:
+        return "ignored";
+    case CXDiagnostic_Note:
+        return "note";
+    case CXDiagnostic_Warning:
+        return "warning";
+    case CXDiagnostic_Error:
+        return "error";
+    case CXDiagnostic_Fatal:
+        return "fatal";
+    }
+    return "";
+}
+
+std::string libclang_vim::stringize_diagnostics(
+    CXTranslationUnit const& translation_unit) {
+    std::string result = "[";
+    unsigned num_diagnostics = clang_getNumDiagnostics(translation_unit);
+    for (unsigned i = 0; i < num_diagnostics; ++i) {
+        CXDiagnostic diagnostic = clang_getDiagnostic(translation_unit, i);
+        if (diagnostic) {
+            result += "{'severity': '" +
+                      stringize_diagnostic_severity(
+                          clang_getDiagnosticSeverity(diagnostic)) +
+                      "', ";
+            result +=
+                stringize_location(clang_getDiagnosticLocation(diagnostic)) +
+                "}, ";
+        }
+        clang_disposeDiagnostic(diagnostic);
+    }
+    return result + "]";
+}
+
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
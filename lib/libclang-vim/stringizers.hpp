@@ -39,6 +39,10 @@ std::string stringize_range(CXSourceRange const& range);
 
 std::string stringize_extent(CXCursor const& cursor);
 
+std::string stringize_diagnostic_severity(CXDiagnosticSeverity const& severity);
+
+std::string stringize_diagnostics(CXTranslationUnit const& translation_unit);
+
 } // namespace libclang_vim
 
 #endif // LIBCLANG_VIM_STRINGIZERS_HPP_INCLUDED
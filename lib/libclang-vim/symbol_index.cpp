@@ -0,0 +1,1126 @@
+#include "symbol_index.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <set>
+#include <sstream>
+#include <tuple>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <clang-c/Index.h>
+
+#include "helpers.hpp"
+
+namespace {
+
+// The file starts with a header: magic, version and the number of sections,
+// followed by the section table. Integers are stored in native byte order,
+// the magic is only valid on a little-endian machine.
+const char index_magic[8] = {'L', 'C', 'V', 'I', 'N', 'D', 'E', 'X'};
+const uint32_t index_version = 7;
+const size_t header_size = 16;
+
+/// One entry of the section table: kind, count, offset and size.
+const size_t section_entry_size = 24;
+
+enum section_kind : uint32_t {
+    /// uint32_t offsets into string_bytes, count + 1 of them.
+    string_offsets = 1,
+    string_bytes = 2,
+    /// Sorted by USR: USR string id, number of occurrences, offset in
+    /// postings, qualified name string id, CXIdxEntityKind.
+    symbols = 3,
+    /// Occurrences of each symbol, sorted by file, line and column. Each one
+    /// is varint(file id delta), varint(line delta, or line for a new file),
+    /// varint(column << 3 | role).
+    postings = 4,
+    /// Sorted by name: name string id, owner string id.
+    files = 5,
+    /// Sorted by main file: main file string id, number of inclusions,
+    /// arguments hash, index of the first inclusion.
+    units = 6,
+    /// File string id, padding, content hash.
+    inclusions = 7,
+    /// Sorted by character: lowercase character of a qualified name, number
+    /// of symbols, offset in name_character_postings.
+    name_characters = 8,
+    /// Symbols of each character, as varint deltas of symbol table indexes.
+    name_character_postings = 9,
+    /// Sorted by included file, includer and line: included file string id,
+    /// includer string id, line, column.
+    includes = 10,
+};
+
+const size_t symbol_record_size = 24;
+const size_t file_record_size = 8;
+const size_t unit_record_size = 24;
+const size_t inclusion_record_size = 16;
+const size_t name_character_record_size = 16;
+const size_t include_record_size = 16;
+
+void append_u32(std::string& out, uint32_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void append_u64(std::string& out, uint64_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void append_varint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+uint32_t read_u32(const char* data) {
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+uint64_t read_u64(const char* data) {
+    uint64_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+/// Writes all of data to fd, retrying short writes.
+bool write_all(int fd, const std::string& data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        const ssize_t ret =
+            write(fd, data.data() + written, data.size() - written);
+        if (ret < 0)
+            return false;
+        written += ret;
+    }
+    return true;
+}
+
+bool read_varint(const char*& data, const char* end, uint64_t& value) {
+    value = 0;
+    for (unsigned shift = 0; data < end && shift < 64; shift += 7) {
+        const unsigned char byte = *data++;
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+/// Assigns ids to strings, in sorted order.
+class string_table {
+    std::map<std::string, uint32_t> _ids;
+
+  public:
+    void add(const std::string& s) { _ids.insert(std::make_pair(s, 0)); }
+
+    /// Call after the last add().
+    void assign_ids() {
+        uint32_t id = 0;
+        for (auto& entry : _ids)
+            entry.second = id++;
+    }
+
+    uint32_t get_id(const std::string& s) const { return _ids.at(s); }
+
+    void write(std::string& offsets, std::string& bytes) const {
+        for (const auto& entry : _ids) {
+            append_u32(offsets, bytes.size());
+            bytes += entry.first;
+        }
+        append_u32(offsets, bytes.size());
+    }
+
+    size_t size() const { return _ids.size(); }
+};
+
+/// Returns the part of a qualified name after the last "::".
+std::string get_unqualified_name(const std::string& name) {
+    const size_t found = name.rfind("::");
+    return found == std::string::npos ? name : name.substr(found + 2);
+}
+
+/// Keys of the character index for a string: its distinct characters,
+/// lowercase. A name can be a fuzzy (subsequence) match of a query only if it
+/// has all keys of the query, so the index doesn't miss abbreviations like
+/// "fbr" for "foo_bar", unlike a substring (trigram) index.
+std::vector<uint32_t> get_character_keys(const std::string& s) {
+    std::vector<uint32_t> ret;
+    // The <cctype> functions take unsigned char values, the bytes of UTF-8
+    // sequences are negative as plain char.
+    for (char c : s)
+        ret.push_back(std::tolower(static_cast<unsigned char>(c)));
+    std::sort(ret.begin(), ret.end());
+    ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+    return ret;
+}
+
+const char* get_entity_kind_spelling(unsigned kind) {
+    switch (kind) {
+    case CXIdxEntity_Typedef:
+        return "typedef";
+    case CXIdxEntity_Function:
+        return "function";
+    case CXIdxEntity_Variable:
+        return "variable";
+    case CXIdxEntity_Field:
+        return "field";
+    case CXIdxEntity_EnumConstant:
+        return "enum_constant";
+    case CXIdxEntity_Enum:
+        return "enum";
+    case CXIdxEntity_Struct:
+        return "struct";
+    case CXIdxEntity_Union:
+        return "union";
+    case CXIdxEntity_CXXClass:
+        return "class";
+    case CXIdxEntity_CXXNamespace:
+        return "namespace";
+    case CXIdxEntity_CXXNamespaceAlias:
+        return "namespace_alias";
+    case CXIdxEntity_CXXStaticVariable:
+        return "static_variable";
+    case CXIdxEntity_CXXStaticMethod:
+        return "static_method";
+    case CXIdxEntity_CXXInstanceMethod:
+        return "method";
+    case CXIdxEntity_CXXConstructor:
+        return "constructor";
+    case CXIdxEntity_CXXDestructor:
+        return "destructor";
+    case CXIdxEntity_CXXConversionFunction:
+        return "conversion_function";
+    case CXIdxEntity_CXXTypeAlias:
+        return "type_alias";
+    default:
+        return "unexposed";
+    }
+}
+
+/// Among equally good matches, types come first, then functions, then the
+/// rest.
+int get_entity_kind_weight(unsigned kind) {
+    switch (kind) {
+    case CXIdxEntity_Typedef:
+    case CXIdxEntity_Enum:
+    case CXIdxEntity_Struct:
+    case CXIdxEntity_Union:
+    case CXIdxEntity_CXXClass:
+    case CXIdxEntity_CXXTypeAlias:
+        return 2;
+    case CXIdxEntity_Function:
+    case CXIdxEntity_CXXStaticMethod:
+    case CXIdxEntity_CXXInstanceMethod:
+    case CXIdxEntity_CXXConstructor:
+    case CXIdxEntity_CXXConversionFunction:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/// A symbol that matches a search query.
+struct symbol_match {
+    uint32_t symbol;
+    int score;
+    int weight;
+    std::string name;
+};
+
+bool is_better_match(const symbol_match& a, const symbol_match& b) {
+    if (a.score != b.score)
+        return a.score > b.score;
+    if (a.weight != b.weight)
+        return a.weight > b.weight;
+    if (a.name.size() != b.name.size())
+        return a.name.size() < b.name.size();
+    return a.name < b.name;
+}
+
+struct posting {
+    uint32_t file;
+    const libclang_vim::symbol_occurrence* occurrence;
+};
+
+struct include_edge {
+    uint32_t included;
+    uint32_t includer;
+    unsigned line;
+    unsigned col;
+
+    bool operator<(const include_edge& other) const {
+        if (included != other.included)
+            return included < other.included;
+        if (includer != other.includer)
+            return includer < other.includer;
+        return line < other.line;
+    }
+};
+}
+
+std::string
+libclang_vim::stringize_occurrence_role(occurrence_role role) {
+    switch (role) {
+    case occurrence_role::declaration:
+        return "declaration";
+    case occurrence_role::definition:
+        return "definition";
+    case occurrence_role::reference:
+        return "reference";
+    case occurrence_role::dynamic_call:
+        return "dynamic_call";
+    case occurrence_role::override:
+        return "override";
+    }
+    return "";
+}
+
+void libclang_vim::symbol_index::set_shard(const std::string& file,
+                                           file_shard shard) {
+    std::sort(shard.occurrences.begin(), shard.occurrences.end(),
+              [](const symbol_occurrence& a, const symbol_occurrence& b) {
+                  if (a.line != b.line)
+                      return a.line < b.line;
+                  return a.col < b.col;
+              });
+    std::sort(shard.includes.begin(), shard.includes.end(),
+              [](const include_directive& a, const include_directive& b) {
+                  return a.line < b.line;
+              });
+    _files[file] = std::move(shard);
+}
+
+void libclang_vim::symbol_index::set_translation_unit(
+    const std::string& main_file, translation_unit_record record) {
+    _units[main_file] = std::move(record);
+}
+
+const std::map<std::string, libclang_vim::translation_unit_record>&
+libclang_vim::symbol_index::get_translation_units() const {
+    return _units;
+}
+
+std::vector<std::string> libclang_vim::symbol_index::remove_translation_unit(
+    const std::string& main_file) {
+    _units.erase(main_file);
+
+    std::vector<std::string> ret;
+    for (auto it = _files.begin(); it != _files.end();) {
+        if (it->second.owner == main_file) {
+            ret.push_back(it->first);
+            it = _files.erase(it);
+        } else
+            ++it;
+    }
+    return ret;
+}
+
+std::map<std::string, std::string>
+libclang_vim::symbol_index::get_file_owners() const {
+    std::map<std::string, std::string> ret;
+    for (const auto& file : _files)
+        ret[file.first] = file.second.owner;
+    return ret;
+}
+
+size_t libclang_vim::symbol_index::get_file_count() const {
+    return _files.size();
+}
+
+bool libclang_vim::symbol_index::save(const std::string& path) const {
+    string_table strings;
+    std::map<std::string, std::vector<posting>> postings_by_usr;
+    uint32_t file_id = 0;
+    for (const auto& file : _files) {
+        strings.add(file.first);
+        strings.add(file.second.owner);
+        for (const auto& directive : file.second.includes)
+            strings.add(directive.file);
+        for (const auto& occurrence : file.second.occurrences) {
+            strings.add(occurrence.usr);
+            posting entry;
+            entry.file = file_id;
+            entry.occurrence = &occurrence;
+            // Files are visited in order, so each list stays sorted.
+            postings_by_usr[occurrence.usr].push_back(entry);
+        }
+        ++file_id;
+    }
+    for (const auto& unit : _units) {
+        strings.add(unit.first);
+        for (const auto& inclusion : unit.second.inclusions)
+            strings.add(inclusion.first);
+    }
+    // The first file that declares a symbol provides its name.
+    std::map<std::string, symbol_info> infos;
+    for (const auto& file : _files) {
+        for (const auto& symbol : file.second.symbols) {
+            infos.insert(symbol);
+            strings.add(symbol.second.name);
+        }
+    }
+    strings.add(std::string());
+    strings.assign_ids();
+
+    std::string string_offsets_data;
+    std::string string_bytes_data;
+    strings.write(string_offsets_data, string_bytes_data);
+
+    std::string symbols_data;
+    std::string postings_data;
+    std::map<uint32_t, std::vector<uint32_t>> symbols_by_key;
+    uint32_t symbol_id = 0;
+    for (const auto& symbol : postings_by_usr) {
+        symbol_info info;
+        info.kind = 0;
+        auto const it = infos.find(symbol.first);
+        if (it != infos.end())
+            info = it->second;
+        append_u32(symbols_data, strings.get_id(symbol.first));
+        append_u32(symbols_data, symbol.second.size());
+        append_u64(symbols_data, postings_data.size());
+        append_u32(symbols_data, strings.get_id(info.name));
+        append_u32(symbols_data, info.kind);
+        for (uint32_t key : get_character_keys(info.name))
+            symbols_by_key[key].push_back(symbol_id);
+        ++symbol_id;
+
+        uint32_t previous_file = 0;
+        unsigned previous_line = 0;
+        for (const auto& entry : symbol.second) {
+            const symbol_occurrence& occurrence = *entry.occurrence;
+            append_varint(postings_data, entry.file - previous_file);
+            if (entry.file != previous_file)
+                previous_line = 0;
+            append_varint(postings_data, occurrence.line - previous_line);
+            append_varint(postings_data,
+                          static_cast<uint64_t>(occurrence.col) << 3 |
+                              static_cast<uint64_t>(occurrence.role));
+            previous_file = entry.file;
+            previous_line = occurrence.line;
+        }
+    }
+
+    std::string files_data;
+    for (const auto& file : _files) {
+        append_u32(files_data, strings.get_id(file.first));
+        append_u32(files_data, strings.get_id(file.second.owner));
+    }
+
+    std::string units_data;
+    std::string inclusions_data;
+    uint64_t inclusion_count = 0;
+    for (const auto& unit : _units) {
+        append_u32(units_data, strings.get_id(unit.first));
+        append_u32(units_data, unit.second.inclusions.size());
+        append_u64(units_data, unit.second.args_hash);
+        append_u64(units_data, inclusion_count);
+        for (const auto& inclusion : unit.second.inclusions) {
+            append_u32(inclusions_data, strings.get_id(inclusion.first));
+            append_u32(inclusions_data, 0);
+            append_u64(inclusions_data, inclusion.second);
+        }
+        inclusion_count += unit.second.inclusions.size();
+    }
+
+    std::vector<include_edge> edges;
+    for (const auto& file : _files) {
+        for (const auto& directive : file.second.includes) {
+            include_edge edge;
+            edge.included = strings.get_id(directive.file);
+            edge.includer = strings.get_id(file.first);
+            edge.line = directive.line;
+            edge.col = directive.col;
+            edges.push_back(edge);
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    std::string includes_data;
+    for (const auto& edge : edges) {
+        append_u32(includes_data, edge.included);
+        append_u32(includes_data, edge.includer);
+        append_u32(includes_data, edge.line);
+        append_u32(includes_data, edge.col);
+    }
+
+    std::string name_characters_data;
+    std::string name_character_postings_data;
+    for (const auto& key : symbols_by_key) {
+        append_u32(name_characters_data, key.first);
+        append_u32(name_characters_data, key.second.size());
+        append_u64(name_characters_data, name_character_postings_data.size());
+        uint32_t previous = 0;
+        for (uint32_t symbol : key.second) {
+            append_varint(name_character_postings_data, symbol - previous);
+            previous = symbol;
+        }
+    }
+
+    struct section_data {
+        section_kind kind;
+        uint32_t count;
+        const std::string* data;
+    };
+    const section_data sections[] = {
+        {section_kind::string_offsets, static_cast<uint32_t>(strings.size()),
+         &string_offsets_data},
+        {section_kind::string_bytes, 0, &string_bytes_data},
+        {section_kind::symbols, static_cast<uint32_t>(postings_by_usr.size()),
+         &symbols_data},
+        {section_kind::postings, 0, &postings_data},
+        {section_kind::files, static_cast<uint32_t>(_files.size()),
+         &files_data},
+        {section_kind::units, static_cast<uint32_t>(_units.size()),
+         &units_data},
+        {section_kind::inclusions, static_cast<uint32_t>(inclusion_count),
+         &inclusions_data},
+        {section_kind::name_characters,
+         static_cast<uint32_t>(symbols_by_key.size()), &name_characters_data},
+        {section_kind::name_character_postings, 0,
+         &name_character_postings_data},
+        {section_kind::includes, static_cast<uint32_t>(edges.size()),
+         &includes_data},
+    };
+
+    std::string header(index_magic, sizeof(index_magic));
+    append_u32(header, index_version);
+    append_u32(header, sizeof(sections) / sizeof(sections[0]));
+    uint64_t offset = header_size + sizeof(sections) / sizeof(sections[0]) *
+                                        section_entry_size;
+    for (const auto& section : sections) {
+        append_u32(header, section.kind);
+        append_u32(header, section.count);
+        append_u64(header, offset);
+        append_u64(header, section.data->size());
+        offset += section.data->size();
+    }
+
+    // A unique temporary file next to path: concurrent writers, e.g. two Vim
+    // instances updating the same project, don't mix their indexes.
+    std::vector<char> temp_path(path.begin(), path.end());
+    const char suffix[] = ".XXXXXX";
+    temp_path.insert(temp_path.end(), suffix, suffix + sizeof(suffix));
+    int fd = mkstemp(temp_path.data());
+    if (fd < 0)
+        return false;
+
+    bool written = fchmod(fd, 0644) == 0 && write_all(fd, header);
+    for (const auto& section : sections)
+        written = written && write_all(fd, *section.data);
+    // The rename must not make an index visible before its contents.
+    written = written && fsync(fd) == 0;
+    written = close(fd) == 0 && written;
+
+    // Readers either see the old or the new index, never a partial one.
+    if (!written || std::rename(temp_path.data(), path.c_str()) != 0) {
+        unlink(temp_path.data());
+        return false;
+    }
+    return true;
+}
+
+void libclang_vim::symbol_index::load(const mapped_symbol_index& mapped) {
+    _files.clear();
+    _units.clear();
+
+    std::vector<std::string> file_names;
+    for (size_t i = 0; i < mapped._files.count; ++i) {
+        const char* record = mapped._files.data + i * file_record_size;
+        file_names.push_back(mapped.get_string(read_u32(record)));
+        _files[file_names.back()].owner =
+            mapped.get_string(read_u32(record + 4));
+    }
+
+    std::vector<std::pair<uint32_t, symbol_occurrence>> occurrences;
+    for (size_t i = 0; i < mapped._symbols.count; ++i) {
+        occurrences.clear();
+        mapped.get_occurrences(mapped._symbols.data + i * symbol_record_size,
+                               occurrences);
+        for (const auto& occurrence : occurrences)
+            _files[file_names[occurrence.first]].occurrences.push_back(
+                occurrence.second);
+
+        // Store the name next to the first declaration.
+        const char* record = mapped._symbols.data + i * symbol_record_size;
+        symbol_info info;
+        info.name = mapped.get_string(read_u32(record + 16));
+        info.kind = read_u32(record + 20);
+        auto declaration = std::find_if(
+            occurrences.begin(), occurrences.end(),
+            [](const std::pair<uint32_t, symbol_occurrence>& occurrence) {
+                return occurrence.second.role ==
+                           occurrence_role::declaration ||
+                       occurrence.second.role == occurrence_role::definition;
+            });
+        if (!info.name.empty() && declaration != occurrences.end())
+            _files[file_names[declaration->first]]
+                .symbols[declaration->second.usr] = info;
+    }
+    for (size_t i = 0; i < mapped._includes.count; ++i) {
+        const char* record = mapped._includes.data + i * include_record_size;
+        auto const includer =
+            _files.find(mapped.get_string(read_u32(record + 4)));
+        if (includer == _files.end())
+            continue;
+
+        include_directive directive;
+        directive.file = mapped.get_string(read_u32(record));
+        directive.line = read_u32(record + 8);
+        directive.col = read_u32(record + 12);
+        includer->second.includes.push_back(directive);
+    }
+    for (auto& file : _files)
+        set_shard(file.first, std::move(file.second));
+
+    for (size_t i = 0; i < mapped._units.count; ++i) {
+        const char* record = mapped._units.data + i * unit_record_size;
+        translation_unit_record& unit =
+            _units[mapped.get_string(read_u32(record))];
+        const uint32_t count = read_u32(record + 4);
+        unit.args_hash = read_u64(record + 8);
+        const uint64_t first = read_u64(record + 16);
+        for (uint64_t j = first;
+             j < first + count && j < mapped._inclusions.count; ++j) {
+            const char* inclusion =
+                mapped._inclusions.data + j * inclusion_record_size;
+            unit.inclusions[mapped.get_string(read_u32(inclusion))] =
+                read_u64(inclusion + 8);
+        }
+    }
+}
+
+libclang_vim::mapped_symbol_index::mapped_symbol_index()
+    : _data(nullptr), _size(0), _string_offsets(), _string_bytes(),
+      _symbols(), _postings(), _files(), _units(), _inclusions(),
+      _name_characters(), _name_character_postings(), _includes() {}
+
+libclang_vim::mapped_symbol_index::~mapped_symbol_index() {
+    if (_data)
+        munmap(_data, _size);
+}
+
+bool libclang_vim::mapped_symbol_index::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat buffer;
+    if (fstat(fd, &buffer) != 0 ||
+        static_cast<size_t>(buffer.st_size) < header_size) {
+        close(fd);
+        return false;
+    }
+    _size = buffer.st_size;
+    // The writer never modifies a file in place, so the mapping stays
+    // consistent even if the index is updated meanwhile.
+    _data = mmap(nullptr, _size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (_data == MAP_FAILED) {
+        _data = nullptr;
+        return false;
+    }
+
+    const char* data = static_cast<const char*>(_data);
+    if (std::memcmp(data, index_magic, sizeof(index_magic)) != 0 ||
+        read_u32(data + 8) != index_version)
+        return false;
+
+    const uint32_t section_count = read_u32(data + 12);
+    if (header_size + section_count * section_entry_size > _size)
+        return false;
+
+    for (uint32_t i = 0; i < section_count; ++i) {
+        const char* entry = data + header_size + i * section_entry_size;
+        const uint64_t offset = read_u64(entry + 8);
+        const uint64_t size = read_u64(entry + 16);
+        if (offset > _size || size > _size - offset)
+            return false;
+
+        section current;
+        current.data = data + offset;
+        current.count = read_u32(entry + 4);
+        current.size = size;
+        switch (read_u32(entry)) {
+        case section_kind::string_offsets:
+            _string_offsets = current;
+            break;
+        case section_kind::string_bytes:
+            _string_bytes = current;
+            break;
+        case section_kind::symbols:
+            _symbols = current;
+            break;
+        case section_kind::postings:
+            _postings = current;
+            break;
+        case section_kind::files:
+            _files = current;
+            break;
+        case section_kind::units:
+            _units = current;
+            break;
+        case section_kind::inclusions:
+            _inclusions = current;
+            break;
+        case section_kind::name_characters:
+            _name_characters = current;
+            break;
+        case section_kind::name_character_postings:
+            _name_character_postings = current;
+            break;
+        case section_kind::includes:
+            _includes = current;
+            break;
+        }
+    }
+
+    return _string_offsets.size >= (_string_offsets.count + 1) * 4 &&
+           _symbols.size >= _symbols.count * symbol_record_size &&
+           _files.size >= _files.count * file_record_size &&
+           _units.size >= _units.count * unit_record_size &&
+           _inclusions.size >= _inclusions.count * inclusion_record_size &&
+           _name_characters.size >=
+               _name_characters.count * name_character_record_size &&
+           _includes.size >= _includes.count * include_record_size;
+}
+
+std::string libclang_vim::mapped_symbol_index::get_string(uint32_t id) const {
+    if (id >= _string_offsets.count)
+        return std::string();
+
+    const uint32_t begin = read_u32(_string_offsets.data + id * 4);
+    const uint32_t end = read_u32(_string_offsets.data + (id + 1) * 4);
+    if (begin > end || end > _string_bytes.size)
+        return std::string();
+    return std::string(_string_bytes.data + begin, end - begin);
+}
+
+bool libclang_vim::mapped_symbol_index::find_string(const std::string& s,
+                                                    uint32_t& id) const {
+    size_t first = 0;
+    size_t last = _string_offsets.count;
+    while (first < last) {
+        const size_t middle = first + (last - first) / 2;
+        const int result = get_string(middle).compare(s);
+        if (result == 0) {
+            id = middle;
+            return true;
+        }
+        if (result < 0)
+            first = middle + 1;
+        else
+            last = middle;
+    }
+    return false;
+}
+
+bool libclang_vim::mapped_symbol_index::is_translation_unit(
+    uint32_t file) const {
+    size_t first = 0;
+    size_t last = _units.count;
+    while (first < last) {
+        const size_t middle = first + (last - first) / 2;
+        const uint32_t main_file =
+            read_u32(_units.data + middle * unit_record_size);
+        if (main_file == file)
+            return true;
+        if (main_file < file)
+            first = middle + 1;
+        else
+            last = middle;
+    }
+    return false;
+}
+
+const char*
+libclang_vim::mapped_symbol_index::find_symbol(const std::string& usr) const {
+    size_t first = 0;
+    size_t last = _symbols.count;
+    while (first < last) {
+        const size_t middle = first + (last - first) / 2;
+        const char* symbol = _symbols.data + middle * symbol_record_size;
+        const int result = get_string(read_u32(symbol)).compare(usr);
+        if (result == 0)
+            return symbol;
+        if (result < 0)
+            first = middle + 1;
+        else
+            last = middle;
+    }
+    return nullptr;
+}
+
+std::vector<uint32_t> libclang_vim::mapped_symbol_index::get_candidates(
+    const std::string& query) const {
+    std::vector<std::vector<uint32_t>> lists;
+    for (uint32_t key : get_character_keys(query)) {
+        // Binary search in the character table.
+        size_t first = 0;
+        size_t last = _name_characters.count;
+        while (first < last) {
+            const size_t middle = first + (last - first) / 2;
+            if (read_u32(_name_characters.data +
+                         middle * name_character_record_size) < key)
+                first = middle + 1;
+            else
+                last = middle;
+        }
+        const char* record =
+            _name_characters.data + first * name_character_record_size;
+        if (first == _name_characters.count || read_u32(record) != key)
+            return std::vector<uint32_t>();
+
+        const uint32_t count = read_u32(record + 4);
+        const uint64_t offset = read_u64(record + 8);
+        if (offset > _name_character_postings.size)
+            return std::vector<uint32_t>();
+        const char* data = _name_character_postings.data + offset;
+        const char* end =
+            _name_character_postings.data + _name_character_postings.size;
+        std::vector<uint32_t> list;
+        list.reserve(count);
+        uint64_t symbol = 0;
+        for (uint32_t i = 0; i < count; ++i) {
+            uint64_t delta;
+            if (!read_varint(data, end, delta))
+                return std::vector<uint32_t>();
+            symbol += delta;
+            list.push_back(symbol);
+        }
+        lists.push_back(std::move(list));
+    }
+    if (lists.empty())
+        return std::vector<uint32_t>();
+
+    // Intersect, starting with the shortest list.
+    std::sort(lists.begin(), lists.end(),
+              [](const std::vector<uint32_t>& a,
+                 const std::vector<uint32_t>& b) {
+                  return a.size() < b.size();
+              });
+    std::vector<uint32_t> ret = lists[0];
+    for (size_t i = 1; i < lists.size() && !ret.empty(); ++i) {
+        std::vector<uint32_t> intersection;
+        std::set_intersection(ret.begin(), ret.end(), lists[i].begin(),
+                              lists[i].end(), std::back_inserter(intersection));
+        ret.swap(intersection);
+    }
+    return ret;
+}
+
+bool libclang_vim::mapped_symbol_index::get_occurrences(
+    const char* symbol,
+    std::vector<std::pair<uint32_t, symbol_occurrence>>& ret) const {
+    const std::string usr = get_string(read_u32(symbol));
+    const uint32_t count = read_u32(symbol + 4);
+    const uint64_t offset = read_u64(symbol + 8);
+    if (offset > _postings.size)
+        return false;
+
+    const char* data = _postings.data + offset;
+    const char* end = _postings.data + _postings.size;
+    uint64_t file = 0;
+    uint64_t line = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        uint64_t file_delta;
+        uint64_t line_delta;
+        uint64_t col_role;
+        if (!read_varint(data, end, file_delta) ||
+            !read_varint(data, end, line_delta) ||
+            !read_varint(data, end, col_role))
+            return false;
+
+        if (file_delta)
+            line = 0;
+        file += file_delta;
+        line += line_delta;
+        const uint64_t role = col_role & 7;
+        if (file >= _files.count ||
+            role > static_cast<uint64_t>(occurrence_role::override))
+            return false;
+
+        symbol_occurrence occurrence;
+        occurrence.usr = usr;
+        occurrence.line = line;
+        occurrence.col = col_role >> 3;
+        occurrence.role = static_cast<occurrence_role>(role);
+        ret.push_back(std::make_pair(file, occurrence));
+    }
+    return true;
+}
+
+std::string libclang_vim::mapped_symbol_index::find_occurrences(
+    const std::string& usr, const std::vector<occurrence_role>& roles) const {
+    std::stringstream ss;
+    ss << "[";
+    const char* symbol = find_symbol(usr);
+    std::vector<std::pair<uint32_t, symbol_occurrence>> occurrences;
+    if (symbol)
+        get_occurrences(symbol, occurrences);
+    for (const auto& entry : occurrences) {
+        const symbol_occurrence& occurrence = entry.second;
+        if (std::find(roles.begin(), roles.end(), occurrence.role) ==
+            roles.end())
+            continue;
+
+        const char* file = _files.data + entry.first * file_record_size;
+        ss << "{'file':'" << escape_single_quotes(get_string(read_u32(file)))
+           << "',";
+        ss << "'line':" << occurrence.line << ",";
+        ss << "'col':" << occurrence.col << ",";
+        ss << "'role':'" << stringize_occurrence_role(occurrence.role)
+           << "'},";
+    }
+    ss << "]";
+    return ss.str();
+}
+
+bool libclang_vim::mapped_symbol_index::has_occurrences(
+    const std::string& usr, occurrence_role role) const {
+    const char* symbol = find_symbol(usr);
+    std::vector<std::pair<uint32_t, symbol_occurrence>> occurrences;
+    if (!symbol || !get_occurrences(symbol, occurrences))
+        return false;
+
+    return std::any_of(
+        occurrences.begin(), occurrences.end(),
+        [role](const std::pair<uint32_t, symbol_occurrence>& occurrence) {
+            return occurrence.second.role == role;
+        });
+}
+
+size_t libclang_vim::mapped_symbol_index::get_occurrence_count(
+    const std::string& usr) const {
+    const char* symbol = find_symbol(usr);
+    return symbol ? read_u32(symbol + 4) : 0;
+}
+
+std::string
+libclang_vim::mapped_symbol_index::search_symbols(const std::string& query,
+                                                  size_t limit) const {
+    // Match qualified names only if the query is qualified.
+    const bool qualified = query.find("::") != std::string::npos;
+    std::vector<symbol_match> matches;
+    for (uint32_t symbol : get_candidates(query)) {
+        if (symbol >= _symbols.count)
+            continue;
+
+        const char* record = _symbols.data + symbol * symbol_record_size;
+        symbol_match match;
+        match.symbol = symbol;
+        match.name = get_string(read_u32(record + 16));
+        match.score = get_fuzzy_score(
+            query, qualified ? match.name : get_unqualified_name(match.name));
+        if (match.name.empty() || match.score < 0)
+            continue;
+
+        match.weight = get_entity_kind_weight(read_u32(record + 20));
+        matches.push_back(match);
+    }
+
+    if (!limit || limit > matches.size())
+        limit = matches.size();
+    std::partial_sort(matches.begin(), matches.begin() + limit, matches.end(),
+                      is_better_match);
+
+    std::stringstream ss;
+    ss << "[";
+    std::vector<std::pair<uint32_t, symbol_occurrence>> occurrences;
+    for (size_t i = 0; i < limit; ++i) {
+        const char* record =
+            _symbols.data + matches[i].symbol * symbol_record_size;
+        occurrences.clear();
+        if (!get_occurrences(record, occurrences) || occurrences.empty())
+            continue;
+
+        // Prefer the definition, then a declaration.
+        auto location = std::find_if(
+            occurrences.begin(), occurrences.end(),
+            [](const std::pair<uint32_t, symbol_occurrence>& occurrence) {
+                return occurrence.second.role == occurrence_role::definition;
+            });
+        if (location == occurrences.end())
+            location = std::find_if(
+                occurrences.begin(), occurrences.end(),
+                [](const std::pair<uint32_t, symbol_occurrence>& occurrence) {
+                    return occurrence.second.role ==
+                           occurrence_role::declaration;
+                });
+        if (location == occurrences.end())
+            location = occurrences.begin();
+
+        const char* file = _files.data + location->first * file_record_size;
+        ss << "{'name':'" << escape_single_quotes(matches[i].name) << "',";
+        ss << "'kind':'" << get_entity_kind_spelling(read_u32(record + 20))
+           << "',";
+        ss << "'file':'" << escape_single_quotes(get_string(read_u32(file)))
+           << "',";
+        ss << "'line':" << location->second.line << ",";
+        ss << "'col':" << location->second.col << "},";
+    }
+    ss << "]";
+    return ss.str();
+}
+
+std::string libclang_vim::mapped_symbol_index::find_includers(
+    const std::string& file) const {
+    uint32_t id;
+    if (!find_string(file, id))
+        return "[]";
+
+    // Breadth-first, so each includer is reported with its shortest depth.
+    std::set<uint32_t> visited;
+    visited.insert(id);
+    std::deque<std::pair<uint32_t, unsigned>> queue;
+    queue.push_back(std::make_pair(id, 0));
+    std::stringstream ss;
+    ss << "[";
+    while (!queue.empty()) {
+        const uint32_t included = queue.front().first;
+        const unsigned depth = queue.front().second + 1;
+        queue.pop_front();
+
+        size_t first = 0;
+        size_t last = _includes.count;
+        while (first < last) {
+            const size_t middle = first + (last - first) / 2;
+            if (read_u32(_includes.data + middle * include_record_size) <
+                included)
+                first = middle + 1;
+            else
+                last = middle;
+        }
+        for (size_t i = first; i < _includes.count; ++i) {
+            const char* record = _includes.data + i * include_record_size;
+            if (read_u32(record) != included)
+                break;
+            const uint32_t includer = read_u32(record + 4);
+            if (!visited.insert(includer).second)
+                continue;
+
+            ss << "{'file':'" << escape_single_quotes(get_string(includer))
+               << "','line':" << read_u32(record + 8) << ",'depth':" << depth
+               << ",'translation_unit':" << is_translation_unit(includer)
+               << "},";
+            queue.push_back(std::make_pair(includer, depth));
+        }
+    }
+    ss << "]";
+    return ss.str();
+}
+
+std::string libclang_vim::mapped_symbol_index::find_dynamic_calls() const {
+    using location = std::tuple<uint32_t, unsigned, unsigned>;
+    struct dynamic_call {
+        location call;
+        /// Index of the called method in the symbol table.
+        size_t method;
+        /// Into overriders.
+        size_t first_overrider;
+        size_t overrider_count;
+    };
+
+    std::vector<dynamic_call> calls;
+    std::vector<location> overriders;
+    std::vector<std::pair<uint32_t, symbol_occurrence>> occurrences;
+    for (size_t i = 0; i < _symbols.count; ++i) {
+        occurrences.clear();
+        if (!get_occurrences(_symbols.data + i * symbol_record_size,
+                             occurrences))
+            continue;
+
+        const size_t first_overrider = overriders.size();
+        const size_t first_call = calls.size();
+        for (const auto& entry : occurrences) {
+            const location at(entry.first, entry.second.line,
+                              entry.second.col);
+            if (entry.second.role == occurrence_role::override)
+                overriders.push_back(at);
+            else if (entry.second.role == occurrence_role::dynamic_call)
+                calls.push_back(dynamic_call{at, i, 0, 0});
+        }
+        for (size_t j = first_call; j < calls.size(); ++j) {
+            calls[j].first_overrider = first_overrider;
+            calls[j].overrider_count = overriders.size() - first_overrider;
+        }
+    }
+
+    // The override occurrences are at the declarations of the overriders,
+    // find out whose declarations they are.
+    std::map<location, std::string> names;
+    for (const auto& overrider : overriders)
+        names[overrider];
+    for (size_t i = 0; i < _symbols.count && !names.empty(); ++i) {
+        const char* record = _symbols.data + i * symbol_record_size;
+        occurrences.clear();
+        if (!get_occurrences(record, occurrences))
+            continue;
+
+        for (const auto& entry : occurrences) {
+            if (entry.second.role != occurrence_role::declaration &&
+                entry.second.role != occurrence_role::definition)
+                continue;
+            auto const name = names.find(
+                location(entry.first, entry.second.line, entry.second.col));
+            if (name != names.end())
+                name->second = get_string(read_u32(record + 16));
+        }
+    }
+
+    // Files are sorted by name, so this sorts by file name, too.
+    std::sort(calls.begin(), calls.end(),
+              [](const dynamic_call& a, const dynamic_call& b) {
+                  return a.call < b.call;
+              });
+    auto const stringize_location = [this](const location& at) {
+        const char* file = _files.data + std::get<0>(at) * file_record_size;
+        std::stringstream ss;
+        ss << "'file':'" << escape_single_quotes(get_string(read_u32(file)))
+           << "',";
+        ss << "'line':" << std::get<1>(at) << ",";
+        ss << "'col':" << std::get<2>(at);
+        return ss.str();
+    };
+    std::stringstream ss;
+    ss << "[";
+    for (const auto& call : calls) {
+        const char* record = _symbols.data + call.method * symbol_record_size;
+        ss << "{" << stringize_location(call.call) << ",";
+        ss << "'method':'"
+           << escape_single_quotes(get_string(read_u32(record + 16)))
+           << "','overriders':[";
+        for (size_t i = 0; i < call.overrider_count; ++i) {
+            const location& overrider = overriders[call.first_overrider + i];
+            ss << "{'name':'" << escape_single_quotes(names[overrider])
+               << "'," << stringize_location(overrider) << "},";
+        }
+        ss << "]},";
+    }
+    ss << "]";
+    return ss.str();
+}
+
+size_t libclang_vim::mapped_symbol_index::get_file_count() const {
+    return _files.count;
+}
+
+size_t libclang_vim::mapped_symbol_index::get_symbol_count() const {
+    return _symbols.count;
+}
+
+std::string libclang_vim::get_symbol_index_path(const std::string& directory) {
+    return directory + "/.libclang-vim-index";
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,207 @@
+#if !defined LIBCLANG_VIM_SYMBOL_INDEX_HPP_INCLUDED
+#define LIBCLANG_VIM_SYMBOL_INDEX_HPP_INCLUDED
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace libclang_vim {
+
+/// dynamic_call is a reference that calls a virtual method through the
+/// vtable. An override is recorded under the USR of the overridden method,
+/// at the declaration of the overrider.
+enum class occurrence_role {
+    declaration,
+    definition,
+    reference,
+    dynamic_call,
+    override
+};
+
+std::string stringize_occurrence_role(occurrence_role role);
+
+/// One occurrence of a symbol inside a file.
+class symbol_occurrence {
+  public:
+    std::string usr;
+    unsigned line;
+    unsigned col;
+    occurrence_role role;
+};
+
+/// Name and kind of a declared symbol, for the workspace symbol search.
+class symbol_info {
+  public:
+    /// Qualified name, e.g. "ns::cls::method".
+    std::string name;
+    /// CXIdxEntityKind of the declaration.
+    unsigned kind;
+};
+
+/// An #include directive, the includer is the file that contains it.
+class include_directive {
+  public:
+    unsigned line;
+    unsigned col;
+    /// The included file.
+    std::string file;
+};
+
+/// Occurrences inside one file. A header is included by many translation
+/// units: only the first one that indexes it records its occurrences.
+class file_shard {
+  public:
+    /// Main file of the translation unit that recorded the occurrences.
+    std::string owner;
+    std::vector<symbol_occurrence> occurrences;
+    /// Symbols declared in the file, by USR.
+    std::map<std::string, symbol_info> symbols;
+    /// Files included by the file, sorted by line.
+    std::vector<include_directive> includes;
+};
+
+/// What a translation unit was indexed from, to decide if it has to be
+/// indexed again.
+class translation_unit_record {
+  public:
+    unsigned long long args_hash;
+    /// Content hashes of the main file and of everything it includes.
+    std::map<std::string, unsigned long long> inclusions;
+};
+
+class mapped_symbol_index;
+
+/// Project-wide map from files to their occurrences, used while indexing.
+/// Queries use mapped_symbol_index, which reads the saved version.
+class symbol_index {
+    std::map<std::string, file_shard> _files;
+    /// Indexed translation units, by main file.
+    std::map<std::string, translation_unit_record> _units;
+
+  public:
+    /// Adds or replaces the occurrences and the includes of file.
+    void set_shard(const std::string& file, file_shard shard);
+
+    void set_translation_unit(const std::string& main_file,
+                              translation_unit_record record);
+
+    const std::map<std::string, translation_unit_record>&
+    get_translation_units() const;
+
+    /// Removes the record of main_file and the shards it owns. Returns the
+    /// files of the removed shards.
+    std::vector<std::string>
+    remove_translation_unit(const std::string& main_file);
+
+    /// Returns the owner of each indexed file.
+    std::map<std::string, std::string> get_file_owners() const;
+
+    size_t get_file_count() const;
+
+    /// Writes the index to path, atomically replacing an older version, so
+    /// readers that still have the old version mapped are not disturbed and
+    /// concurrent writers don't mix their versions.
+    bool save(const std::string& path) const;
+
+    /// Replaces the contents with the ones of a saved index.
+    void load(const mapped_symbol_index& mapped);
+};
+
+/// Read-only view of a saved symbol_index. The file is mapped into memory,
+/// not deserialized: opening it is cheap, and only the pages touched by
+/// queries are read. The file has a table of interned strings, a symbol
+/// table sorted by USR, varint delta-encoded occurrence lists, an index of
+/// the characters in the qualified names of the symbols, and the include
+/// edges sorted by included file.
+class mapped_symbol_index {
+    struct section {
+        const char* data;
+        size_t count;
+        size_t size;
+    };
+
+    void* _data;
+    size_t _size;
+    section _string_offsets;
+    section _string_bytes;
+    section _symbols;
+    section _postings;
+    section _files;
+    section _units;
+    section _inclusions;
+    section _name_characters;
+    section _name_character_postings;
+    section _includes;
+
+    std::string get_string(uint32_t id) const;
+
+    /// Binary search in the string table, strings are stored sorted.
+    bool find_string(const std::string& s, uint32_t& id) const;
+
+    bool is_translation_unit(uint32_t file) const;
+
+    /// Binary search in the symbol table, returns nullptr if usr is unknown.
+    const char* find_symbol(const std::string& usr) const;
+
+    /// Returns the symbol table indexes that may match query: the ones that
+    /// contain all characters of query, ignoring case.
+    std::vector<uint32_t> get_candidates(const std::string& query) const;
+
+    /// Decodes the occurrences of a symbol table entry.
+    bool get_occurrences(
+        const char* symbol,
+        std::vector<std::pair<uint32_t, symbol_occurrence>>& ret) const;
+
+  public:
+    mapped_symbol_index();
+    mapped_symbol_index(const mapped_symbol_index&) = delete;
+    mapped_symbol_index& operator=(const mapped_symbol_index&) = delete;
+    ~mapped_symbol_index();
+
+    /// Maps path and validates its header.
+    bool open(const std::string& path);
+
+    /// Returns "[{'file':'..','line':..,'col':..,'role':'..'},]" for the
+    /// occurrences of usr that have one of the given roles.
+    std::string
+    find_occurrences(const std::string& usr,
+                     const std::vector<occurrence_role>& roles) const;
+
+    bool has_occurrences(const std::string& usr, occurrence_role role) const;
+
+    /// Number of occurrences of usr, whatever their role.
+    size_t get_occurrence_count(const std::string& usr) const;
+
+    /// Returns "[{'name':'..','kind':'..','file':'..','line':..,'col':..},]"
+    /// for the best limit symbols matching query, ranked by fuzzy match
+    /// quality and kind. The location is the definition, or the declaration
+    /// if there is no definition.
+    std::string search_symbols(const std::string& query, size_t limit) const;
+
+    /// Returns "[{'file':'..','line':..,'depth':..,'translation_unit':..},]"
+    /// for the files that include file directly (depth 1) or transitively,
+    /// each one once, with the line of its directive.
+    std::string find_includers(const std::string& file) const;
+
+    /// Returns "[{'file':'..','line':..,'col':..,'method':'..','overriders':
+    /// [{'name':'..','file':'..','line':..,'col':..},]},]" for the dynamic
+    /// calls of the project, sorted by location.
+    std::string find_dynamic_calls() const;
+
+    size_t get_file_count() const;
+
+    size_t get_symbol_count() const;
+
+    friend class symbol_index;
+};
+
+/// Location of the index of the project that has its compile_commands.json
+/// in directory.
+std::string get_symbol_index_path(const std::string& directory);
+
+} // namespace libclang_vim
+
+#endif // LIBCLANG_VIM_SYMBOL_INDEX_HPP_INCLUDED
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
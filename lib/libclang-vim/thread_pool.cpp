@@ -0,0 +1,124 @@
+#include "thread_pool.hpp"
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "scheduler.hpp"
+
+namespace {
+
+/// Items owned by one worker: the owner pops from the front, thieves from the
+/// back.
+class work_queue {
+    std::mutex _mutex;
+    std::deque<std::size_t> _items;
+
+  public:
+    void push(std::size_t item) { _items.push_back(item); }
+
+    bool pop(std::size_t& item) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_items.empty())
+            return false;
+        item = _items.front();
+        _items.pop_front();
+        return true;
+    }
+
+    bool steal(std::size_t& item) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_items.empty())
+            return false;
+        item = _items.back();
+        _items.pop_back();
+        return true;
+    }
+};
+
+void run_worker(std::vector<std::unique_ptr<work_queue>>& queues,
+                unsigned worker, libclang_vim::request_priority priority,
+                const std::function<void(std::size_t, unsigned)>& task) {
+    const unsigned jobs = queues.size();
+    std::size_t item;
+    while (true) {
+        bool found = queues[worker]->pop(item);
+        // No new items are added once the workers are started, so if all
+        // queues are empty, we're done.
+        for (unsigned i = 1; !found && i < jobs; ++i)
+            found = queues[(worker + i) % jobs]->steal(item);
+        if (!found)
+            return;
+
+        libclang_vim::yield_to_higher_priority(priority);
+        task(item, worker);
+    }
+}
+}
+
+unsigned libclang_vim::get_default_jobs() {
+    unsigned jobs = std::thread::hardware_concurrency();
+    return jobs ? jobs : 1;
+}
+
+void libclang_vim::parallel_for(
+    std::size_t count, unsigned jobs,
+    const std::function<void(std::size_t, unsigned)>& task) {
+    if (!jobs)
+        jobs = get_default_jobs();
+    if (jobs > count)
+        jobs = count;
+    if (!jobs)
+        return;
+
+    // Contiguous slices, so neighbouring items (often files of the same
+    // directory) are processed by the same worker.
+    std::vector<std::unique_ptr<work_queue>> queues;
+    for (unsigned i = 0; i < jobs; ++i)
+        queues.emplace_back(new work_queue());
+    for (std::size_t i = 0; i < count; ++i)
+        queues[i * jobs / count]->push(i);
+
+    // The helper threads work at the priority of the caller.
+    const request_priority priority = get_current_priority();
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < jobs; ++i)
+        threads.emplace_back(run_worker, std::ref(queues), i, priority,
+                             std::cref(task));
+    run_worker(queues, 0, priority, task);
+    for (auto& thread : threads)
+        thread.join();
+}
+
+libclang_vim::rw_mutex::rw_mutex()
+    : _readers(0), _waiting_writers(0), _writer(false) {}
+
+void libclang_vim::rw_mutex::lock() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    ++_waiting_writers;
+    _condition.wait(lock, [this] { return !_writer && !_readers; });
+    --_waiting_writers;
+    _writer = true;
+}
+
+void libclang_vim::rw_mutex::unlock() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _writer = false;
+    _condition.notify_all();
+}
+
+void libclang_vim::rw_mutex::lock_shared() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    _condition.wait(lock, [this] { return !_writer && !_waiting_writers; });
+    ++_readers;
+}
+
+void libclang_vim::rw_mutex::unlock_shared() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!--_readers)
+        _condition.notify_all();
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
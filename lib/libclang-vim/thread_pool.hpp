@@ -0,0 +1,53 @@
+#if !defined LIBCLANG_VIM_THREAD_POOL_HPP_INCLUDED
+#define LIBCLANG_VIM_THREAD_POOL_HPP_INCLUDED
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+
+namespace libclang_vim {
+
+/// Number of workers to use if the caller doesn't specify it: the number of
+/// cores.
+unsigned get_default_jobs();
+
+/// Runs task(item, worker) for each item in [0, count) on up to jobs threads,
+/// including the calling one. worker is in [0, jobs), so callers can keep
+/// per-worker state, like a CXIndex. Each worker starts with its own slice of
+/// the items and steals from the others when it runs out of work, so a few
+/// slow items don't leave the other cores idle. Between items, the workers
+/// yield to work of a higher priority than the caller's, see
+/// yield_to_higher_priority().
+void parallel_for(std::size_t count, unsigned jobs,
+                  const std::function<void(std::size_t, unsigned)>& task);
+
+/// Reader/writer lock, as std::shared_timed_mutex is C++14: any number of
+/// shared owners or one exclusive owner. Once a writer waits, new readers
+/// wait too, so a stream of queries can't starve a reparse.
+class rw_mutex {
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    unsigned _readers;
+    unsigned _waiting_writers;
+    bool _writer;
+
+  public:
+    rw_mutex();
+    rw_mutex(const rw_mutex&) = delete;
+    rw_mutex& operator=(const rw_mutex&) = delete;
+
+    void lock();
+
+    void unlock();
+
+    void lock_shared();
+
+    void unlock_shared();
+};
+
+} // namespace libclang_vim
+
+#endif // LIBCLANG_VIM_THREAD_POOL_HPP_INCLUDED
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
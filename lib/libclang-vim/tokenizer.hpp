@@ -11,15 +11,17 @@
 namespace libclang_vim {
 
 class tokenizer {
-    CXSourceRange
-    get_range_whole_file(const location_tuple& tuple,
-                         const cxtranslation_unit_ptr& translation_unit) const;
     const char* get_kind_spelling(const CXTokenKind kind) const;
     std::string
     make_vimson_from_tokens(const cxtranslation_unit_ptr& translation_unit,
                             std::vector<CXToken> tokens) const;
 
   public:
+    /// Range of the whole main file of tuple, or a null range.
+    CXSourceRange
+    get_range_whole_file(const location_tuple& tuple,
+                         const cxtranslation_unit_ptr& translation_unit) const;
+
     std::string tokenize_as_vimson(const location_tuple& tuple);
 };
 
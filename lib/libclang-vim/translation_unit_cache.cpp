@@ -0,0 +1,334 @@
+#include "translation_unit_cache.hpp"
+
+#include "session.hpp"
+
+namespace {
+
+/// Relative file names are resolved against the working directory at parse
+/// time, so make them part of the key.
+std::string get_cache_key(const std::string& file) {
+    return libclang_vim::get_absolute_path(file);
+}
+
+/// Hash of the main file contents that location_info parses, 0 if it can't
+/// be read.
+unsigned long long
+get_buffer_hash(const libclang_vim::location_tuple& location_info) {
+    unsigned long long hash = 0;
+    if (!location_info.unsaved_file.empty())
+        return libclang_vim::get_content_hash(
+            location_info.unsaved_file.data(),
+            location_info.unsaved_file.size());
+    if (!libclang_vim::get_file_content_hash(location_info.file, hash))
+        return 0;
+    return hash;
+}
+
+thread_local unsigned long answered_generation = 0;
+}
+
+libclang_vim::translation_unit_cache::snapshot::snapshot(
+    CXTranslationUnit snapshot_unit)
+    : unit(snapshot_unit), generation(0), content_hash(0) {}
+
+libclang_vim::translation_unit_cache::snapshot::~snapshot() {
+    if (unit)
+        clang_disposeTranslationUnit(unit);
+}
+
+libclang_vim::translation_unit_cache::entry::entry(
+    const args_type& entry_args, std::shared_ptr<snapshot> entry_front)
+    : args(entry_args), front(std::move(entry_front)), last_use(0),
+      completed(false) {}
+
+libclang_vim::translation_unit_cache::translation_unit_cache(
+    bool warm_up_completion, bool double_buffered)
+    : _warm_up_completion(warm_up_completion),
+      _double_buffered(double_buffered),
+      _index(clang_createIndex(/*excludeDeclsFromPCH*/ 1,
+                               /*displayDiagnostics*/ 0)),
+      _use_counter(0) {}
+
+CXTranslationUnit libclang_vim::translation_unit_cache::parse(
+    const location_tuple& location_info,
+    std::vector<CXUnsavedFile>& unsaved_files, bool warm_up_completion) {
+    const char* file_name = location_info.file.c_str();
+    auto const args_ptrs = get_args_ptrs(location_info.args);
+    unsigned options = CXTranslationUnit_Incomplete |
+                       CXTranslationUnit_PrecompiledPreamble |
+                       CXTranslationUnit_CacheCompletionResults |
+                       CXTranslationUnit_IncludeBriefCommentsInCodeCompletion;
+    CXTranslationUnit unit = clang_parseTranslationUnit(
+        _index, file_name, args_ptrs.data(), args_ptrs.size(),
+        unsaved_files.data(), unsaved_files.size(), options);
+    if (!unit)
+        return nullptr;
+
+    // Warm up: the preamble is only built on the first reparse, and the
+    // global completion results are only cached on the first completion, so
+    // do both now instead of during the first real request. Completion is
+    // only warmed up for files that use it.
+    if (clang_reparseTranslationUnit(unit, unsaved_files.size(),
+                                     unsaved_files.data(),
+                                     clang_defaultReparseOptions(unit)) != 0) {
+        clang_disposeTranslationUnit(unit);
+        return nullptr;
+    }
+    if (_warm_up_completion && warm_up_completion) {
+        CXCodeCompleteResults* results = clang_codeCompleteAt(
+            unit, file_name, /*line*/ 1, /*column*/ 1, unsaved_files.data(),
+            unsaved_files.size(), clang_defaultCodeCompleteOptions());
+        if (results)
+            clang_disposeCodeCompleteResults(results);
+    }
+
+    return unit;
+}
+
+void libclang_vim::translation_unit_cache::evict_least_recently_used() {
+    auto oldest = _entries.begin();
+    for (auto it = _entries.begin(); it != _entries.end(); ++it) {
+        if (it->second->last_use < oldest->second->last_use)
+            oldest = it;
+    }
+    if (oldest != _entries.end())
+        _entries.erase(oldest);
+}
+
+std::shared_ptr<libclang_vim::translation_unit_cache::entry>
+libclang_vim::translation_unit_cache::find_or_parse(
+    const location_tuple& location_info, bool& parsed) {
+    parsed = false;
+    if (!_index)
+        return nullptr;
+
+    const std::string key = get_cache_key(location_info.file);
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        bool waited = false;
+        while (_parsing.count(key)) {
+            _parsed.wait(lock);
+            waited = true;
+        }
+
+        auto const it = _entries.find(key);
+        if (it != _entries.end() && it->second->args == location_info.args) {
+            it->second->last_use = ++_use_counter;
+            const std::shared_ptr<entry> found = it->second;
+            const unsigned long long front_hash = found->front->content_hash;
+            lock.unlock();
+            // The parse we waited for may have seen the same buffer.
+            parsed = waited && front_hash &&
+                     front_hash == get_buffer_hash(location_info);
+            return found;
+        }
+        // Different compiler arguments, the preamble can't be reused. Users
+        // of the old translation unit keep it alive until they're done.
+        if (it != _entries.end())
+            _entries.erase(it);
+        _parsing.insert(key);
+    }
+
+    // Parse outside of the cache lock, so other files can be queried
+    // meanwhile. A completion that parses the file follows right away, so
+    // there is nothing to warm up.
+    std::vector<CXUnsavedFile> unsaved_files =
+        create_unsaved_files(location_info);
+    CXTranslationUnit unit =
+        parse(location_info, unsaved_files, /*warm_up_completion=*/false);
+
+    std::shared_ptr<entry> cached;
+    if (unit) {
+        parsed = true;
+        auto const front = std::make_shared<snapshot>(unit);
+        front->generation = 1;
+        front->content_hash = get_buffer_hash(location_info);
+        cached = std::make_shared<entry>(location_info.args, front);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _parsing.erase(key);
+        if (cached) {
+            if (!_entries.count(key) && _entries.size() >= max_entries)
+                evict_least_recently_used();
+            cached->last_use = ++_use_counter;
+            _entries[key] = cached;
+        }
+    }
+    _parsed.notify_all();
+    return cached;
+}
+
+libclang_vim::translation_unit_cache::unit_lock
+libclang_vim::translation_unit_cache::get(const location_tuple& location_info,
+                                          bool exclusive) {
+    bool parsed;
+    auto const cached = find_or_parse(location_info, parsed);
+    if (!cached)
+        return unit_lock();
+
+    std::shared_ptr<snapshot> front;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        front = cached->front;
+        if (exclusive)
+            cached->completed = true;
+    }
+    return unit_lock(front, exclusive);
+}
+
+libclang_vim::translation_unit_cache::unit_lock
+libclang_vim::translation_unit_cache::get_reparsed(
+    const location_tuple& location_info) {
+    bool parsed;
+    auto const cached = find_or_parse(location_info, parsed);
+    if (!cached)
+        return unit_lock();
+    if (parsed)
+        return get(location_info);
+
+    const unsigned long long content_hash = get_buffer_hash(location_info);
+    unsigned long seen;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        seen = cached->front->generation;
+    }
+
+    std::lock_guard<std::mutex> reparse_lock(cached->reparse_mutex);
+    std::shared_ptr<snapshot> next;
+    unsigned long generation;
+    bool completed;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        // Reparsed while we waited, from the same contents: use that one.
+        const std::shared_ptr<snapshot>& front = cached->front;
+        if (front->generation != seen && content_hash &&
+            front->content_hash == content_hash)
+            return unit_lock(front, /*exclusive=*/false);
+
+        generation = front->generation + 1;
+        completed = cached->completed;
+        if (_double_buffered)
+            next = std::move(cached->back);
+        else
+            next = front;
+    }
+
+    std::vector<CXUnsavedFile> unsaved_files =
+        create_unsaved_files(location_info);
+    if (next) {
+        // Waits for the queries that still read the older generation.
+        unit_lock writer(next, /*exclusive=*/true);
+        if (clang_reparseTranslationUnit(
+                next->unit, unsaved_files.size(), unsaved_files.data(),
+                clang_defaultReparseOptions(next->unit)) != 0) {
+            // The translation unit is unusable after a failed reparse. If it
+            // was the front one, queries get nullptr until the parse below
+            // replaces it.
+            clang_disposeTranslationUnit(next->unit);
+            next->unit = nullptr;
+        } else {
+            // unit_lock::get_generation() reads them under the snapshot lock,
+            // the lookups of the front snapshot under _mutex.
+            std::lock_guard<std::mutex> lock(_mutex);
+            next->generation = generation;
+            next->content_hash = content_hash;
+        }
+    }
+    if (!next || !next->unit) {
+        CXTranslationUnit unit = parse(location_info, unsaved_files,
+                                       /*warm_up_completion=*/completed);
+        if (!unit)
+            return unit_lock();
+        // Not shared before the swap below.
+        next = std::make_shared<snapshot>(unit);
+        next->generation = generation;
+        next->content_hash = content_hash;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (cached->front != next) {
+        if (_double_buffered)
+            cached->back = std::move(cached->front);
+        cached->front = next;
+    }
+    return unit_lock(next, /*exclusive=*/false);
+}
+
+libclang_vim::translation_unit_cache::unit_lock
+libclang_vim::translation_unit_cache::get_current(
+    const location_tuple& location_info) {
+    bool parsed;
+    auto const cached = find_or_parse(location_info, parsed);
+    if (!cached)
+        return unit_lock();
+    if (parsed)
+        return get(location_info);
+
+    const unsigned long long content_hash = get_buffer_hash(location_info);
+    std::shared_ptr<snapshot> front;
+    unsigned long long front_hash;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        front = cached->front;
+        front_hash = front->content_hash;
+    }
+    if (content_hash && front_hash == content_hash) {
+        unit_lock current(front, /*exclusive=*/false);
+        // Unless a failed reparse left it unusable.
+        if (current)
+            return current;
+    }
+    return get_reparsed(location_info);
+}
+
+libclang_vim::translation_unit_cache::unit_lock::unit_lock()
+    : _exclusive(false) {}
+
+libclang_vim::translation_unit_cache::unit_lock::unit_lock(
+    std::shared_ptr<snapshot> locked_snapshot, bool exclusive)
+    : _snapshot(std::move(locked_snapshot)), _exclusive(exclusive) {
+    if (_exclusive)
+        _snapshot->mutex.lock();
+    else
+        _snapshot->mutex.lock_shared();
+    answered_generation = get_generation();
+}
+
+libclang_vim::translation_unit_cache::unit_lock::unit_lock(unit_lock&& other)
+    : _snapshot(std::move(other._snapshot)), _exclusive(other._exclusive) {
+    other._snapshot.reset();
+}
+
+libclang_vim::translation_unit_cache::unit_lock::~unit_lock() {
+    if (!_snapshot)
+        return;
+    if (_exclusive)
+        _snapshot->mutex.unlock();
+    else
+        _snapshot->mutex.unlock_shared();
+}
+
+libclang_vim::translation_unit_cache::unit_lock::
+operator CXTranslationUnit() const {
+    return _snapshot ? _snapshot->unit : nullptr;
+}
+
+unsigned long
+libclang_vim::translation_unit_cache::unit_lock::get_generation() const {
+    return _snapshot && _snapshot->unit ? _snapshot->generation : 0;
+}
+
+libclang_vim::translation_unit_cache&
+libclang_vim::get_translation_unit_cache() {
+    return get_current_session().get_translation_unit_cache();
+}
+
+unsigned long libclang_vim::get_answered_generation() {
+    return answered_generation;
+}
+
+void libclang_vim::reset_answered_generation() { answered_generation = 0; }
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,167 @@
+#if !defined LIBCLANG_VIM_TRANSLATION_UNIT_CACHE_HPP_INCLUDED
+#define LIBCLANG_VIM_TRANSLATION_UNIT_CACHE_HPP_INCLUDED
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+
+#include <clang-c/Index.h>
+
+#include "helpers.hpp"
+#include "thread_pool.hpp"
+
+namespace libclang_vim {
+
+/// Keeps parsed translation units alive between calls, so that repeated
+/// queries on the same file can reuse the precompiled preamble instead of
+/// parsing everything from scratch. Can be used from multiple threads.
+///
+/// A file has two translation units when double buffered: queries read the
+/// front one, while a reparse updates the back one (the front one before the
+/// previous reparse) to the current buffer, then makes it the front one. So
+/// queries never wait for a reparse, they get the previous generation of the
+/// buffer until it's done.
+class translation_unit_cache {
+    /// One parsed generation of a file.
+    class snapshot {
+      public:
+        CXTranslationUnit unit;
+        /// 1 for the first parse of the file, incremented by each reparse.
+        unsigned long generation;
+        /// Of the main file it was parsed from, 0 if unknown.
+        unsigned long long content_hash;
+        rw_mutex mutex;
+
+        explicit snapshot(CXTranslationUnit snapshot_unit);
+        snapshot(const snapshot&) = delete;
+        snapshot& operator=(const snapshot&) = delete;
+        ~snapshot();
+    };
+
+    /// The translation units of one file.
+    class entry {
+      public:
+        args_type args;
+        /// The one queries get, swapped by reparses under the cache mutex.
+        std::shared_ptr<snapshot> front;
+        /// Reparsed next, nullptr if not double buffered or not parsed yet.
+        std::shared_ptr<snapshot> back;
+        unsigned long last_use;
+        /// Set by the first completion of the file, so its next parses warm
+        /// up completion.
+        bool completed;
+        /// Serializes the reparses of the file.
+        std::mutex reparse_mutex;
+
+        entry(const args_type& entry_args,
+              std::shared_ptr<snapshot> entry_front);
+        entry(const entry&) = delete;
+        entry& operator=(const entry&) = delete;
+    };
+
+  public:
+    /// A cached translation unit, locked while the unit_lock lives: shared
+    /// for queries, which only read it, exclusive for completion, which
+    /// modifies it. Keeps the translation unit alive even if the cache
+    /// evicts it or a reparse replaces it meanwhile.
+    class unit_lock {
+        std::shared_ptr<snapshot> _snapshot;
+        bool _exclusive;
+
+      public:
+        unit_lock();
+        unit_lock(std::shared_ptr<snapshot> locked_snapshot, bool exclusive);
+        unit_lock(unit_lock&& other);
+        unit_lock(const unit_lock&) = delete;
+        unit_lock& operator=(const unit_lock&) = delete;
+        ~unit_lock();
+
+        /// nullptr if parsing failed.
+        operator CXTranslationUnit() const;
+
+        /// Generation of the buffer the translation unit was parsed from, 0
+        /// if parsing failed.
+        unsigned long get_generation() const;
+    };
+
+  private:
+    const bool _warm_up_completion;
+    const bool _double_buffered;
+    cxindex_ptr _index;
+    /// Protects _entries, _use_counter and the front and back snapshots and
+    /// completed flags of the entries, not the translation units.
+    std::mutex _mutex;
+    std::map<std::string, std::shared_ptr<entry>> _entries;
+    unsigned long _use_counter;
+    /// Keys that find_or_parse() is parsing: other misses of the same key
+    /// wait for that parse instead of parsing the file again.
+    std::set<std::string> _parsing;
+    /// Notified when a key leaves _parsing.
+    std::condition_variable _parsed;
+
+    CXTranslationUnit parse(const location_tuple& location_info,
+                            std::vector<CXUnsavedFile>& unsaved_files,
+                            bool warm_up_completion);
+
+    void evict_least_recently_used();
+
+    /// Returns the entry of location_info, parsing it if needed; parsed is
+    /// set if the front translation unit was just parsed from the current
+    /// buffer, by this call or by a concurrent one it waited for.
+    std::shared_ptr<entry> find_or_parse(const location_tuple& location_info,
+                                         bool& parsed);
+
+  public:
+    /// Maximum number of translation units kept alive at the same time.
+    static const size_t max_entries = 8;
+
+    /// If warm_up_completion is true, a first completion is run right after
+    /// parsing a file that was completed before, so the next real completion
+    /// is fast; other queries don't pay for it. Without double_buffered,
+    /// a file has a single translation unit, which reparses update in place,
+    /// so queries wait for them: that's enough if a single thread uses the
+    /// cache, at half the memory.
+    explicit translation_unit_cache(bool warm_up_completion = true,
+                                    bool double_buffered = true);
+    translation_unit_cache(const translation_unit_cache&) = delete;
+    translation_unit_cache& operator=(const translation_unit_cache&) = delete;
+
+    /// Returns the cached translation unit of location_info, parsing it on
+    /// first use. The contents may be older than the unsaved buffer, which is
+    /// fine for clang_codeCompleteAt(), as it reparses the main file anyway.
+    /// Doesn't wait for a running reparse of the file. exclusive is for
+    /// completion, it marks the file as completed.
+    unit_lock get(const location_tuple& location_info, bool exclusive = false);
+
+    /// Same as get(), but reparses an already cached translation unit, so it
+    /// reflects the current buffer contents. A reparse that waited for one
+    /// of the same buffer contents returns its result. The returned lock is
+    /// shared.
+    unit_lock get_reparsed(const location_tuple& location_info);
+
+    /// Same as get_reparsed(), but returns the cached translation unit as is
+    /// if it was parsed from the current contents of the main file. Cursor
+    /// queries use it: they see edits of included headers with the next
+    /// reparse only, like their memoized results. The returned lock is
+    /// shared.
+    unit_lock get_current(const location_tuple& location_info);
+};
+
+/// The cache of the current session, see get_current_session().
+translation_unit_cache& get_translation_unit_cache();
+
+/// Generation of the cached translation unit that the last query of the
+/// current thread used, see unit_lock::get_generation(); 0 if none did.
+unsigned long get_answered_generation();
+
+/// Forgets the generation of the previous query of the current thread.
+void reset_answered_generation();
+
+} // namespace libclang_vim
+
+#endif // LIBCLANG_VIM_TRANSLATION_UNIT_CACHE_HPP_INCLUDED
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,208 @@
+#include "virtual_calls.hpp"
+
+#include <map>
+#include <set>
+
+#include "compilation_database.hpp"
+#include "indexer.hpp"
+#include "translation_unit_cache.hpp"
+
+namespace {
+
+std::string get_usr(const CXCursor& cursor) {
+    libclang_vim::cxstring_ptr usr = clang_getCursorUSR(cursor);
+    const char* usr_string = libclang_vim::to_c_str(usr);
+    return usr_string ? usr_string : std::string();
+}
+
+void collect_overridden_methods(const CXCursor& method,
+                                std::set<std::string>& usrs,
+                                std::vector<CXCursor>& ret) {
+    CXCursor* overridden = nullptr;
+    unsigned count = 0;
+    clang_getOverriddenCursors(method, &overridden, &count);
+    for (unsigned i = 0; i < count; ++i) {
+        if (!usrs.insert(get_usr(overridden[i])).second)
+            continue;
+        ret.push_back(overridden[i]);
+        collect_overridden_methods(overridden[i], usrs, ret);
+    }
+    clang_disposeOverriddenCursors(overridden);
+}
+
+struct source_position {
+    std::string file;
+    unsigned line;
+    unsigned col;
+};
+
+source_position get_source_position(const CXCursor& cursor) {
+    CXFile file;
+    source_position position;
+    clang_getFileLocation(clang_getCursorLocation(cursor), &file,
+                          &position.line, &position.col, nullptr);
+    libclang_vim::cxstring_ptr name = clang_getFileName(file);
+    const char* file_name = clang_getCString(name);
+    position.file = file_name ? file_name : "";
+    return position;
+}
+
+CXChildVisitResult find_member_ref(CXCursor cursor, CXCursor,
+                                   CXClientData data) {
+    if (clang_getCursorKind(cursor) != CXCursor_MemberRefExpr)
+        return CXChildVisit_Continue;
+
+    *static_cast<CXCursor*>(data) = cursor;
+    return CXChildVisit_Break;
+}
+
+/// The location of a call is the start of the receiver expression, use the
+/// one of the method name instead, like the indexer does.
+source_position get_call_position(const CXCursor& call) {
+    CXCursor callee = call;
+    clang_visitChildren(call, find_member_ref, &callee);
+    return get_source_position(callee);
+}
+
+struct virtual_call {
+    source_position position;
+    std::string function;
+    std::string method;
+    std::string method_usr;
+    std::string receiver_type;
+    unsigned loop_depth;
+};
+
+struct overrider {
+    std::string name;
+    source_position position;
+};
+
+/// Client data of collect_virtual_calls().
+class virtual_call_collector {
+  public:
+    /// Qualified name of the function being visited.
+    std::string function;
+    unsigned loop_depth;
+    std::vector<virtual_call> calls;
+    /// By the USR of the overridden method, then by the USR of the overrider.
+    std::map<std::string, std::map<std::string, overrider>> overriders;
+
+    virtual_call_collector() : loop_depth(0) {}
+};
+
+CXChildVisitResult collect_virtual_calls(CXCursor cursor, CXCursor,
+                                         CXClientData data) {
+    auto& collector = *static_cast<virtual_call_collector*>(data);
+    const CXCursorKind kind = clang_getCursorKind(cursor);
+
+    // Overriders anywhere in the translation unit, calls only in the main
+    // file.
+    if (kind == CXCursor_CXXMethod && clang_CXXMethod_isVirtual(cursor)) {
+        // Out-of-line definitions are reported at the declaration.
+        const CXCursor canonical = clang_getCanonicalCursor(cursor);
+        const std::string usr = get_usr(canonical);
+        for (const CXCursor& method :
+             libclang_vim::get_overridden_methods(cursor)) {
+            overrider& entry = collector.overriders[get_usr(method)][usr];
+            entry.name = libclang_vim::get_qualified_name(canonical);
+            entry.position = get_source_position(canonical);
+        }
+    } else if (kind == CXCursor_CallExpr &&
+               clang_Cursor_isDynamicCall(cursor) &&
+               clang_Location_isFromMainFile(
+                   clang_getCursorLocation(cursor))) {
+        const CXCursor method = clang_getCursorReferenced(cursor);
+        libclang_vim::cxstring_ptr receiver_type =
+            clang_getTypeSpelling(clang_Cursor_getReceiverType(cursor));
+        virtual_call call;
+        call.position = get_call_position(cursor);
+        call.function = collector.function;
+        call.method = libclang_vim::get_qualified_name(method);
+        call.method_usr = get_usr(method);
+        call.receiver_type = clang_getCString(receiver_type);
+        call.loop_depth = collector.loop_depth;
+        collector.calls.push_back(call);
+    }
+
+    const std::string function = collector.function;
+    const unsigned loop_depth = collector.loop_depth;
+    if (libclang_vim::is_function_decl_kind(kind))
+        collector.function = libclang_vim::get_qualified_name(cursor);
+    else if (libclang_vim::is_loop_kind(kind))
+        ++collector.loop_depth;
+    clang_visitChildren(cursor, collect_virtual_calls, data);
+    collector.function = function;
+    collector.loop_depth = loop_depth;
+    return CXChildVisit_Continue;
+}
+}
+
+std::vector<CXCursor>
+libclang_vim::get_overridden_methods(const CXCursor& method) {
+    std::set<std::string> usrs;
+    std::vector<CXCursor> ret;
+    collect_overridden_methods(method, usrs, ret);
+    return ret;
+}
+
+const char*
+libclang_vim::extract_virtual_calls(const location_tuple& location_info) {
+    thread_local std::string vimson;
+
+    auto const translation_unit =
+        get_translation_unit_cache().get_reparsed(location_info);
+    if (!translation_unit)
+        return "[]";
+
+    virtual_call_collector collector;
+    clang_visitChildren(clang_getTranslationUnitCursor(translation_unit),
+                        collect_virtual_calls, &collector);
+
+    std::stringstream ss;
+    ss << "[";
+    for (const auto& call : collector.calls) {
+        ss << "{'file':'" << escape_single_quotes(call.position.file) << "',";
+        ss << "'line':" << call.position.line << ",";
+        ss << "'col':" << call.position.col << ",";
+        ss << "'function':'" << escape_single_quotes(call.function) << "',";
+        ss << "'method':'" << escape_single_quotes(call.method) << "',";
+        ss << "'receiver_type':'" << escape_single_quotes(call.receiver_type)
+           << "',";
+        ss << "'loop_depth':" << call.loop_depth << ",'overriders':[";
+        auto const overriders = collector.overriders.find(call.method_usr);
+        if (overriders != collector.overriders.end()) {
+            for (const auto& entry : overriders->second) {
+                const overrider& method = entry.second;
+                ss << "{'name':'" << escape_single_quotes(method.name) << "',";
+                ss << "'file':'" << escape_single_quotes(method.position.file)
+                   << "',";
+                ss << "'line':" << method.position.line << ",";
+                ss << "'col':" << method.position.col << "},";
+            }
+        }
+        ss << "]},";
+    }
+    ss << "]";
+    vimson = ss.str();
+    return vimson.c_str();
+}
+
+const char*
+libclang_vim::get_project_virtual_calls(const std::string& directory) {
+    thread_local std::string vimson;
+
+    const std::string database_directory =
+        find_compilation_database(directory);
+    if (database_directory.empty())
+        return "[]";
+
+    auto const index = get_project_index(database_directory);
+    if (!index)
+        return "[]";
+
+    vimson = index->find_dynamic_calls();
+    return vimson.c_str();
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,30 @@
+#if !defined LIBCLANG_VIM_VIRTUAL_CALLS_HPP_INCLUDED
+#define LIBCLANG_VIM_VIRTUAL_CALLS_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+
+#include <clang-c/Index.h>
+
+#include "helpers.hpp"
+
+namespace libclang_vim {
+
+/// Methods that method overrides, directly or transitively, each one once.
+std::vector<CXCursor> get_overridden_methods(const CXCursor& method);
+
+/// Calls of the main file of location_info that are dispatched through the
+/// vtable (clang_Cursor_isDynamicCall()), with the enclosing function, the
+/// static receiver type, the number of enclosing loops and the overriders of
+/// the called method that the translation unit knows.
+const char* extract_virtual_calls(const location_tuple& location_info);
+
+/// Dynamic calls recorded in the project index, each one with the overriders
+/// of the called method in the whole project.
+const char* get_project_virtual_calls(const std::string& directory);
+
+} // namespace libclang_vim
+
+#endif // LIBCLANG_VIM_VIRTUAL_CALLS_HPP_INCLUDED
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
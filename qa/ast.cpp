@@ -4,14 +4,18 @@
 #include <cassert>
 #include <cppunit/extensions/HelperMacros.h>
 
+#include "../lib/libclang-vim/clang_vim.h"
+
 class ast_test : public CPPUNIT_NS::TestFixture {
     CPPUNIT_TEST_SUITE(ast_test);
     CPPUNIT_TEST(test_extract_declarations_current_file);
     CPPUNIT_TEST(test_unsaved_extract_declarations_current_file);
+    CPPUNIT_TEST(test_extract_nodes);
     CPPUNIT_TEST_SUITE_END();
 
     void test_extract_declarations_current_file();
     void test_unsaved_extract_declarations_current_file();
+    void test_extract_nodes();
 
     void* m_handle;
 
@@ -63,6 +67,52 @@ void ast_test::test_unsaved_extract_declarations_current_file() {
     CPPUNIT_ASSERT(actual != "{'root':[]}");
 }
 
+void ast_test::test_extract_nodes() {
+    auto vim_clang_extract_nodes =
+        reinterpret_cast<vim_clang_nodes* (*)(char const*, char const*, int)>(
+            dlsym(m_handle, "vim_clang_extract_nodes"));
+    assert(vim_clang_extract_nodes);
+    auto vim_clang_free_nodes = reinterpret_cast<void (*)(vim_clang_nodes*)>(
+        dlsym(m_handle, "vim_clang_free_nodes"));
+    assert(vim_clang_free_nodes);
+
+    const char* arguments = "qa/data/declaration.cpp:-std=c++1y";
+    CPPUNIT_ASSERT(!vim_clang_extract_nodes(arguments, "foo", 1));
+
+    vim_clang_nodes* result =
+        vim_clang_extract_nodes(arguments, "declarations", 1);
+    CPPUNIT_ASSERT(result);
+    CPPUNIT_ASSERT(result->count > 2);
+
+    // namespace ns, at the top level.
+    const vim_clang_node& ns = result->nodes[0];
+    CPPUNIT_ASSERT_EQUAL(std::string("ns"),
+                         std::string(result->strings + ns.name));
+    CPPUNIT_ASSERT_EQUAL(std::string("qa/data/declaration.cpp"),
+                         std::string(result->strings + ns.file));
+    CPPUNIT_ASSERT_EQUAL(1U, ns.start_line);
+    CPPUNIT_ASSERT_EQUAL(1U, ns.start_column);
+    CPPUNIT_ASSERT_EQUAL(0U, ns.start_offset);
+    CPPUNIT_ASSERT_EQUAL(8U, ns.end_line);
+    CPPUNIT_ASSERT_EQUAL(-1, ns.parent);
+
+    // class C, inside ns.
+    const vim_clang_node& c = result->nodes[1];
+    CPPUNIT_ASSERT_EQUAL(std::string("C"),
+                         std::string(result->strings + c.name));
+    CPPUNIT_ASSERT_EQUAL(0, c.parent);
+
+    // ns::C c, the last declaration, inside main().
+    const vim_clang_node& variable = result->nodes[result->count - 1];
+    CPPUNIT_ASSERT_EQUAL(std::string("c"),
+                         std::string(result->strings + variable.name));
+    CPPUNIT_ASSERT_EQUAL(
+        std::string("main"),
+        std::string(result->strings + result->nodes[variable.parent].name));
+
+    vim_clang_free_nodes(result);
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(ast_test);
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,125 @@
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+
+#include <iostream>
+
+namespace {
+
+void print_result(char const* result, void*) {
+    std::cout << result << std::endl;
+}
+
+/// Progress goes to stderr, so stdout only has the report.
+void print_progress(char const* result, void*) {
+    std::cerr << result << std::endl;
+}
+
+int usage(const char* program) {
+    std::cerr << "Usage: " << program
+              << " diagnostics|index|update-index|hotspots|padding|functions "
+                 "<project directory> "
+                 "[<jobs>] [json|csv (hotspots only)]"
+              << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "Runs a command on every file of the compile_commands.json "
+                 "in the project directory or in one of its parents. "
+                 "<jobs> defaults to the number of cores."
+              << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "  diagnostics: prints the diagnostics of each file as soon "
+                 "as it's parsed"
+              << std::endl;
+    std::cerr << "  index: builds the symbol index next to "
+                 "compile_commands.json"
+              << std::endl;
+    std::cerr << "  update-index: indexes changed files again" << std::endl;
+    std::cerr << "  hotspots: prints the parse time, memory, number of "
+                 "included files and AST nodes of each file, slowest first, "
+                 "as json (default) or csv"
+              << std::endl;
+    std::cerr << "  padding: prints the record types with padding or fields "
+                 "straddling a cache line, most wasteful first"
+              << std::endl;
+    std::cerr << "  functions: prints the size, nesting depth, loops and "
+                 "calls of each function definition, biggest first"
+              << std::endl;
+    return 1;
+}
+}
+
+/// Project-wide counterpart of qa/tool: runs commands on a whole compilation
+/// database from the command line.
+int main(int argc, char** argv) {
+    if (argc < 3)
+        return usage(argv[0]);
+    const char* command = argv[1];
+    const char* directory = argv[2];
+    unsigned jobs = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 0;
+    // Only hotspots has a choice of formats.
+    if (argc > 4 && std::strcmp(command, "hotspots") != 0)
+        return usage(argv[0]);
+
+    void* handle = dlopen(SRC_ROOT "/lib/libclang-vim.so", RTLD_NOW);
+    if (!handle) {
+        std::cerr << "dlopen() failed: " << dlerror() << std::endl;
+        return 1;
+    }
+
+    if (std::strcmp(command, "diagnostics") == 0) {
+        auto function = reinterpret_cast<char const* (*)(
+            char const*, unsigned, void (*)(char const*, void*), void*)>(
+            dlsym(handle, "vim_clang_sweep_diagnostics"));
+        assert(function);
+
+        std::cout << function(directory, jobs, print_result, nullptr)
+                  << std::endl;
+    } else if (std::strcmp(command, "hotspots") == 0) {
+        auto function = reinterpret_cast<char const* (*)(
+            char const*, unsigned, char const*, void (*)(char const*, void*),
+            void*)>(dlsym(handle, "vim_clang_profile_project"));
+        assert(function);
+
+        const char* format = argc > 4 ? argv[4] : "json";
+        if (std::strcmp(format, "json") != 0 &&
+            std::strcmp(format, "csv") != 0) {
+            dlclose(handle);
+            return usage(argv[0]);
+        }
+        std::cout << function(directory, jobs, format, print_progress,
+                              nullptr);
+        if (std::strcmp(format, "json") == 0)
+            std::cout << std::endl;
+    } else if (std::strcmp(command, "padding") == 0) {
+        auto function =
+            reinterpret_cast<char const* (*)(char const*, unsigned)>(
+                dlsym(handle, "vim_clang_scan_padding"));
+        assert(function);
+
+        std::cout << function(directory, jobs) << std::endl;
+    } else if (std::strcmp(command, "functions") == 0) {
+        auto function =
+            reinterpret_cast<char const* (*)(char const*, unsigned)>(
+                dlsym(handle, "vim_clang_measure_functions"));
+        assert(function);
+
+        std::cout << function(directory, jobs) << std::endl;
+    } else if (std::strcmp(command, "index") == 0 ||
+               std::strcmp(command, "update-index") == 0) {
+        auto function =
+            reinterpret_cast<char const* (*)(char const*, unsigned, int)>(
+                dlsym(handle, "vim_clang_build_project_index"));
+        assert(function);
+
+        const int incremental = std::strcmp(command, "update-index") == 0;
+        std::cout << function(directory, jobs, incremental) << std::endl;
+    } else {
+        dlclose(handle);
+        return usage(argv[0]);
+    }
+
+    dlclose(handle);
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
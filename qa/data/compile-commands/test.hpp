@@ -0,0 +1,4 @@
+struct padded {
+    char c;
+    int i;
+};
@@ -0,0 +1,10 @@
+int helper(int i) { return i * 2; }
+
+int sum(const int* values, int count) {
+    int ret = 0;
+    for (int i = 0; i < count; ++i) {
+        if (values[i] > 0)
+            ret += helper(values[i]);
+    }
+    return ret;
+}
@@ -0,0 +1 @@
+int widget_count();
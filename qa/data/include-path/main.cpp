@@ -0,0 +1,3 @@
+#include <widget.hpp>
+
+int widget_count() { return 1; }
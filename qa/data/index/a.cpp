@@ -0,0 +1,7 @@
+#include "shared.hpp"
+
+int shared_function() { return 0; }
+
+struct square : shape {
+    int area() const override { return 4; }
+};
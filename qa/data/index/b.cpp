@@ -0,0 +1,5 @@
+#include "shared.hpp"
+
+int caller() { return shared_function(); }
+
+int get_area(const shape& s) { return s.area(); }
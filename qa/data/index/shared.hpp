@@ -0,0 +1,5 @@
+int shared_function();
+
+struct shape {
+    virtual int area() const = 0;
+};
@@ -0,0 +1,18 @@
+struct padded {
+    char c;
+    double d;
+    int i;
+};
+
+#pragma pack(push, 1)
+struct packed {
+    char head[62];
+    int value;
+};
+#pragma pack(pop)
+
+struct with_virtual_destructor {
+    virtual ~with_virtual_destructor();
+    int x;
+    int y;
+};
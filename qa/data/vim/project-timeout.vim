@@ -0,0 +1,12 @@
+" Runs a project-wide query without a callback against a server that takes
+" longer than ch_evalexpr()'s default timeout, writes the result to
+" $LIBCLANG_VIM_RESULT.
+let s:root = expand('<sfile>:p:h:h:h:h')
+let &runtimepath = s:root . ',' . &runtimepath
+runtime autoload/libclang/server.vim
+let g:libclang#server#path = s:root . '/qa/data/vim/slow-server.sh'
+call libclang#server#start()
+let s:result = libclang#index#project(s:root)
+call writefile([string(s:result)], $LIBCLANG_VIM_RESULT)
+call libclang#server#stop()
+qa!
@@ -0,0 +1,9 @@
+#!/bin/sh
+# Stands in for libclang-vim-server: answers each request after 3 seconds,
+# like a project-wide query would.
+while read -r request; do
+    sleep 3
+    id=${request#\[}
+    id=${id%%,*}
+    printf '[%s,{"result":"done"}]\n' "$id"
+done
@@ -0,0 +1,14 @@
+struct shape {
+    virtual int area() const = 0;
+};
+
+struct square : shape {
+    int area() const override { return 4; }
+};
+
+int total_area(const shape* shapes[], int count) {
+    int ret = 0;
+    for (int i = 0; i < count; ++i)
+        ret += shapes[i]->area();
+    return ret;
+}
@@ -14,6 +14,10 @@ class deduction_test : public CPPUNIT_NS::TestFixture {
     CPPUNIT_TEST(test_unsaved_current_function_at);
     CPPUNIT_TEST(test_completion_at);
     CPPUNIT_TEST(test_unsaved_completion_at);
+    CPPUNIT_TEST(test_cached_completion_at);
+    CPPUNIT_TEST(test_filtered_completion_at);
+    CPPUNIT_TEST(test_refined_completion_at);
+    CPPUNIT_TEST(test_completion_items_at);
     CPPUNIT_TEST(test_comment_at);
     CPPUNIT_TEST(test_unsaved_comment_at);
     CPPUNIT_TEST(test_declaration_at);
@@ -23,6 +27,7 @@ class deduction_test : public CPPUNIT_NS::TestFixture {
     CPPUNIT_TEST(test_unsaved_include_at);
     CPPUNIT_TEST(test_diagnostics);
     CPPUNIT_TEST(test_unsaved_diagnostics);
+    CPPUNIT_TEST(test_background_diagnostics);
     CPPUNIT_TEST_SUITE_END();
 
     void test_get_type_with_deduction_at();
@@ -33,6 +38,10 @@ class deduction_test : public CPPUNIT_NS::TestFixture {
     void test_unsaved_current_function_at();
     void test_completion_at();
     void test_unsaved_completion_at();
+    void test_cached_completion_at();
+    void test_filtered_completion_at();
+    void test_refined_completion_at();
+    void test_completion_items_at();
     void test_comment_at();
     void test_unsaved_comment_at();
     void test_declaration_at();
@@ -42,6 +51,7 @@ class deduction_test : public CPPUNIT_NS::TestFixture {
     void test_unsaved_include_at();
     void test_diagnostics();
     void test_unsaved_diagnostics();
+    void test_background_diagnostics();
 
     void* m_handle;
 
@@ -179,6 +189,107 @@ void deduction_test::test_unsaved_completion_at() {
     CPPUNIT_ASSERT_EQUAL(expected, actual);
 }
 
+void deduction_test::test_cached_completion_at() {
+    auto vim_clang_get_completion_at =
+        reinterpret_cast<char const* (*)(char const*)>(
+            dlsym(m_handle, "vim_clang_get_completion_at"));
+    assert(vim_clang_get_completion_at);
+
+    // The second call is served from the cached translation unit.
+    std::string expected("['C', 'bar', 'foo', 'operator=', '~C']");
+    std::string actual(
+        vim_clang_get_completion_at("qa/data/completion.cpp:-std=c++1y:16:7"));
+    CPPUNIT_ASSERT_EQUAL(expected, actual);
+    actual =
+        vim_clang_get_completion_at("qa/data/completion.cpp:-std=c++1y:16:7");
+    CPPUNIT_ASSERT_EQUAL(expected, actual);
+}
+
+void deduction_test::test_filtered_completion_at() {
+    auto vim_clang_get_filtered_completion_at =
+        reinterpret_cast<char const* (*)(char const*)>(
+            dlsym(m_handle, "vim_clang_get_filtered_completion_at"));
+    assert(vim_clang_get_filtered_completion_at);
+
+    std::string expected("['foo']");
+    std::string actual(vim_clang_get_filtered_completion_at(
+        "qa/data/completion.cpp:-std=c++1y:16:7:fo:10"));
+    CPPUNIT_ASSERT_EQUAL(expected, actual);
+
+    // Prefix matches rank before other fuzzy matches.
+    expected = "['operator=', 'foo']";
+    actual = vim_clang_get_filtered_completion_at(
+        "qa/data/completion.cpp:-std=c++1y:16:7:o:10");
+    CPPUNIT_ASSERT_EQUAL(expected, actual);
+
+    // Only the top 1 is returned.
+    expected = "['operator=']";
+    actual = vim_clang_get_filtered_completion_at(
+        "qa/data/completion.cpp:-std=c++1y:16:7:o:1");
+    CPPUNIT_ASSERT_EQUAL(expected, actual);
+}
+
+void deduction_test::test_refined_completion_at() {
+    auto vim_clang_get_filtered_completion_at =
+        reinterpret_cast<char const* (*)(char const*)>(
+            dlsym(m_handle, "vim_clang_get_filtered_completion_at"));
+    assert(vim_clang_get_filtered_completion_at);
+
+    std::string expected("['operator=', 'foo']");
+    std::string actual(vim_clang_get_filtered_completion_at(
+        "qa/data/completion.cpp:-std=c++1y:16:7:o:10"));
+    CPPUNIT_ASSERT_EQUAL(expected, actual);
+    // Extends the previous prefix: refined from the retained results.
+    expected = "['operator=']";
+    actual = vim_clang_get_filtered_completion_at(
+        "qa/data/completion.cpp:-std=c++1y:16:7:op:10");
+    CPPUNIT_ASSERT_EQUAL(expected, actual);
+    // Doesn't extend the previous prefix, but the context is the same.
+    expected = "['bar']";
+    actual = vim_clang_get_filtered_completion_at(
+        "qa/data/completion.cpp:-std=c++1y:16:7:ba:10");
+    CPPUNIT_ASSERT_EQUAL(expected, actual);
+}
+
+void deduction_test::test_completion_items_at() {
+    auto vim_clang_get_completion_items_at =
+        reinterpret_cast<char const* (*)(char const*)>(
+            dlsym(m_handle, "vim_clang_get_completion_items_at"));
+    assert(vim_clang_get_completion_items_at);
+    auto vim_clang_get_completion_detail =
+        reinterpret_cast<char const* (*)(char const*)>(
+            dlsym(m_handle, "vim_clang_get_completion_detail"));
+    assert(vim_clang_get_completion_detail);
+
+    std::string actual(vim_clang_get_completion_items_at(
+        "qa/data/completion.cpp:-std=c++1y:16:7:fo:10"));
+    std::string expected_prefix("[{'id':'");
+    CPPUNIT_ASSERT_EQUAL(
+        0, actual.compare(0, expected_prefix.size(), expected_prefix));
+    CPPUNIT_ASSERT(actual.find("'word':'foo','kind':'CXXMethod'") !=
+                   std::string::npos);
+
+    // Fetch the details of the first item.
+    std::string id =
+        actual.substr(expected_prefix.size(),
+                      actual.find('\'', expected_prefix.size()) -
+                          expected_prefix.size());
+    actual = vim_clang_get_completion_detail(id.c_str());
+    CPPUNIT_ASSERT(actual.find("{'kind':'TypedText','text':'foo'}") !=
+                   std::string::npos);
+    CPPUNIT_ASSERT(actual.find("'result_type':'int'") != std::string::npos);
+
+    CPPUNIT_ASSERT_EQUAL(std::string("{}"),
+                         std::string(vim_clang_get_completion_detail("x")));
+
+    // A completion at another location replaces the results of id.
+    vim_clang_get_completion_items_at(
+        "qa/data/completion.cpp:-std=c++1y:15:5:ns:10");
+    CPPUNIT_ASSERT_EQUAL(
+        std::string("{}"),
+        std::string(vim_clang_get_completion_detail(id.c_str())));
+}
+
 void deduction_test::test_comment_at() {
     auto vim_clang_get_completion_at =
         reinterpret_cast<char const* (*)(char const*)>(
@@ -259,6 +370,12 @@ void deduction_test::test_include_at() {
         "qa/data/compile-commands/test.cpp:-std=c++1y -I" SRC_ROOT
         "/qa/data/compile-commands/:1:2"));
     CPPUNIT_ASSERT_EQUAL(expected, actual);
+
+    // The cached include graph is found under the absolute name, too.
+    actual = vim_clang_get_include_at(
+        SRC_ROOT "/qa/data/compile-commands/test.cpp:-std=c++1y -I" SRC_ROOT
+                 "/qa/data/compile-commands/:1:2");
+    CPPUNIT_ASSERT_EQUAL(expected, actual);
 }
 
 void deduction_test::test_unsaved_include_at() {
@@ -307,6 +424,40 @@ void deduction_test::test_unsaved_diagnostics() {
     CPPUNIT_ASSERT_EQUAL(expected, actual);
 }
 
+void deduction_test::test_background_diagnostics() {
+    auto vim_clang_schedule_diagnostics =
+        reinterpret_cast<char const* (*)(char const*)>(
+            dlsym(m_handle, "vim_clang_schedule_diagnostics"));
+    assert(vim_clang_schedule_diagnostics);
+    auto vim_clang_get_latest_diagnostics =
+        reinterpret_cast<char const* (*)(char const*)>(
+            dlsym(m_handle, "vim_clang_get_latest_diagnostics"));
+    assert(vim_clang_get_latest_diagnostics);
+    auto vim_clang_wait_for_diagnostics =
+        reinterpret_cast<char const* (*)(char const*, unsigned long long)>(
+            dlsym(m_handle, "vim_clang_wait_for_diagnostics"));
+    assert(vim_clang_wait_for_diagnostics);
+
+    std::string expected("{'generation':2}");
+    std::string actual(vim_clang_schedule_diagnostics(
+        "qa/data/diagnostics.cpp:-Wunused-variable:2"));
+    CPPUNIT_ASSERT_EQUAL(expected, actual);
+    // Older than the pending request: dropped.
+    vim_clang_schedule_diagnostics(
+        "qa/data/diagnostics.cpp:-Wunused-variable:1");
+
+    expected = "{'generation':2,'diagnostics':[{'severity': 'warning', "
+               "'line':1,'column':18,'offset':17,'file':'qa/data/"
+               "diagnostics.cpp',}, ]}";
+    actual = vim_clang_wait_for_diagnostics("qa/data/diagnostics.cpp", 2);
+    CPPUNIT_ASSERT_EQUAL(expected, actual);
+
+    // Results are found under any spelling of the file name.
+    actual = vim_clang_get_latest_diagnostics(
+        SRC_ROOT "/qa/data/diagnostics.cpp");
+    CPPUNIT_ASSERT_EQUAL(expected, actual);
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(deduction_test);
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
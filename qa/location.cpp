@@ -10,16 +10,24 @@ class location_test : public CPPUNIT_NS::TestFixture {
     CPPUNIT_TEST(test_unsaved_all_extents);
     CPPUNIT_TEST(test_ast_node);
     CPPUNIT_TEST(test_unsaved_ast_node);
+    CPPUNIT_TEST(test_memoized_ast_node);
     CPPUNIT_TEST(test_extent);
     CPPUNIT_TEST(test_unsaved_extent);
+    CPPUNIT_TEST(test_layout_at);
+    CPPUNIT_TEST(test_layout_at_field);
+    CPPUNIT_TEST(test_layout_at_virtual_destructor);
     CPPUNIT_TEST_SUITE_END();
 
     void test_all_extents();
     void test_unsaved_all_extents();
     void test_ast_node();
     void test_unsaved_ast_node();
+    void test_memoized_ast_node();
     void test_extent();
     void test_unsaved_extent();
+    void test_layout_at();
+    void test_layout_at_field();
+    void test_layout_at_virtual_destructor();
 
     void* m_handle;
 
@@ -110,6 +118,27 @@ void location_test::test_unsaved_ast_node() {
         0, actual.compare(0, expected_prefix.size(), expected_prefix));
 }
 
+void location_test::test_memoized_ast_node() {
+    auto vim_clang_get_location_information =
+        reinterpret_cast<char const* (*)(char const*)>(
+            dlsym(m_handle, "vim_clang_get_location_information"));
+    assert(vim_clang_get_location_information);
+
+    // The second call is answered from the memo, the third one has a
+    // different buffer.
+    std::string expected_prefix = "{'spell':'y','type':'int',";
+    std::string first(vim_clang_get_location_information(
+        "qa/data/current-function.cpp:-std=c++1y:10:9"));
+    std::string second(vim_clang_get_location_information(
+        "qa/data/current-function.cpp:-std=c++1y:10:9"));
+    std::string other(vim_clang_get_location_information(
+        "qa/data/current-function.cpp#qa/data/layout.cpp:-std=c++1y:10:9"));
+    CPPUNIT_ASSERT_EQUAL(
+        0, first.compare(0, expected_prefix.size(), expected_prefix));
+    CPPUNIT_ASSERT_EQUAL(first, second);
+    CPPUNIT_ASSERT(first != other);
+}
+
 void location_test::test_extent() {
     auto vim_clang_get_extent_of_node_at_specific_location =
         reinterpret_cast<char const* (*)(char const*)>(dlsym(
@@ -142,6 +171,61 @@ void location_test::test_unsaved_extent() {
     CPPUNIT_ASSERT_EQUAL(expected, actual);
 }
 
+void location_test::test_layout_at() {
+    auto vim_clang_get_layout_at =
+        reinterpret_cast<char const* (*)(char const*)>(
+            dlsym(m_handle, "vim_clang_get_layout_at"));
+    assert(vim_clang_get_layout_at);
+
+    std::string expected =
+        "{'name':'padded','size':24,'align':8,'base_size':0,'padding':11,"
+        "'cache_lines':1,'fields':[{'name':'c','type':'char','offset':0,"
+        "'size':1,'align':1,'straddles_cache_line':0},{'name':'d','type':"
+        "'double','offset':8,'size':8,'align':8,'straddles_cache_line':0},"
+        "{'name':'i','type':'int','offset':16,'size':4,'align':4,"
+        "'straddles_cache_line':0},],'holes':[{'offset':1,'size':7,"
+        "'after':'c'},{'offset':20,'size':4,'after':'i'},]}";
+    std::string actual(
+        vim_clang_get_layout_at("qa/data/layout.cpp:-std=c++11:1:8"));
+    CPPUNIT_ASSERT_EQUAL(expected, actual);
+}
+
+void location_test::test_layout_at_field() {
+    auto vim_clang_get_layout_at =
+        reinterpret_cast<char const* (*)(char const*)>(
+            dlsym(m_handle, "vim_clang_get_layout_at"));
+    assert(vim_clang_get_layout_at);
+
+    // A field of a non-class type shows the enclosing class.
+    std::string expected =
+        "{'name':'packed','size':66,'align':1,'base_size':0,'padding':0,"
+        "'cache_lines':2,'fields':[{'name':'head','type':'char [62]',"
+        "'offset':0,'size':62,'align':1,'straddles_cache_line':0},{'name':"
+        "'value','type':'int','offset':62,'size':4,'align':4,"
+        "'straddles_cache_line':1},],'holes':[]}";
+    std::string actual(
+        vim_clang_get_layout_at("qa/data/layout.cpp:-std=c++11:10:9"));
+    CPPUNIT_ASSERT_EQUAL(expected, actual);
+}
+
+void location_test::test_layout_at_virtual_destructor() {
+    auto vim_clang_get_layout_at =
+        reinterpret_cast<char const* (*)(char const*)>(
+            dlsym(m_handle, "vim_clang_get_layout_at"));
+    assert(vim_clang_get_layout_at);
+
+    // The vtable pointer of a virtual destructor is not padding.
+    std::string expected =
+        "{'name':'with_virtual_destructor','size':16,'align':8,"
+        "'base_size':8,'padding':0,'cache_lines':1,'fields':[{'name':'x',"
+        "'type':'int','offset':8,'size':4,'align':4,"
+        "'straddles_cache_line':0},{'name':'y','type':'int','offset':12,"
+        "'size':4,'align':4,'straddles_cache_line':0},],'holes':[]}";
+    std::string actual(
+        vim_clang_get_layout_at("qa/data/layout.cpp:-std=c++11:14:8"));
+    CPPUNIT_ASSERT_EQUAL(expected, actual);
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(location_test);
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,159 @@
+#include <iostream>
+#include <dlfcn.h>
+#include <cassert>
+#include <string>
+#include <vector>
+#include <cppunit/extensions/HelperMacros.h>
+
+class profile_test : public CPPUNIT_NS::TestFixture {
+    CPPUNIT_TEST_SUITE(profile_test);
+    CPPUNIT_TEST(test_profile_includes);
+    CPPUNIT_TEST(test_profile_project);
+    CPPUNIT_TEST(test_extract_virtual_calls);
+    CPPUNIT_TEST(test_extract_function_metrics);
+    CPPUNIT_TEST_SUITE_END();
+
+    void test_profile_includes();
+    void test_profile_project();
+    void test_extract_virtual_calls();
+    void test_extract_function_metrics();
+
+    void* m_handle;
+
+  public:
+    profile_test();
+    profile_test(const profile_test&) = delete;
+    profile_test& operator=(const profile_test&) = delete;
+
+    void setUp() override;
+    void tearDown() override;
+};
+
+namespace {
+
+void collect_result(char const* result, void* data) {
+    static_cast<std::vector<std::string>*>(data)->push_back(result);
+}
+
+bool starts_with(const std::string& s, const std::string& prefix) {
+    return s.compare(0, prefix.size(), prefix) == 0;
+}
+
+bool ends_with(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() &&
+           s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+}
+
+profile_test::profile_test() : m_handle(nullptr) {}
+
+void profile_test::setUp() {
+    m_handle = dlopen("lib/libclang-vim.so", RTLD_NOW);
+    if (!m_handle) {
+        std::stringstream ss;
+        ss << "dlopen() failed: ";
+        ss << dlerror();
+        CPPUNIT_FAIL(ss.str());
+    }
+}
+
+void profile_test::tearDown() {
+    if (m_handle)
+        dlclose(m_handle);
+}
+
+void profile_test::test_profile_includes() {
+    auto vim_clang_profile_includes =
+        reinterpret_cast<char const* (*)(char const*)>(
+            dlsym(m_handle, "vim_clang_profile_includes"));
+    assert(vim_clang_profile_includes);
+
+    std::string actual(vim_clang_profile_includes(
+        SRC_ROOT "/qa/data/index/a.cpp:-std=c++11"));
+
+    // Times and memory vary, so only check what's around them.
+    CPPUNIT_ASSERT(starts_with(
+        actual, "{'file':'" SRC_ROOT "/qa/data/index/a.cpp','parse_time':"));
+    CPPUNIT_ASSERT(actual.find("'includes':[{'file':'" SRC_ROOT
+                               "/qa/data/index/shared.hpp','line':1,"
+                               "'parse_time':") != std::string::npos);
+    std::string expected("'headers':1},],'headers':[{'file':'" SRC_ROOT
+                         "/qa/data/index/shared.hpp','depth':1,'entries':1,"
+                         "'via':'" SRC_ROOT "/qa/data/index/shared.hpp'},]}");
+    CPPUNIT_ASSERT(ends_with(actual, expected));
+}
+
+void profile_test::test_profile_project() {
+    auto vim_clang_profile_project = reinterpret_cast<char const* (*)(
+        char const*, unsigned, char const*, void (*)(char const*, void*),
+        void*)>(dlsym(m_handle, "vim_clang_profile_project"));
+    assert(vim_clang_profile_project);
+
+    std::vector<std::string> results;
+    std::string report(vim_clang_profile_project(
+        SRC_ROOT "/qa/data/index", 2, "csv", collect_result, &results));
+    CPPUNIT_ASSERT(starts_with(
+        report, "file,parse_time,memory,included_files,ast_nodes,error\n"));
+    CPPUNIT_ASSERT(report.find("\n" SRC_ROOT "/qa/data/index/a.cpp,") !=
+                   std::string::npos);
+    CPPUNIT_ASSERT(report.find("\n" SRC_ROOT "/qa/data/index/b.cpp,") !=
+                   std::string::npos);
+
+    // Rows are reported as soon as they are ready, in the same format; the
+    // error column is empty.
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), results.size());
+    CPPUNIT_ASSERT(starts_with(results[0], SRC_ROOT "/qa/data/index/"));
+    CPPUNIT_ASSERT(ends_with(results[0], ","));
+
+    results.clear();
+    report = vim_clang_profile_project(SRC_ROOT "/qa/data/index", 2, "json",
+                                       collect_result, &results);
+    CPPUNIT_ASSERT(starts_with(report, "{\"translation_units\":[{\"file\":\""));
+    CPPUNIT_ASSERT(report.find("],\"failed\":0,\"wall_time\":") !=
+                   std::string::npos);
+}
+
+void profile_test::test_extract_virtual_calls() {
+    auto vim_clang_extract_virtual_calls =
+        reinterpret_cast<char const* (*)(char const*)>(
+            dlsym(m_handle, "vim_clang_extract_virtual_calls"));
+    assert(vim_clang_extract_virtual_calls);
+
+    std::string expected(
+        "[{'file':'qa/data/virtual-calls.cpp','line':12,'col':27,"
+        "'function':'total_area','method':'shape::area',"
+        "'receiver_type':'const shape *','loop_depth':1,'overriders':["
+        "{'name':'square::area','file':'qa/data/virtual-calls.cpp',"
+        "'line':6,'col':9},]},]");
+    std::string actual(vim_clang_extract_virtual_calls(
+        "qa/data/virtual-calls.cpp:-std=c++11"));
+    CPPUNIT_ASSERT_EQUAL(expected, actual);
+}
+
+void profile_test::test_extract_function_metrics() {
+    auto vim_clang_extract_function_metrics =
+        reinterpret_cast<char const* (*)(char const*)>(
+            dlsym(m_handle, "vim_clang_extract_function_metrics"));
+    assert(vim_clang_extract_function_metrics);
+
+    // The number of nodes depends on the implicit casts libclang exposes.
+    std::string actual(vim_clang_extract_function_metrics(
+        "qa/data/function-metrics.cpp:-std=c++11"));
+    CPPUNIT_ASSERT(starts_with(
+        actual, "[{'name':'helper','line':1,'statements':1,'nodes':"));
+    CPPUNIT_ASSERT(actual.find("'max_depth':0,'loops':0,'calls':0,"
+                               "'lines':1,},{'name':'sum','line':3,"
+                               "'statements':5,'nodes':") !=
+                   std::string::npos);
+    CPPUNIT_ASSERT(ends_with(
+        actual, "'max_depth':2,'loops':1,'calls':1,'lines':8,},]"));
+
+    // The second time comes from the cache.
+    CPPUNIT_ASSERT_EQUAL(actual,
+                         std::string(vim_clang_extract_function_metrics(
+                             "qa/data/function-metrics.cpp:-std=c++11")));
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(profile_test);
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,345 @@
+#include <iostream>
+#include <dlfcn.h>
+#include <fstream>
+#include <cassert>
+#include <string>
+#include <vector>
+#include <cppunit/extensions/HelperMacros.h>
+
+class project_test : public CPPUNIT_NS::TestFixture {
+    CPPUNIT_TEST_SUITE(project_test);
+    CPPUNIT_TEST(test_sweep_diagnostics);
+    CPPUNIT_TEST(test_project_definition_at);
+    CPPUNIT_TEST(test_project_references_at);
+    CPPUNIT_TEST(test_update_project_index);
+    CPPUNIT_TEST(test_search_project_symbols);
+    CPPUNIT_TEST(test_project_includers);
+    CPPUNIT_TEST(test_project_include_path);
+    CPPUNIT_TEST(test_scan_padding);
+    CPPUNIT_TEST(test_project_virtual_calls);
+    CPPUNIT_TEST(test_measure_functions);
+    CPPUNIT_TEST_SUITE_END();
+
+    void test_sweep_diagnostics();
+    void test_project_definition_at();
+    void test_project_references_at();
+    void test_update_project_index();
+    void test_search_project_symbols();
+    void test_project_includers();
+    void test_project_include_path();
+    void test_scan_padding();
+    void test_project_virtual_calls();
+    void test_measure_functions();
+
+    void build_project_index();
+
+    void* m_handle;
+
+  public:
+    project_test();
+    project_test(const project_test&) = delete;
+    project_test& operator=(const project_test&) = delete;
+
+    void setUp() override;
+    void tearDown() override;
+};
+
+namespace {
+
+void collect_result(char const* result, void* data) {
+    static_cast<std::vector<std::string>*>(data)->push_back(result);
+}
+
+bool starts_with(const std::string& s, const std::string& prefix) {
+    return s.compare(0, prefix.size(), prefix) == 0;
+}
+
+bool ends_with(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() &&
+           s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+}
+
+project_test::project_test() : m_handle(nullptr) {}
+
+void project_test::setUp() {
+    m_handle = dlopen("lib/libclang-vim.so", RTLD_NOW);
+    if (!m_handle) {
+        std::stringstream ss;
+        ss << "dlopen() failed: ";
+        ss << dlerror();
+        CPPUNIT_FAIL(ss.str());
+    }
+}
+
+void project_test::tearDown() {
+    if (m_handle)
+        dlclose(m_handle);
+}
+
+void project_test::test_sweep_diagnostics() {
+    auto vim_clang_sweep_diagnostics = reinterpret_cast<char const* (*)(
+        char const*, unsigned, void (*)(char const*, void*), void*)>(
+        dlsym(m_handle, "vim_clang_sweep_diagnostics"));
+    assert(vim_clang_sweep_diagnostics);
+
+    std::vector<std::string> results;
+    std::string summary(vim_clang_sweep_diagnostics(
+        SRC_ROOT "/qa/data/compile-commands", 2, collect_result, &results));
+    CPPUNIT_ASSERT(starts_with(summary, "{'files':1,'failed':0,'wall_time':"));
+
+    // Times vary, so only check what's around them.
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(1), results.size());
+    CPPUNIT_ASSERT(starts_with(results[0], "{'file':'" SRC_ROOT
+                                           "/qa/data/compile-commands/"
+                                           "test.cpp','parse_time':"));
+    CPPUNIT_ASSERT(ends_with(results[0], ",'diagnostics':[]}"));
+}
+
+void project_test::build_project_index() {
+    auto vim_clang_build_project_index =
+        reinterpret_cast<char const* (*)(char const*, unsigned, int)>(
+            dlsym(m_handle, "vim_clang_build_project_index"));
+    assert(vim_clang_build_project_index);
+
+    std::string summary(
+        vim_clang_build_project_index(SRC_ROOT "/qa/data/index", 2, 0));
+    CPPUNIT_ASSERT(starts_with(summary, "{'translation_units':2,'failed':0,"
+                                        "'files':3,'symbols':7,'wall_time':"));
+}
+
+void project_test::test_project_definition_at() {
+    auto vim_clang_get_project_definition_at =
+        reinterpret_cast<char const* (*)(char const*)>(
+            dlsym(m_handle, "vim_clang_get_project_definition_at"));
+    assert(vim_clang_get_project_definition_at);
+    build_project_index();
+
+    // The call in b.cpp resolves to the definition in a.cpp, which is not
+    // visible from b.cpp.
+    std::string expected("[{'file':'" SRC_ROOT "/qa/data/index/a.cpp',"
+                         "'line':3,'col':5,'role':'definition'},]");
+    std::string actual(vim_clang_get_project_definition_at(
+        SRC_ROOT "/qa/data/index/b.cpp:-std=c++11:3:23"));
+    CPPUNIT_ASSERT_EQUAL(expected, actual);
+}
+
+void project_test::test_project_references_at() {
+    auto vim_clang_get_project_references_at =
+        reinterpret_cast<char const* (*)(char const*)>(
+            dlsym(m_handle, "vim_clang_get_project_references_at"));
+    assert(vim_clang_get_project_references_at);
+    build_project_index();
+
+    std::string expected(
+        "[{'file':'" SRC_ROOT "/qa/data/index/a.cpp','line':3,'col':5,"
+        "'role':'definition'},{'file':'" SRC_ROOT "/qa/data/index/b.cpp',"
+        "'line':3,'col':23,'role':'reference'},{'file':'" SRC_ROOT
+        "/qa/data/index/shared.hpp','line':1,'col':5,'role':'declaration'},]");
+    std::string actual(vim_clang_get_project_references_at(
+        SRC_ROOT "/qa/data/index/a.cpp:-std=c++11:3:5"));
+    CPPUNIT_ASSERT_EQUAL(expected, actual);
+}
+
+void project_test::test_update_project_index() {
+    auto vim_clang_update_project_index =
+        reinterpret_cast<char const* (*)(char const*)>(
+            dlsym(m_handle, "vim_clang_update_project_index"));
+    assert(vim_clang_update_project_index);
+    build_project_index();
+
+    // Nothing changed.
+    std::string actual(
+        vim_clang_update_project_index(SRC_ROOT "/qa/data/index"));
+    CPPUNIT_ASSERT(starts_with(actual, "{'translation_units':2,'failed':0,"
+                                       "'reindexed':[],'removed':[],"));
+
+    // Changing the header means both translation units are indexed again.
+    const std::string header = SRC_ROOT "/qa/data/index/shared.hpp";
+    std::string contents;
+    {
+        std::ifstream stream(header.c_str());
+        contents.assign(std::istreambuf_iterator<char>(stream),
+                        std::istreambuf_iterator<char>());
+    }
+    {
+        std::ofstream stream(header.c_str());
+        stream << contents << "// changed\n";
+    }
+    actual = vim_clang_update_project_index(SRC_ROOT "/qa/data/index");
+    {
+        std::ofstream stream(header.c_str());
+        stream << contents;
+    }
+    std::string expected(
+        "{'translation_units':2,'failed':0,'reindexed':[{'file':'" SRC_ROOT
+        "/qa/data/index/a.cpp','reason':'" SRC_ROOT "/qa/data/index/"
+        "shared.hpp changed'},{'file':'" SRC_ROOT "/qa/data/index/b.cpp',"
+        "'reason':'" SRC_ROOT "/qa/data/index/shared.hpp changed'},],"
+        "'removed':[],");
+    CPPUNIT_ASSERT(starts_with(actual, expected));
+}
+
+void project_test::test_search_project_symbols() {
+    auto vim_clang_search_project_symbols =
+        reinterpret_cast<char const* (*)(char const*)>(
+            dlsym(m_handle, "vim_clang_search_project_symbols"));
+    assert(vim_clang_search_project_symbols);
+    build_project_index();
+
+    std::string expected("[{'name':'shared_function','kind':'function',"
+                         "'file':'" SRC_ROOT "/qa/data/index/a.cpp',"
+                         "'line':3,'col':5},]");
+    std::string actual(vim_clang_search_project_symbols(
+        SRC_ROOT "/qa/data/index:func:10"));
+    CPPUNIT_ASSERT_EQUAL(expected, actual);
+
+    // Queries match anywhere in the name, but the start of it ranks first.
+    expected = "[{'name':'caller','kind':'function','file':'" SRC_ROOT
+               "/qa/data/index/b.cpp','line':3,'col':5},"
+               "{'name':'shared_function','kind':'function','file':'" SRC_ROOT
+               "/qa/data/index/a.cpp','line':3,'col':5},]";
+    actual = vim_clang_search_project_symbols(SRC_ROOT "/qa/data/index:c:10");
+    CPPUNIT_ASSERT_EQUAL(expected, actual);
+
+    // Abbreviations are subsequences of the name, not substrings.
+    expected = "[{'name':'shared_function','kind':'function','file':'" SRC_ROOT
+               "/qa/data/index/a.cpp','line':3,'col':5},]";
+    actual =
+        vim_clang_search_project_symbols(SRC_ROOT "/qa/data/index:sfn:10");
+    CPPUNIT_ASSERT_EQUAL(expected, actual);
+}
+
+void project_test::test_project_includers() {
+    auto vim_clang_get_project_includers =
+        reinterpret_cast<char const* (*)(char const*)>(
+            dlsym(m_handle, "vim_clang_get_project_includers"));
+    assert(vim_clang_get_project_includers);
+    build_project_index();
+
+    std::string expected(
+        "[{'file':'" SRC_ROOT "/qa/data/index/a.cpp','line':1,'depth':1,"
+        "'translation_unit':1},{'file':'" SRC_ROOT "/qa/data/index/b.cpp',"
+        "'line':1,'depth':1,'translation_unit':1},]");
+    std::string actual(vim_clang_get_project_includers(
+        SRC_ROOT "/qa/data/index/shared.hpp"));
+    CPPUNIT_ASSERT_EQUAL(expected, actual);
+
+    // Nothing includes a translation unit.
+    actual =
+        vim_clang_get_project_includers(SRC_ROOT "/qa/data/index/a.cpp");
+    CPPUNIT_ASSERT_EQUAL(std::string("[]"), actual);
+}
+
+void project_test::test_project_include_path() {
+    auto vim_clang_build_project_index =
+        reinterpret_cast<char const* (*)(char const*, unsigned, int)>(
+            dlsym(m_handle, "vim_clang_build_project_index"));
+    assert(vim_clang_build_project_index);
+    auto vim_clang_get_project_includers =
+        reinterpret_cast<char const* (*)(char const*)>(
+            dlsym(m_handle, "vim_clang_get_project_includers"));
+    assert(vim_clang_get_project_includers);
+    auto vim_clang_get_project_references_at =
+        reinterpret_cast<char const* (*)(char const*)>(
+            dlsym(m_handle, "vim_clang_get_project_references_at"));
+    assert(vim_clang_get_project_references_at);
+
+    // The header is found through -Iinclude, relative to the directory of
+    // the compile command, not to ours.
+    std::string summary(vim_clang_build_project_index(
+        SRC_ROOT "/qa/data/include-path", 2, 0));
+    CPPUNIT_ASSERT(starts_with(summary, "{'translation_units':1,'failed':0,"
+                                        "'files':2,"));
+
+    std::string expected("[{'file':'" SRC_ROOT "/qa/data/include-path/"
+                         "main.cpp','line':1,'depth':1,"
+                         "'translation_unit':1},]");
+    std::string actual(vim_clang_get_project_includers(
+        SRC_ROOT "/qa/data/include-path/include/widget.hpp"));
+    CPPUNIT_ASSERT_EQUAL(expected, actual);
+
+    actual = vim_clang_get_project_references_at(
+        SRC_ROOT "/qa/data/include-path/main.cpp:-std=c++11:3:5");
+    CPPUNIT_ASSERT(actual.find("{'file':'" SRC_ROOT "/qa/data/include-path/"
+                               "include/widget.hpp','line':1,'col':5,"
+                               "'role':'declaration'},") !=
+                   std::string::npos);
+}
+
+void project_test::test_scan_padding() {
+    auto vim_clang_scan_padding =
+        reinterpret_cast<char const* (*)(char const*, unsigned)>(
+            dlsym(m_handle, "vim_clang_scan_padding"));
+    assert(vim_clang_scan_padding);
+
+    // The project has no index, so the waste is just the padding.
+    std::string expected(
+        "{'translation_units':1,'failed':0,'types':[{'name':'padded',"
+        "'file':'" SRC_ROOT "/qa/data/compile-commands/test.hpp','line':1,"
+        "'size':8,'padding':3,"
+        "'uses':0,'waste':3,'straddles_cache_line':0},],'wall_time':");
+    std::string actual(
+        vim_clang_scan_padding(SRC_ROOT "/qa/data/compile-commands", 2));
+    CPPUNIT_ASSERT(starts_with(actual, expected));
+}
+
+void project_test::test_project_virtual_calls() {
+    auto vim_clang_get_project_virtual_calls =
+        reinterpret_cast<char const* (*)(char const*)>(
+            dlsym(m_handle, "vim_clang_get_project_virtual_calls"));
+    assert(vim_clang_get_project_virtual_calls);
+    build_project_index();
+
+    // The overrider is in an other translation unit than the call.
+    std::string expected(
+        "[{'file':'" SRC_ROOT "/qa/data/index/b.cpp','line':5,'col':41,"
+        "'method':'shape::area','overriders':[{'name':'square::area',"
+        "'file':'" SRC_ROOT "/qa/data/index/a.cpp','line':6,'col':9},]},]");
+    std::string actual(
+        vim_clang_get_project_virtual_calls(SRC_ROOT "/qa/data/index"));
+    CPPUNIT_ASSERT_EQUAL(expected, actual);
+}
+
+void project_test::test_measure_functions() {
+    auto vim_clang_measure_functions =
+        reinterpret_cast<char const* (*)(char const*, unsigned)>(
+            dlsym(m_handle, "vim_clang_measure_functions"));
+    assert(vim_clang_measure_functions);
+
+    std::string actual(
+        vim_clang_measure_functions(SRC_ROOT "/qa/data/index", 2));
+    CPPUNIT_ASSERT(starts_with(actual, "{'translation_units':2,'failed':0,"));
+    CPPUNIT_ASSERT(actual.find("{'file':'" SRC_ROOT "/qa/data/index/b.cpp',"
+                               "'name':'caller','line':3,'statements':1,") !=
+                   std::string::npos);
+
+    // Nothing changed, so nothing is parsed again.
+    actual = vim_clang_measure_functions(SRC_ROOT "/qa/data/index", 2);
+    CPPUNIT_ASSERT(starts_with(actual, "{'translation_units':2,'failed':0,"
+                                       "'cached':2,'functions':["));
+
+    // Both translation units include the changed header.
+    const std::string header = SRC_ROOT "/qa/data/index/shared.hpp";
+    std::string contents;
+    {
+        std::ifstream stream(header.c_str());
+        contents.assign(std::istreambuf_iterator<char>(stream),
+                        std::istreambuf_iterator<char>());
+    }
+    {
+        std::ofstream stream(header.c_str());
+        stream << contents << "// changed\n";
+    }
+    actual = vim_clang_measure_functions(SRC_ROOT "/qa/data/index", 2);
+    {
+        std::ofstream stream(header.c_str());
+        stream << contents;
+    }
+    CPPUNIT_ASSERT(starts_with(actual, "{'translation_units':2,'failed':0,"
+                                       "'cached':0,'functions':["));
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(project_test);
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cppunit/extensions/HelperMacros.h>
+
+class server_test : public CPPUNIT_NS::TestFixture {
+    CPPUNIT_TEST_SUITE(server_test);
+    CPPUNIT_TEST(test_server);
+    CPPUNIT_TEST(test_cancel);
+    CPPUNIT_TEST(test_identical);
+    CPPUNIT_TEST(test_parallel);
+    CPPUNIT_TEST(test_priority);
+    CPPUNIT_TEST(test_unit_generation);
+    CPPUNIT_TEST(test_vim_project_timeout);
+    CPPUNIT_TEST_SUITE_END();
+
+    void test_server();
+    void test_cancel();
+    void test_identical();
+    void test_parallel();
+    void test_priority();
+    void test_unit_generation();
+    void test_vim_project_timeout();
+};
+
+namespace {
+
+/// Runs the server with one request per argument on stdin, returns the
+/// response lines, sorted by id.
+std::vector<std::string> run_server(const std::vector<std::string>& requests) {
+    std::string command = "printf '%s\\n'";
+    for (const auto& request : requests)
+        command += " '" + request + "'";
+    command += " | server/libclang-vim-server";
+
+    std::vector<std::string> responses;
+    FILE* pipe = popen(command.c_str(), "r");
+    if (!pipe)
+        return responses;
+
+    std::string line;
+    int c;
+    while ((c = std::fgetc(pipe)) != EOF) {
+        if (c != '\n') {
+            line += static_cast<char>(c);
+            continue;
+        }
+        responses.push_back(line);
+        line.clear();
+    }
+    pclose(pipe);
+    std::sort(responses.begin(), responses.end());
+    return responses;
+}
+}
+
+void server_test::test_server() {
+    std::vector<std::string> responses = run_server(
+        {"[1,{\"method\":\"vim_clang_get_include_at\",\"argument\":"
+         "\"qa/data/compile-commands/test.cpp:-std=c++1y -I" SRC_ROOT
+         "/qa/data/compile-commands/:1:2\"}]",
+         "[2,{\"method\":\"vim_clang_foo\"}]",
+         "[3,{\"method\":\"vim_clang_version\"}]"});
+
+    // The result is converted to JSON.
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(3), responses.size());
+    CPPUNIT_ASSERT_EQUAL(std::string("[1,{\"result\":{\"file\":\"" SRC_ROOT
+                                     "/qa/data/compile-commands/test.hpp\"}}]"),
+                         responses[0]);
+    CPPUNIT_ASSERT_EQUAL(
+        std::string("[2,{\"error\":\"unknown method: vim_clang_foo\"}]"),
+        responses[1]);
+    CPPUNIT_ASSERT_EQUAL(std::string("[3,{\"result\":\""),
+                         responses[2].substr(0, 13));
+}
+
+void server_test::test_cancel() {
+    const std::string argument =
+        "\"qa/data/compile-commands/test.cpp:-std=c++1y -I" SRC_ROOT
+        "/qa/data/compile-commands/:1:";
+    std::vector<std::string> responses = run_server(
+        {"[1,{\"method\":\"vim_clang_get_include_at\",\"argument\":" +
+             argument + "1\"}]",
+         "[2,{\"method\":\"vim_clang_get_include_at\",\"argument\":" +
+             argument + "2\"}]"});
+
+    // Every request is answered, but only the latest one has to be run to the
+    // end.
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), responses.size());
+    const std::string result =
+        "{\"result\":{\"file\":\"" SRC_ROOT
+        "/qa/data/compile-commands/test.hpp\"}}]";
+    CPPUNIT_ASSERT(responses[0] == "[1,{\"error\":\"cancelled\"}]" ||
+                   responses[0] == "[1," + result);
+    CPPUNIT_ASSERT_EQUAL("[2," + result, responses[1]);
+}
+
+void server_test::test_identical() {
+    const std::string argument =
+        "\"qa/data/compile-commands/test.cpp:-std=c++1y -I" SRC_ROOT
+        "/qa/data/compile-commands/:1:2\"";
+    std::vector<std::string> responses = run_server(
+        {"[1,{\"method\":\"vim_clang_get_include_at\",\"argument\":" +
+             argument + "}]",
+         "[2,{\"method\":\"vim_clang_get_include_at\",\"argument\":" +
+             argument + "}]"});
+
+    // A repeated request doesn't cancel the first one, both get its result.
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), responses.size());
+    const std::string result =
+        "{\"result\":{\"file\":\"" SRC_ROOT
+        "/qa/data/compile-commands/test.hpp\"}}]";
+    CPPUNIT_ASSERT_EQUAL("[1," + result, responses[0]);
+    CPPUNIT_ASSERT_EQUAL("[2," + result, responses[1]);
+}
+
+void server_test::test_parallel() {
+    const std::string argument =
+        "\"qa/data/compile-commands/test.cpp:-std=c++1y -I" SRC_ROOT
+        "/qa/data/compile-commands/:1:2\"";
+    std::vector<std::string> responses = run_server(
+        {"[1,{\"method\":\"vim_clang_get_include_at\",\"argument\":" +
+             argument + "}]",
+         "[2,{\"method\":\"vim_clang_get_extent_of_node_at_specific_"
+         "location\",\"argument\":" +
+             argument + "}]",
+         "[3,{\"method\":\"vim_clang_get_current_function_at\","
+         "\"argument\":" +
+             argument + "}]"});
+
+    // Different methods don't supersede each other, even on the same file.
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(3), responses.size());
+    for (size_t i = 0; i < responses.size(); ++i) {
+        const std::string prefix =
+            "[" + std::to_string(i + 1) + ",{\"result\":";
+        CPPUNIT_ASSERT_EQUAL(prefix, responses[i].substr(0, prefix.size()));
+    }
+}
+
+void server_test::test_priority() {
+    std::vector<std::string> responses = run_server(
+        {"[1,{\"method\":\"vim_clang_get_scheduler_stats\",\"argument\":\"\","
+         "\"priority\":\"background\"}]",
+         "[2,{\"method\":\"vim_clang_get_scheduler_stats\",\"argument\":\"\","
+         "\"priority\":\"urgent\"}]"});
+
+    // The request itself is the running background one.
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(2), responses.size());
+    const std::string background = "\"background\":{\"waiting\":0,"
+                                   "\"running\":1,\"admitted\":1,";
+    CPPUNIT_ASSERT(responses[0].find(background) != std::string::npos);
+    CPPUNIT_ASSERT_EQUAL(
+        std::string("[2,{\"error\":\"unknown priority: urgent\"}]"),
+        responses[1]);
+}
+
+void server_test::test_unit_generation() {
+    std::vector<std::string> responses = run_server(
+        {"[1,{\"method\":\"vim_clang_extract_virtual_calls\",\"argument\":"
+         "\"qa/data/virtual-calls.cpp:-std=c++11\"}]",
+         "[2,{\"method\":\"vim_clang_version\"}]",
+         "[3,{\"method\":\"vim_clang_get_location_information\","
+         "\"argument\":\"qa/data/current-function.cpp:-std=c++1y:10:9\"}]"});
+
+    // The first parse of the cached translation unit is its generation 1;
+    // results that don't come from the cache have none.
+    CPPUNIT_ASSERT_EQUAL(static_cast<size_t>(3), responses.size());
+    const std::string suffix = "}]}],\"unit_generation\":1}]";
+    CPPUNIT_ASSERT(responses[0].size() > suffix.size());
+    CPPUNIT_ASSERT_EQUAL(suffix, responses[0].substr(responses[0].size() -
+                                                     suffix.size()));
+    CPPUNIT_ASSERT(responses[1].find("unit_generation") == std::string::npos);
+    // Cursor queries use the cached translation unit, too.
+    const std::string cursor_suffix = "},\"unit_generation\":1}]";
+    CPPUNIT_ASSERT(responses[2].size() > cursor_suffix.size());
+    CPPUNIT_ASSERT_EQUAL(cursor_suffix,
+                         responses[2].substr(responses[2].size() -
+                                             cursor_suffix.size()));
+}
+
+void server_test::test_vim_project_timeout() {
+    // The Vim wrappers need Vim with channels.
+    if (std::system("vim --version 2>/dev/null | grep -q '+channel'") != 0)
+        return;
+
+    const std::string result_file = "qa/data/vim/project-timeout.result";
+    std::remove(result_file.c_str());
+    const std::string command =
+        "LIBCLANG_VIM_RESULT=" + result_file +
+        " vim -N -u NONE -i NONE -es -S qa/data/vim/project-timeout.vim"
+        " </dev/null";
+    CPPUNIT_ASSERT_EQUAL(0, std::system(command.c_str()));
+
+    // The fake server answers after 3 seconds, more than ch_evalexpr()
+    // waits by default.
+    std::ifstream stream(result_file.c_str());
+    std::string result;
+    std::getline(stream, result);
+    std::remove(result_file.c_str());
+    CPPUNIT_ASSERT_EQUAL(std::string("'done'"), result);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(server_test);
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
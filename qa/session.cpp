@@ -0,0 +1,133 @@
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <dlfcn.h>
+#include <cassert>
+#include <cppunit/extensions/HelperMacros.h>
+
+struct vim_clang_session;
+
+class session_test : public CPPUNIT_NS::TestFixture {
+    CPPUNIT_TEST_SUITE(session_test);
+    CPPUNIT_TEST(test_session_call);
+    CPPUNIT_TEST(test_parallel_sessions);
+    CPPUNIT_TEST_SUITE_END();
+
+    void test_session_call();
+    void test_parallel_sessions();
+
+    void* m_handle;
+    vim_clang_session* (*m_create_session)();
+    void (*m_dispose_session)(vim_clang_session*);
+    char* (*m_session_call)(vim_clang_session*, char const*, char const*, int);
+    void (*m_free_result)(char*);
+
+    /// Runs method in session and returns its result as a string.
+    std::string call(vim_clang_session* session, char const* method,
+                     char const* argument, int json);
+
+  public:
+    session_test();
+    session_test(const session_test&) = delete;
+    session_test& operator=(const session_test&) = delete;
+
+    void setUp() override;
+    void tearDown() override;
+};
+
+namespace {
+
+const char include_at_argument[] =
+    "qa/data/compile-commands/test.cpp:-std=c++1y -I" SRC_ROOT
+    "/qa/data/compile-commands/:1:2";
+}
+
+session_test::session_test()
+    : m_handle(nullptr), m_create_session(nullptr),
+      m_dispose_session(nullptr), m_session_call(nullptr),
+      m_free_result(nullptr) {}
+
+void session_test::setUp() {
+    m_handle = dlopen("lib/libclang-vim.so", RTLD_NOW);
+    if (!m_handle) {
+        std::stringstream ss;
+        ss << "dlopen() failed: ";
+        ss << dlerror();
+        CPPUNIT_FAIL(ss.str());
+    }
+
+    m_create_session = reinterpret_cast<vim_clang_session* (*)()>(
+        dlsym(m_handle, "vim_clang_create_session"));
+    assert(m_create_session);
+    m_dispose_session = reinterpret_cast<void (*)(vim_clang_session*)>(
+        dlsym(m_handle, "vim_clang_dispose_session"));
+    assert(m_dispose_session);
+    m_session_call = reinterpret_cast<char* (*)(vim_clang_session*,
+                                                char const*, char const*, int)>(
+        dlsym(m_handle, "vim_clang_session_call"));
+    assert(m_session_call);
+    m_free_result = reinterpret_cast<void (*)(char*)>(
+        dlsym(m_handle, "vim_clang_free_result"));
+    assert(m_free_result);
+}
+
+void session_test::tearDown() {
+    if (m_handle)
+        dlclose(m_handle);
+}
+
+std::string session_test::call(vim_clang_session* session, char const* method,
+                               char const* argument, int json) {
+    char* result = m_session_call(session, method, argument, json);
+    if (!result)
+        return "(null)";
+
+    std::string ret(result);
+    m_free_result(result);
+    return ret;
+}
+
+void session_test::test_session_call() {
+    vim_clang_session* session = m_create_session();
+
+    CPPUNIT_ASSERT_EQUAL(
+        std::string("{\"file\":\"" SRC_ROOT
+                    "/qa/data/compile-commands/test.hpp\"}"),
+        call(session, "vim_clang_get_include_at", include_at_argument, 1));
+    CPPUNIT_ASSERT_EQUAL(
+        std::string("{'file':'" SRC_ROOT
+                    "/qa/data/compile-commands/test.hpp'}"),
+        call(session, "vim_clang_get_include_at", include_at_argument, 0));
+    CPPUNIT_ASSERT_EQUAL(std::string("(null)"),
+                         call(session, "vim_clang_foo", "", 1));
+
+    m_dispose_session(session);
+}
+
+void session_test::test_parallel_sessions() {
+    vim_clang_session* first = m_create_session();
+    vim_clang_session* second = m_create_session();
+
+    // Each thread owns its result, nothing is overwritten by the other one.
+    std::string first_result;
+    std::thread thread([this, first, &first_result] {
+        first_result =
+            call(first, "vim_clang_get_include_at", include_at_argument, 1);
+    });
+    const std::string second_result =
+        call(second, "vim_clang_get_include_at", include_at_argument, 1);
+    thread.join();
+
+    const std::string expected(
+        "{\"file\":\"" SRC_ROOT "/qa/data/compile-commands/test.hpp\"}");
+    CPPUNIT_ASSERT_EQUAL(expected, first_result);
+    CPPUNIT_ASSERT_EQUAL(expected, second_result);
+
+    m_dispose_session(second);
+    m_dispose_session(first);
+}
+
+CPPUNIT_TEST_SUITE_REGISTRATION(session_test);
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */
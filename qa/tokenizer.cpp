@@ -4,14 +4,18 @@
 #include <cassert>
 #include <cppunit/extensions/HelperMacros.h>
 
+#include "../lib/libclang-vim/clang_vim.h"
+
 class tokenizer_test : public CPPUNIT_NS::TestFixture {
     CPPUNIT_TEST_SUITE(tokenizer_test);
     CPPUNIT_TEST(test_tokens);
     CPPUNIT_TEST(test_unsaved_tokens);
+    CPPUNIT_TEST(test_token_nodes);
     CPPUNIT_TEST_SUITE_END();
 
     void test_tokens();
     void test_unsaved_tokens();
+    void test_token_nodes();
 
     void* m_handle;
 
@@ -63,6 +67,39 @@ void tokenizer_test::test_unsaved_tokens() {
     CPPUNIT_ASSERT(actual != "[]");
 }
 
+void tokenizer_test::test_token_nodes() {
+    auto vim_clang_get_token_nodes =
+        reinterpret_cast<vim_clang_nodes* (*)(char const*)>(
+            dlsym(m_handle, "vim_clang_get_token_nodes"));
+    assert(vim_clang_get_token_nodes);
+    auto vim_clang_free_nodes = reinterpret_cast<void (*)(vim_clang_nodes*)>(
+        dlsym(m_handle, "vim_clang_free_nodes"));
+    assert(vim_clang_free_nodes);
+
+    vim_clang_nodes* result =
+        vim_clang_get_token_nodes("qa/data/declaration.cpp:-std=c++1y");
+    CPPUNIT_ASSERT(result);
+    CPPUNIT_ASSERT(result->count > 2);
+
+    // "namespace ns {": a keyword, then an identifier (CXToken_Keyword and
+    // CXToken_Identifier).
+    const vim_clang_node& keyword = result->nodes[0];
+    CPPUNIT_ASSERT_EQUAL(1, keyword.kind);
+    CPPUNIT_ASSERT_EQUAL(std::string("namespace"),
+                         std::string(result->strings + keyword.name));
+    CPPUNIT_ASSERT_EQUAL(0U, keyword.start_offset);
+    CPPUNIT_ASSERT_EQUAL(9U, keyword.end_offset);
+    CPPUNIT_ASSERT_EQUAL(-1, keyword.parent);
+    const vim_clang_node& identifier = result->nodes[1];
+    CPPUNIT_ASSERT_EQUAL(2, identifier.kind);
+    CPPUNIT_ASSERT_EQUAL(std::string("ns"),
+                         std::string(result->strings + identifier.name));
+    CPPUNIT_ASSERT_EQUAL(1U, identifier.start_line);
+    CPPUNIT_ASSERT_EQUAL(11U, identifier.start_column);
+
+    vim_clang_free_nodes(result);
+}
+
 CPPUNIT_TEST_SUITE_REGISTRATION(tokenizer_test);
 
 /* vim:set shiftwidth=4 softtabstop=4 expandtab: */
@@ -0,0 +1,491 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "clang_vim.h"
+#include "helpers.hpp"
+#include "scheduler.hpp"
+#include "session.hpp"
+#include "thread_pool.hpp"
+#include "translation_unit_cache.hpp"
+
+namespace {
+
+using libcall_function = char const* (*)(char const*);
+
+using method_map = std::map<std::string, libcall_function>;
+
+method_map get_methods() {
+    method_map methods;
+#define LIBCLANG_VIM_ADD_METHOD(name) methods[#name] = name;
+    LIBCLANG_VIM_LIBCALL_FUNCTIONS(LIBCLANG_VIM_ADD_METHOD)
+#undef LIBCLANG_VIM_ADD_METHOD
+    return methods;
+}
+
+void skip_space(const std::string& s, size_t& pos) {
+    while (pos < s.size() && std::strchr(" \t\r\n", s[pos]))
+        ++pos;
+}
+
+bool skip_char(const std::string& s, size_t& pos, char c) {
+    skip_space(s, pos);
+    if (pos >= s.size() || s[pos] != c)
+        return false;
+    ++pos;
+    return true;
+}
+
+void append_utf8(unsigned code_point, std::string& ret) {
+    if (code_point < 0x80)
+        ret += static_cast<char>(code_point);
+    else if (code_point < 0x800) {
+        ret += static_cast<char>(0xc0 | code_point >> 6);
+        ret += static_cast<char>(0x80 | (code_point & 0x3f));
+    } else {
+        ret += static_cast<char>(0xe0 | code_point >> 12);
+        ret += static_cast<char>(0x80 | (code_point >> 6 & 0x3f));
+        ret += static_cast<char>(0x80 | (code_point & 0x3f));
+    }
+}
+
+bool parse_string(const std::string& s, size_t& pos, std::string& ret) {
+    if (!skip_char(s, pos, '"'))
+        return false;
+
+    ret.clear();
+    while (pos < s.size() && s[pos] != '"') {
+        if (s[pos] != '\\') {
+            ret += s[pos++];
+            continue;
+        }
+
+        if (++pos >= s.size())
+            return false;
+        const char c = s[pos++];
+        switch (c) {
+        case 'b':
+            ret += '\b';
+            break;
+        case 'f':
+            ret += '\f';
+            break;
+        case 'n':
+            ret += '\n';
+            break;
+        case 'r':
+            ret += '\r';
+            break;
+        case 't':
+            ret += '\t';
+            break;
+        case 'u': {
+            if (pos + 4 > s.size())
+                return false;
+            char* end;
+            const std::string digits = s.substr(pos, 4);
+            const unsigned long code_point =
+                std::strtoul(digits.c_str(), &end, 16);
+            if (*end)
+                return false;
+            append_utf8(code_point, ret);
+            pos += 4;
+            break;
+        }
+        default:
+            ret += c;
+        }
+    }
+    return skip_char(s, pos, '"');
+}
+
+/// Numbers are kept as text, that's what libcall() passes, too.
+bool parse_number(const std::string& s, size_t& pos, std::string& ret) {
+    skip_space(s, pos);
+    const size_t end = s.find_first_not_of("+-.0123456789eE", pos);
+    ret = s.substr(pos, end == std::string::npos ? end : end - pos);
+    pos = end == std::string::npos ? s.size() : end;
+    return !ret.empty();
+}
+
+bool parse_scalar(const std::string& s, size_t& pos, std::string& ret) {
+    skip_space(s, pos);
+    if (pos < s.size() && s[pos] == '"')
+        return parse_string(s, pos, ret);
+    return parse_number(s, pos, ret);
+}
+
+/// A request of the Vim channel protocol in JSON mode:
+/// [id,{"method":"vim_clang_...","argument":"...","priority":"..."}], the
+/// priority is optional.
+class request {
+  public:
+    std::string id;
+    std::string method;
+    std::string argument;
+    std::string priority;
+
+    /// Returns false if line is not a request.
+    bool parse(const std::string& line);
+};
+
+bool request::parse(const std::string& line) {
+    size_t pos = 0;
+    if (!skip_char(line, pos, '[') || !parse_number(line, pos, id) ||
+        !skip_char(line, pos, ',') || !skip_char(line, pos, '{'))
+        return false;
+
+    skip_space(line, pos);
+    while (pos < line.size() && line[pos] != '}') {
+        std::string key;
+        std::string value;
+        if (!parse_string(line, pos, key) || !skip_char(line, pos, ':') ||
+            !parse_scalar(line, pos, value))
+            return false;
+        if (key == "method")
+            method = value;
+        else if (key == "argument")
+            argument = value;
+        else if (key == "priority")
+            priority = value;
+        if (!skip_char(line, pos, ','))
+            break;
+        skip_space(line, pos);
+    }
+    return skip_char(line, pos, '}') && skip_char(line, pos, ']');
+}
+
+/// Requests of the same method for the same buffer supersede each other,
+/// unless they have the same argument: the buffer is the file part of
+/// "file:args..." (without an unsaved "#temp" file), or the whole argument,
+/// e.g. a directory.
+std::string get_supersede_key(const request& r) {
+    const std::string buffer = r.argument.substr(0, r.argument.find(':'));
+    return r.method + "\n" + buffer.substr(0, buffer.find('#'));
+}
+
+/// A request the worker hasn't answered yet.
+class job {
+  public:
+    /// The request and the identical ones that arrived before it finished.
+    std::vector<std::string> ids;
+    libcall_function method;
+    std::string argument;
+    std::string key;
+    libclang_vim::request_priority priority;
+    libclang_vim::scheduler::clock::time_point queued;
+    std::shared_ptr<libclang_vim::cancellation_token> token;
+};
+
+/// Answers the requests of one client: the reading thread submits them,
+/// worker threads run them in parallel, one per core and one more that
+/// background requests leave to the others. Waiting requests start by
+/// priority, see libclang_vim::scheduler. A new request cancels the waiting
+/// and the running ones it supersedes, so only the latest cursor position of
+/// a fast navigation is queried to the end. A request identical to a waiting
+/// or running one gets its result instead.
+class connection {
+    const method_map& _methods;
+    FILE* _output;
+    /// Caches of the client, independent of other clients.
+    libclang_vim::session _state;
+    std::mutex _output_mutex;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::deque<job> _pending;
+    std::vector<std::shared_ptr<job>> _running;
+    const unsigned _background_limit;
+    unsigned _running_background;
+    bool _closed;
+
+    void respond(const std::string& id, const std::string& message);
+
+    /// Adds the id of r to a waiting or running job with the same arguments,
+    /// returns false if there is none. The caller holds _mutex.
+    bool attach(const request& r, const std::string& key,
+                libclang_vim::request_priority priority);
+
+    /// The first pending job of the highest priority that may start now.
+    std::deque<job>::iterator find_next();
+
+  public:
+    connection(const method_map& methods, FILE* output,
+               unsigned background_limit)
+        : _methods(methods), _output(output),
+          _background_limit(background_limit), _running_background(0),
+          _closed(false) {}
+
+    void submit(const std::string& line);
+
+    /// No more requests, the workers return once the pending ones are
+    /// answered.
+    void close();
+
+    void work();
+};
+
+void connection::respond(const std::string& id, const std::string& message) {
+    const std::string response = "[" + id + "," + message + "]\n";
+    std::lock_guard<std::mutex> lock(_output_mutex);
+    std::fwrite(response.data(), 1, response.size(), _output);
+    std::fflush(_output);
+}
+
+bool connection::attach(const request& r, const std::string& key,
+                        libclang_vim::request_priority priority) {
+    for (auto& pending : _pending) {
+        if (pending.key != key || pending.argument != r.argument)
+            continue;
+        pending.ids.push_back(r.id);
+        if (priority < pending.priority) {
+            libclang_vim::get_scheduler().dequeue(pending.priority);
+            libclang_vim::get_scheduler().enqueue(priority);
+            pending.priority = priority;
+            _condition.notify_all();
+        }
+        return true;
+    }
+    for (const auto& running : _running) {
+        if (running->key != key || running->argument != r.argument ||
+            running->token->is_cancelled())
+            continue;
+        running->ids.push_back(r.id);
+        return true;
+    }
+    return false;
+}
+
+void connection::submit(const std::string& line) {
+    request r;
+    if (!r.parse(line)) {
+        respond("0", "{\"error\":\"invalid request\"}");
+        return;
+    }
+
+    if (r.method == "vim_clang_version") {
+        const std::string version =
+            libclang_vim::escape_json(vim_clang_version());
+        respond(r.id, "{\"result\":\"" + version + "\"}");
+        return;
+    }
+
+    auto const method = _methods.find(r.method);
+    if (method == _methods.end()) {
+        respond(r.id, "{\"error\":\"unknown method: " +
+                          libclang_vim::escape_json(r.method) + "\"}");
+        return;
+    }
+
+    job j;
+    j.priority = libclang_vim::get_default_priority(r.method);
+    if (!r.priority.empty() &&
+        !libclang_vim::parse_request_priority(r.priority, j.priority)) {
+        respond(r.id, "{\"error\":\"unknown priority: " +
+                          libclang_vim::escape_json(r.priority) + "\"}");
+        return;
+    }
+    j.ids.push_back(r.id);
+    j.method = method->second;
+    j.argument = r.argument;
+    j.key = get_supersede_key(r);
+    j.queued = libclang_vim::scheduler::clock::now();
+    j.token = std::make_shared<libclang_vim::cancellation_token>();
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (attach(r, j.key, j.priority))
+        return;
+    for (auto it = _pending.begin(); it != _pending.end();) {
+        if (it->key != j.key) {
+            ++it;
+            continue;
+        }
+        for (const auto& id : it->ids)
+            respond(id, "{\"error\":\"cancelled\"}");
+        libclang_vim::get_scheduler().dequeue(it->priority);
+        it = _pending.erase(it);
+    }
+    for (const auto& running : _running) {
+        if (running->key == j.key)
+            running->token->cancel();
+    }
+    libclang_vim::get_scheduler().enqueue(j.priority);
+    _pending.push_back(std::move(j));
+    _condition.notify_all();
+}
+
+void connection::close() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _closed = true;
+    _condition.notify_all();
+}
+
+std::deque<job>::iterator connection::find_next() {
+    auto next = _pending.end();
+    for (auto it = _pending.begin(); it != _pending.end(); ++it) {
+        if (it->priority == libclang_vim::request_priority::background &&
+            _running_background >= _background_limit)
+            continue;
+        if (next == _pending.end() || it->priority < next->priority)
+            next = it;
+    }
+    return next;
+}
+
+void connection::work() {
+    const auto background = libclang_vim::request_priority::background;
+    while (true) {
+        std::shared_ptr<job> j;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _condition.wait(lock, [this] {
+                return (_closed && _pending.empty()) ||
+                       find_next() != _pending.end();
+            });
+            auto const next = find_next();
+            if (next == _pending.end())
+                return;
+            j = std::make_shared<job>(std::move(*next));
+            _pending.erase(next);
+            _running.push_back(j);
+            if (j->priority == background)
+                ++_running_background;
+        }
+
+        std::string result;
+        unsigned long generation;
+        {
+            libclang_vim::scheduler_slot slot(j->priority, j->queued,
+                                              /*enqueued=*/true);
+            libclang_vim::session_scope session(_state);
+            libclang_vim::cancellation_scope scope(*j->token);
+            libclang_vim::reset_answered_generation();
+            result =
+                libclang_vim::vimson_to_json(j->method(j->argument.c_str()));
+            generation = libclang_vim::get_answered_generation();
+        }
+        std::vector<std::string> ids;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _running.erase(std::find(_running.begin(), _running.end(), j));
+            ids = j->ids;
+            if (j->priority == background) {
+                --_running_background;
+                _condition.notify_all();
+            }
+        }
+
+        std::string message;
+        if (j->token->is_cancelled())
+            message = "{\"error\":\"cancelled\"}";
+        else if (generation)
+            message = "{\"result\":" + result + ",\"unit_generation\":" +
+                      std::to_string(generation) + "}";
+        else
+            message = "{\"result\":" + result + "}";
+        for (const auto& id : ids)
+            respond(id, message);
+    }
+}
+
+/// Answers the requests of input on output, one line each, until input is
+/// closed.
+void serve(const method_map& methods, FILE* input, FILE* output) {
+    const unsigned jobs = libclang_vim::get_default_jobs();
+    connection c(methods, output, jobs);
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i <= jobs; ++i)
+        workers.emplace_back(&connection::work, &c);
+
+    char* line = nullptr;
+    size_t capacity = 0;
+    ssize_t size;
+    while ((size = getline(&line, &capacity, input)) > 0) {
+        const std::string request(line, size);
+        if (request.find_first_not_of(" \t\r\n") == std::string::npos)
+            continue;
+
+        c.submit(request);
+    }
+    std::free(line);
+
+    c.close();
+    for (auto& worker : workers)
+        worker.join();
+}
+
+int serve_socket(const method_map& methods, const char* path) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (std::strlen(path) >= sizeof(address.sun_path)) {
+        std::fprintf(stderr, "socket path is too long: %s\n", path);
+        return 1;
+    }
+    std::strcpy(address.sun_path, path);
+
+    const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path);
+    if (listener < 0 ||
+        bind(listener, reinterpret_cast<sockaddr*>(&address),
+             sizeof(address)) != 0 ||
+        listen(listener, 1) != 0) {
+        std::perror(path);
+        return 1;
+    }
+
+    // One client at a time, each one gets all the cores.
+    while (true) {
+        const int client = accept(listener, nullptr, nullptr);
+        if (client < 0)
+            continue;
+
+        FILE* input = fdopen(client, "r");
+        FILE* output = fdopen(dup(client), "w");
+        if (input && output)
+            serve(methods, input, output);
+        if (input)
+            std::fclose(input);
+        if (output)
+            std::fclose(output);
+    }
+}
+}
+
+/// Serves the libcall() functions of libclang-vim.so out of process: one
+/// JSON request per line on stdin, or on a Unix domain socket, and one JSON
+/// response per line.
+int main(int argc, char** argv) {
+    const char* socket_path = nullptr;
+    if (argc == 3 && std::strcmp(argv[1], "--socket") == 0)
+        socket_path = argv[2];
+    else if (argc != 1) {
+        std::fprintf(stderr, "Usage: %s [--socket <path>]\n", argv[0]);
+        return 1;
+    }
+
+    // Keep the channel for responses, anything else the library or libclang
+    // print to stdout goes to stderr.
+    FILE* output = fdopen(dup(STDOUT_FILENO), "w");
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+
+    const method_map methods = get_methods();
+    if (socket_path)
+        return serve_socket(methods, socket_path);
+
+    serve(methods, stdin, output);
+    return 0;
+}
+
+/* vim:set shiftwidth=4 softtabstop=4 expandtab: */